@@ -2,42 +2,124 @@
 
 #include "chkhash.h"
 
-#include <regex.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
+#include "string/ctype/isascii.h"
 #include "string/strcmp/streq.h"
 #include "string/strcmp/strprefix.h"
 
 
 /*
- * match_regex - return true if match, false if not
+ * The characters of the base-64 encoding of crypt(5): [./A-Za-z0-9].
  */
-bool 
-match_regex(const char *pattern, const char *string) 
+static const bool  b64[UCHAR_MAX + 1] = {
+	['.'] = true,
+	['/'] = true,
+	['0' ... '9'] = true,
+	['A' ... 'Z'] = true,
+	['a' ... 'z'] = true,
+};
+
+
+/*
+ * b64_span - length of the initial segment of s made of base-64 characters
+ */
+static size_t
+b64_span(const char *s)
+{
+	size_t  n = 0;
+
+	while (b64[(unsigned char) s[n]])
+		n++;
+
+	return n;
+}
+
+
+/*
+ * b64_field - skip a field of min to max base-64 characters ended by '$'
+ *
+ * Returns the string after the '$', or NULL if there is no such field.
+ */
+static const char *
+b64_field(const char *s, size_t min, size_t max)
 {
-	regex_t regex;
-	int result;
+	size_t  n;
+
+	n = b64_span(s);
+	if (n < min || n > max || s[n] != '$')
+		return NULL;
 
-	if (regcomp(&regex, pattern, REG_EXTENDED) != 0)
+	return s + n + 1;
+}
+
+
+/*
+ * is_b64_tail - return true if s is exactly len base-64 characters
+ */
+static bool
+is_b64_tail(const char *s, size_t len)
+{
+	return b64_span(s) == len && s[len] == '\0';
+}
+
+
+/*
+ * is_sha_tail - match salt + $ + len-char hash, as in a SHA-crypt hash.
+ */
+static bool
+is_sha_tail(const char *s, size_t len)
+{
+	size_t  n;
+
+	n = strcspn(s, "$:\n");
+	if (n < 1 || n > 16 || s[n] != '$')
 		return false;
 
-	result = regexec(&regex, string, 0, NULL, 0);
-	regfree(&regex);
+	return is_b64_tail(s + n + 1, len);
+}
+
 
-	return result == 0;
+/*
+ * is_sha - match [rounds=N$] + salt + $ + len-char hash
+ *
+ * N is 4 to 9 digits, not starting with 0.  A rounds= which is not
+ * valid can still be the beginning of the salt.
+ */
+static bool
+is_sha(const char *s, size_t len)
+{
+	const char  *p;
+	size_t      n;
+
+	p = strprefix(s, "rounds=");
+	if (p != NULL && *p != '0') {
+		n = strspn(p, CTYPE_DIGIT_C);
+		if (n >= 4 && n <= 9 && p[n] == '$'
+		    && is_sha_tail(p + n + 1, len))
+		{
+			return true;
+		}
+	}
+
+	return is_sha_tail(s, len);
 }
 
 
 /*
  * is_valid_hash - check if the string is a valid shadow(5) 2nd field.
  *
- * regex from: https://man.archlinux.org/man/crypt.5.en
+ * The formats are those of https://man.archlinux.org/man/crypt.5.en
  */
 bool 
 is_valid_hash(const char *hash) 
 {
+	const char  *p;
+
 	// Password temporarily locked
 	hash = strprefix(hash, "!") ?: hash;
 
@@ -54,20 +136,33 @@ is_valid_hash(const char *hash)
 		return false;
 
 	// Yescrypt: $y$ + algorithm parameters + $ + salt + $ + 43-char hash
-	if (match_regex("^\\$y\\$[./A-Za-z0-9]+\\$[./A-Za-z0-9]{1,86}\\$[./A-Za-z0-9]{43}$", hash))
-		return true;
+	p = strprefix(hash, "$y$");
+	if (p != NULL) {
+		p = b64_field(p, 1, SIZE_MAX);
+		if (p != NULL)
+			p = b64_field(p, 1, 86);
+		return p != NULL && is_b64_tail(p, 43);
+	}
 
 	// Bcrypt: $2[abxy]$ + 2-digit cost + $ + 53-char hash
-	if (match_regex("^\\$2[abxy]\\$[0-9]{2}\\$[./A-Za-z0-9]{53}$", hash))
-		return true;
+	p = strprefix(hash, "$2");
+	if (p != NULL) {
+		return p[0] != '\0' && strchr("abxy", p[0]) != NULL
+		    && p[1] == '$'
+		    && isdigit_c(p[2]) && isdigit_c(p[3])
+		    && p[4] == '$'
+		    && is_b64_tail(p + 5, 53);
+	}
 
 	// SHA-512: $6$ + salt + $ + 86-char hash
-	if (match_regex("^\\$6\\$(rounds=[1-9][0-9]{3,8}\\$)?[^$:\n]{1,16}\\$[./A-Za-z0-9]{86}$", hash))
-		return true;
+	p = strprefix(hash, "$6$");
+	if (p != NULL)
+		return is_sha(p, 86);
 
 	// SHA-256: $5$ + salt + $ + 43-char hash
-	if (match_regex("^\\$5\\$(rounds=[1-9][0-9]{3,8}\\$)?[^$:\n]{1,16}\\$[./A-Za-z0-9]{43}$", hash))
-		return true;
+	p = strprefix(hash, "$5$");
+	if (p != NULL)
+		return is_sha(p, 43);
 
 	// Not a valid hash
 	return false;
@@ -15,33 +15,86 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 
+#include "alloc/malloc.h"
 #include "defines.h"
 #include "prototypes.h"
 #include "string/strcmp/streq.h"
+#include "workpool.h"
 
 
-static int chown_tree_at (int at_fd,
-                const char *path,
-                uid_t old_uid,
-                uid_t new_uid,
-                gid_t old_gid,
-                gid_t new_gid)
+/*
+ * The subdirectories are handed to a pool of threads.  A subdirectory
+ * which cannot be queued is done by the thread which found it.
+ */
+struct chown_job {
+	int dir_fd;
+	uid_t old_uid;
+	uid_t new_uid;
+	gid_t old_gid;
+	gid_t new_gid;
+};
+
+static int chown_dir (struct workpool *wp, const struct chown_job *job);
+
+static void chown_job_run (struct workpool *wp, void *arg)
 {
-	DIR *dir;
-	const struct dirent *ent;
-	struct stat dir_sb;
-	int dir_fd, rc = 0;
+	struct chown_job *job = arg;
+
+	if (chown_dir (wp, job) != 0) {
+		workpool_fail (wp);
+	}
+	free (job);
+}
+
+/*
+ * chown_subdir - change the ownership in the directory path of at_fd
+ */
+static int chown_subdir (struct workpool *wp, int at_fd, const char *path,
+                         const struct chown_job *parent)
+{
+	struct chown_job *job;
+	struct chown_job local;
+	int dir_fd;
 
 	dir_fd = openat (at_fd, path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
 	if (dir_fd < 0) {
 		return -1;
 	}
 
-	dir = fdopendir (dir_fd);
+	job = malloc_T (1, struct chown_job);
+	if (NULL != job) {
+		*job = *parent;
+		job->dir_fd = dir_fd;
+		if (workpool_trysubmit (wp, chown_job_run, job)) {
+			return 0;
+		}
+		free (job);
+	}
+
+	local = *parent;
+	local.dir_fd = dir_fd;
+	return chown_dir (wp, &local);
+}
+
+/*
+ * chown_dir - change the ownership in the directory job->dir_fd
+ *
+ *	The entries of the directory, then the directory itself, are
+ *	changed.  job->dir_fd is closed.
+ */
+static int chown_dir (struct workpool *wp, const struct chown_job *job)
+{
+	DIR *dir;
+	const struct dirent *ent;
+	struct stat dir_sb;
+	int rc = 0;
+
+	dir = fdopendir (job->dir_fd);
 	if (!dir) {
-		(void) close (dir_fd);
+		(void) close (job->dir_fd);
 		return -1;
 	}
 
@@ -64,6 +117,14 @@ static int chown_tree_at (int at_fd,
 			continue;
 		}
 
+		/*
+		 * Give up if another directory failed
+		 */
+		if (workpool_failed (wp)) {
+			rc = -1;
+			break;
+		}
+
 		rc = fstatat (dirfd(dir), ent->d_name, &ent_sb, AT_SYMLINK_NOFOLLOW);
 		if (rc < 0) {
 			break;
@@ -71,12 +132,13 @@ static int chown_tree_at (int at_fd,
 
 		if (S_ISDIR (ent_sb.st_mode)) {
 			/*
-			 * Do the entire subdirectory.
+			 * Do the entire subdirectory, including its root.
 			 */
-			rc = chown_tree_at (dirfd(dir), ent->d_name, old_uid, new_uid, old_gid, new_gid);
+			rc = chown_subdir (wp, dirfd(dir), ent->d_name, job);
 			if (0 != rc) {
 				break;
 			}
+			continue;
 		}
 
 		/*
@@ -88,11 +150,11 @@ static int chown_tree_at (int at_fd,
 		 * If the file is not group-owned by the group, the
 		 * group-owner is not changed.
 		 */
-		if (((uid_t) -1 == old_uid) || (ent_sb.st_uid == old_uid)) {
-			tmpuid = new_uid;
+		if (((uid_t) -1 == job->old_uid) || (ent_sb.st_uid == job->old_uid)) {
+			tmpuid = job->new_uid;
 		}
-		if (((gid_t) -1 == old_gid) || (ent_sb.st_gid == old_gid)) {
-			tmpgid = new_gid;
+		if (((gid_t) -1 == job->old_gid) || (ent_sb.st_gid == job->old_gid)) {
+			tmpgid = job->new_gid;
 		}
 		if (((uid_t) -1 != tmpuid) || ((gid_t) -1 != tmpgid)) {
 			rc = fchownat (dirfd(dir), ent->d_name, tmpuid, tmpgid, AT_SYMLINK_NOFOLLOW);
@@ -108,11 +170,11 @@ static int chown_tree_at (int at_fd,
 	if ((0 == rc) && (fstat (dirfd(dir), &dir_sb) == 0)) {
 		uid_t tmpuid = (uid_t) -1;
 		gid_t tmpgid = (gid_t) -1;
-		if (((uid_t) -1 == old_uid) || (dir_sb.st_uid == old_uid)) {
-			tmpuid = new_uid;
+		if (((uid_t) -1 == job->old_uid) || (dir_sb.st_uid == job->old_uid)) {
+			tmpuid = job->new_uid;
 		}
-		if (((gid_t) -1 == old_gid) || (dir_sb.st_gid == old_gid)) {
-			tmpgid = new_gid;
+		if (((gid_t) -1 == job->old_gid) || (dir_sb.st_gid == job->old_gid)) {
+			tmpgid = job->new_gid;
 		}
 		if (((uid_t) -1 != tmpuid) || ((gid_t) -1 != tmpgid)) {
 			rc = fchown (dirfd(dir), tmpuid, tmpgid);
@@ -138,6 +200,9 @@ static int chown_tree_at (int at_fd,
  *
  *	new_uid and new_gid can be set to -1 to indicate that no owner or
  *	group-owner shall be changed.
+ *
+ *	The subdirectories are done in parallel when several processors
+ *	are online.
  */
 int chown_tree (const char *root,
                 uid_t old_uid,
@@ -145,5 +210,29 @@ int chown_tree (const char *root,
                 gid_t old_gid,
                 gid_t new_gid)
 {
-	return chown_tree_at (AT_FDCWD, root, old_uid, new_uid, old_gid, new_gid);
+	struct workpool wp;
+	struct chown_job job;
+	int rc;
+
+	/* Nothing would be changed */
+	if (((uid_t) -1 == new_uid) && ((gid_t) -1 == new_gid)) {
+		return 0;
+	}
+
+	job.dir_fd = openat (AT_FDCWD, root, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (job.dir_fd < 0) {
+		return -1;
+	}
+	job.old_uid = old_uid;
+	job.new_uid = new_uid;
+	job.old_gid = old_gid;
+	job.new_gid = new_gid;
+
+	workpool_start (&wp, 0);
+	rc = chown_dir (&wp, &job);
+	if (workpool_stop (&wp) != 0) {
+		rc = -1;
+	}
+
+	return rc;
 }
@@ -14,18 +14,25 @@
 #include <limits.h>
 #include <signal.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <stdlib.h>
+#include <time.h>
 #include <utime.h>
 
+#include "alloc/calloc.h"
 #include "alloc/malloc.h"
+#include "alloc/reallocf.h"
 #include "atoi/getnum.h"
 #include "commonio.h"
 #include "defines.h"
 #include "fs/mkstemp/fmkomstemp.h"
+#include "getdef.h"
 #include "io/fprintf.h"
+#include "io/syslog.h"
 #include "nscd.h"
 #ifdef WITH_TCB
 #include <tcb.h>
@@ -38,7 +45,6 @@
 #include "string/sprintf/stprintf.h"
 #include "string/strcmp/streq.h"
 #include "string/strcmp/strprefix.h"
-#include "string/strtok/stpsep.h"
 
 #undef NDEBUG
 #include <assert.h>
@@ -46,17 +52,30 @@
 
 /* local function prototypes */
 static int check_link_count (const char *file, bool log);
-static int do_lock_file (const char *file, const char *lock, bool log);
+static int do_lock_file (const char *file, const char *lock, bool log,
+                         pid_t *holder);
+static intmax_t monotonic_ns (void);
+static int lock_db (struct commonio_db *);
+static void lock_released (struct commonio_db *);
 static /*@null@*/ /*@dependent@*/FILE *fmkstemp_set_perms (
 	char *name,
 	const struct stat *sb);
+static int copy_range (int in, off_t off, off_t len, FILE *out);
+static int copy_file (const char *name, FILE *fp, const char *target);
 static int create_backup (const char *, FILE *);
+static int read_slab_text (struct commonio_db *);
+static int map_slab_text (struct commonio_db *);
+static /*@null@*/void *entry_eptr (const struct commonio_db *,
+                                   struct commonio_entry *);
+static int parse_all (struct commonio_db *);
+static void free_entry (struct commonio_db *,
+                        /*@only@*/struct commonio_entry *);
 static void free_linked_list (struct commonio_db *);
 static void add_one_entry (
 	struct commonio_db *db,
 	/*@owned@*/struct commonio_entry *p);
 static bool name_is_nis (const char *name);
-static int write_all (const struct commonio_db *);
+static int write_all (const struct commonio_db *, int);
 static /*@dependent@*/ /*@null@*/struct commonio_entry *find_entry_by_name (
 	struct commonio_db *,
 	const char *);
@@ -64,6 +83,18 @@ static /*@dependent@*/ /*@null@*/struct commonio_entry *next_entry_by_name (
 	struct commonio_db *,
 	/*@null@*/struct commonio_entry *pos,
 	const char *);
+static int name_is_duplicated (struct commonio_db *,
+                               const struct commonio_entry *,
+                               const char *);
+static void name_index_build (struct commonio_db *);
+static void name_index_free (struct commonio_db *);
+static void name_index_add (struct commonio_db *, struct commonio_entry *);
+static void name_index_del (struct commonio_db *,
+                            const struct commonio_entry *);
+static void id_index_free (struct commonio_db *);
+static void id_index_add (struct commonio_db *, struct commonio_entry *);
+static void id_index_del (struct commonio_db *,
+                          const struct commonio_entry *);
 
 static int lock_count = 0;
 static bool nscd_need_reload = false;
@@ -93,7 +124,8 @@ static int check_link_count (const char *file, bool log)
 }
 
 
-static int do_lock_file (const char *file, const char *lock, bool log)
+static int do_lock_file (const char *file, const char *lock, bool log,
+                         pid_t *holder)
 {
 	int      fd;
 	int      retval;
@@ -171,6 +203,7 @@ static int do_lock_file (const char *file, const char *lock, bool log)
 		return 0;
 	}
 	if (kill (pid, 0) == 0) {
+		*holder = pid;
 		if (log) {
 			(void) fprintf (log_get_logfd(),
 			                "%s: lock %s already used by PID %lu\n",
@@ -232,15 +265,68 @@ static /*@null@*/ /*@dependent@*/FILE *fmkstemp_set_perms (
 }
 
 
-static int create_backup (const char *name, FILE * fp)
+/*
+ * copy_range - Copy len bytes of the file open as in, starting at offset
+ *              off, to the end of the stream out.
+ *
+ *	The data is copied by the kernel when possible.
+ *	It returns 0 on success, -1 on failure.
+ */
+static int copy_range (int in, off_t off, off_t len, FILE *out)
+{
+	char     buf[65536];
+	ssize_t  n;
+
+	if (0 == len) {
+		return 0;
+	}
+	if (fflush (out) != 0) {
+		return -1;
+	}
+
+#ifdef HAVE_COPY_FILE_RANGE
+	while (len > 0) {
+		n = copy_file_range (in, &off, fileno (out), NULL, len, 0);
+		if (n <= 0) {
+			break;	/* fall back to read(2) and write(2) */
+		}
+		len -= n;
+	}
+#endif
+
+	while (len > 0) {
+		n = pread (in, buf, MIN(len, (off_t) sizeof (buf)), off);
+		if (n <= 0) {
+			return -1;
+		}
+		if (write_full (fileno (out), buf, n) == -1) {
+			return -1;
+		}
+		off += n;
+		len -= n;
+	}
+
+	/* The stream must write after what was copied. */
+	return fseeko (out, 0, SEEK_END);
+}
+
+
+/*
+ * copy_file - Replace target with a copy of fp, which is the file name.
+ *
+ *	The copy is written and synced next to name, and renamed over
+ *	target.  It keeps the times of fp.
+ */
+static int copy_file (const char *name, FILE *fp, const char *target)
 {
-	char  tmpf[PATH_MAX], target[PATH_MAX];
+	char  tmpf[PATH_MAX];
 	struct stat sb;
 	struct utimbuf ub;
 	FILE *bkfp;
-	int c;
 
-	stprintf_a(tmpf, "%s.cioXXXXXX", name);
+	if (stprintf_a(tmpf, "%s.cioXXXXXX", name) == -1) {
+		return -1;
+	}
 	if (fstat (fileno (fp), &sb) != 0) {
 		return -1;
 	}
@@ -250,16 +336,8 @@ static int create_backup (const char *name, FILE * fp)
 		return -1;
 	}
 
-	/* TODO: faster copy, not one-char-at-a-time.  --marekm */
-	c = 0;
-	if (fseek (fp, 0, SEEK_SET) == 0) {
-		while ((c = getc (fp)) != EOF) {
-			if (putc (c, bkfp) == EOF) {
-				break;
-			}
-		}
-	}
-	if ((c != EOF) || (ferror (fp) != 0) || (fflush (bkfp) != 0)) {
+	if (   (copy_range (fileno (fp), 0, sb.st_size, bkfp) != 0)
+	    || (fflush (bkfp) != 0)) {
 		(void) fclose (bkfp);
 		unlink(tmpf);
 		return -1;
@@ -274,7 +352,6 @@ static int create_backup (const char *name, FILE * fp)
 		return -1;
 	}
 
-	stprintf_a(target, "%s-", name);
 	if (rename(tmpf, target) != 0) {
 		unlink(tmpf);
 		return -1;
@@ -286,6 +363,147 @@ static int create_backup (const char *name, FILE * fp)
 	return 0;
 }
 
+static int create_backup (const char *name, FILE * fp)
+{
+	char  target[PATH_MAX];
+
+	if (stprintf_a(target, "%s-", name) == -1) {
+		return -1;
+	}
+	return copy_file (name, fp, target);
+}
+
+
+/*
+ * read_slab_text - Read the whole database file in db->slab_text.
+ *
+ *	The text is NUL terminated, but db->slab_text_size does not count
+ *	the terminating NUL.
+ *	It returns 0 on success, -1 on failure (with errno set).
+ */
+static int read_slab_text (struct commonio_db *db)
+	/*@requires notnull db->fp@*/
+{
+	char         *text;
+	size_t       len, size;
+	struct stat  sb;
+
+	size = BUFSIZ;
+	if ((fstat (fileno (db->fp), &sb) == 0) && (sb.st_size >= BUFSIZ)) {
+		size = sb.st_size + 1;
+	}
+
+	text = malloc_T(size, char);
+	if (NULL == text) {
+		return -1;
+	}
+
+	len = 0;
+	for (;;) {
+		len += fread (text + len, 1, size - len, db->fp);
+		if (len < size) {
+			break;
+		}
+		/* The file grew, or the size could not be known. */
+		size *= 2;
+		text = reallocf_T(text, size, char);
+		if (NULL == text) {
+			return -1;
+		}
+	}
+	if (ferror (db->fp) != 0) {
+		free (text);
+		return -1;
+	}
+	stpcpy(&text[len], "");
+
+	db->slab_text = text;
+	db->slab_text_size = len;
+	db->slab_text_mapped = false;
+	return 0;
+}
+
+
+/*
+ * map_slab_text - Map the whole database file in db->slab_text.
+ *
+ *	This is used for the databases open read-only, to avoid copying
+ *	the file.  The mapping is read-only, so that the pages are shared
+ *	with the page cache: the lines are not split, each of them ends at
+ *	its '\n', and the text is not NUL terminated.  The mapping is
+ *	private, so that commonio_split_lines() can split the lines in
+ *	place when they are needed as strings.
+ *	It returns 0 on success, -1 on failure (with errno set), in which
+ *	case the file should be read with read_slab_text().
+ */
+static int map_slab_text (struct commonio_db *db)
+	/*@requires notnull db->fp@*/
+{
+	void         *text;
+	struct stat  sb;
+
+	if (fstat (fileno (db->fp), &sb) != 0) {
+		return -1;
+	}
+	if (!S_ISREG (sb.st_mode) || (0 == sb.st_size)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	text = mmap (NULL, sb.st_size, PROT_READ, MAP_PRIVATE,
+	             fileno (db->fp), 0);
+	if (MAP_FAILED == text) {
+		return -1;
+	}
+
+	db->slab_text = text;
+	db->slab_text_size = sb.st_size;
+	db->slab_text_mapped = true;
+	return 0;
+}
+
+
+static bool in_slab_text (const struct commonio_db *db, const char *s)
+{
+	uintptr_t  a = (uintptr_t) s;
+	uintptr_t  start = (uintptr_t) db->slab_text;
+
+	return (NULL != s) && (a >= start) && (a - start < db->slab_text_size);
+}
+
+
+static bool in_slab_entries (const struct commonio_db *db,
+                             const struct commonio_entry *p)
+{
+	uintptr_t  a = (uintptr_t) p;
+	uintptr_t  start = (uintptr_t) db->slab_entries;
+
+	return (a >= start)
+	    && ((a - start) / sizeof (*p) < db->slab_entries_count);
+}
+
+
+/*
+ * free_entry - Free an entry, its line and its object.
+ *
+ *	The entry shall not be linked in the database anymore.
+ */
+static void free_entry (struct commonio_db *db,
+                        /*@only@*/struct commonio_entry *p)
+{
+	if (!in_slab_text (db, p->line)) {
+		free (p->line);
+	}
+
+	if (NULL != p->eptr) {
+		db->ops->cio_free(p->eptr);
+	}
+
+	if (!in_slab_entries (db, p)) {
+		free (p);
+	}
+}
+
 
 static void free_linked_list (struct commonio_db *db)
 {
@@ -294,15 +512,412 @@ static void free_linked_list (struct commonio_db *db)
 	while (NULL != db->head) {
 		p = db->head;
 		db->head = p->next;
+		free_entry (db, p);
+	}
+	db->tail = NULL;
+	name_index_free (db);
+	id_index_free (db);
+
+	free (db->slab_entries);
+	db->slab_entries = NULL;
+	db->slab_entries_count = 0;
+	if (db->slab_text_mapped) {
+		(void) munmap (db->slab_text, db->slab_text_size);
+	} else {
+		free (db->slab_text);
+	}
+	db->slab_text = NULL;
+	db->slab_text_size = 0;
+	db->slab_text_mapped = false;
+}
 
-		free (p->line);
 
-		if (NULL != p->eptr)
-			db->ops->cio_free(p->eptr);
+/*
+ * entry_eptr - Return the object of an entry, parsing its line first if
+ *              this was not done yet.
+ *
+ *	It returns NULL for the NIS entries, and for the lines which cannot
+ *	be parsed.
+ *	If there is not enough memory, it returns NULL with errno set to
+ *	ENOMEM, and p->parsed remains false: a lookup shall not report the
+ *	entry as missing, commonio_update() would add a duplicate.
+ */
+static /*@null@*/void *entry_eptr (const struct commonio_db *db,
+                                   struct commonio_entry *p)
+{
+	char  *line = p->line;
+	void  *eptr;
 
-		free (p);
+	if ((NULL != p->eptr) || p->parsed) {
+		return p->eptr;
+	}
+
+	/* A line of a mapped file ends at its '\n' */
+	if (db->slab_text_mapped && in_slab_text (db, line)) {
+		line = strndup (line, strcspn (line, "\n"));
+		if (NULL == line) {
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+
+	eptr = db->ops->cio_parse(line);
+	if (line != p->line) {
+		free (line);
+	}
+	if (NULL != eptr) {
+		eptr = db->ops->cio_dup(eptr);
+		if (NULL == eptr) {
+			errno = ENOMEM;
+			return NULL;
+		}
+	}
+
+	p->eptr = eptr;
+	p->parsed = true;
+	return eptr;
+}
+
+
+/*
+ * parse_all - Parse the entries which were not parsed yet.
+ *
+ *	It returns 0 on success, -1 if there was not enough memory (with
+ *	errno set).
+ */
+static int parse_all (struct commonio_db *db)
+{
+	struct commonio_entry  *p;
+
+	for (p = db->head; NULL != p; p = p->next) {
+		if ((NULL == entry_eptr (db, p)) && !p->parsed) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+/*
+ * Name index.
+ *
+ * The named entries are chained in hash buckets through their hnext
+ * field, so that looking up an entry by name does not need to walk the
+ * whole linked list.  The entries which are not parsed yet are indexed
+ * by the first field of their line, and only the entries of the right
+ * bucket with this key are parsed when they are looked up.  The linked list remains the
+ * reference for the order of the entries: when several entries have the
+ * same name, the first one in the list is searched the old way.
+ *
+ * If the index could not be allocated, db->name_index is NULL and all
+ * the lookups walk the linked list.
+ */
+#ifndef NAME_INDEX_MIN_SIZE
+#define NAME_INDEX_MIN_SIZE 64
+#endif
+
+static size_t name_hash (const char *name, size_t len)
+{
+	size_t  h = 2166136261U;	/* FNV-1a */
+
+	for (; len > 0; name++, len--) {
+		h ^= (unsigned char) *name;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static struct commonio_entry **name_bucket (const struct commonio_db *db,
+                                            const char *name, size_t len)
+{
+	return &db->name_index[  name_hash (name, len)
+	                       & (db->name_index_size - 1)];
+}
+
+/*
+ * The NIS entries are not named.  The other lines are, even if they
+ * cannot be parsed, so that an entry stays in the same bucket.
+ */
+static bool entry_is_named (const struct commonio_entry *p)
+{
+	return (NULL != p->eptr) || !name_is_nis (p->line);
+}
+
+/*
+ * entry_key - Return the name of a named entry, and its length in *len.
+ *
+ *	For an entry without object, this is the first field of the line,
+ *	which is not NUL terminated, and the line may end with a '\n'.
+ */
+static const char *entry_key (const struct commonio_db *db,
+                              const struct commonio_entry *p,
+                              size_t *len)
+{
+	const char  *name;
+
+	if (NULL != p->eptr) {
+		name = db->ops->cio_getname(p->eptr);
+		*len = strlen (name);
+	} else {
+		name = p->line;
+		*len = strcspn (name, ":\n");
+	}
+	return name;
+}
+
+/*
+ * entry_has_name - Check if an entry can be parsed and has this name.
+ *
+ *	It returns 1 if it has, 0 if it has not, and -1 if there was not
+ *	enough memory to parse it (with errno set).
+ */
+static int entry_has_name (const struct commonio_db *db,
+                           struct commonio_entry *p,
+                           const char *name, size_t len)
+{
+	size_t      klen;
+	const char  *key;
+	const void  *eptr;
+
+	if (!entry_is_named (p)) {
+		return 0;
+	}
+	key = entry_key (db, p, &klen);
+	if ((klen != len) || (memcmp (key, name, len) != 0)) {
+		return 0;
+	}
+
+	eptr = entry_eptr (db, p);
+	if (NULL == eptr) {
+		return p->parsed ? 0 : -1;
+	}
+	return streq(db->ops->cio_getname(eptr), name);
+}
+
+static int name_index_resize (struct commonio_db *db, size_t size)
+{
+	size_t                 i;
+	struct commonio_entry  **buckets, **b, *p, *next;
+
+	buckets = calloc_T(size, struct commonio_entry *);
+	if (NULL == buckets) {
+		return -1;
+	}
+
+	for (i = 0; i < db->name_index_size; i++) {
+		for (p = db->name_index[i]; NULL != p; p = next) {
+			size_t      len;
+			const char  *key;
+
+			next = p->hnext;
+			key = entry_key (db, p, &len);
+			b = &buckets[name_hash (key, len) & (size - 1)];
+			p->hnext = *b;
+			*b = p;
+		}
+	}
+
+	free (db->name_index);
+	db->name_index = buckets;
+	db->name_index_size = size;
+	return 0;
+}
+
+static void name_index_add (struct commonio_db *db, struct commonio_entry *p)
+{
+	size_t                 len;
+	const char             *key;
+	struct commonio_entry  **b;
+
+	if ((NULL == db->name_index) || !entry_is_named (p)) {
+		return;
+	}
+
+	/* If the index cannot grow, the chains just get longer. */
+	if (db->name_index_count >= db->name_index_size) {
+		(void) name_index_resize (db, db->name_index_size * 2);
+	}
+
+	key = entry_key (db, p, &len);
+	b = name_bucket (db, key, len);
+	p->hnext = *b;
+	*b = p;
+	db->name_index_count++;
+}
+
+static void name_index_del (struct commonio_db *db,
+                            const struct commonio_entry *p)
+{
+	size_t                 len;
+	const char             *key;
+	struct commonio_entry  **b;
+
+	if ((NULL == db->name_index) || !entry_is_named (p)) {
+		return;
+	}
+
+	key = entry_key (db, p, &len);
+	for (b = name_bucket (db, key, len); NULL != *b; b = &(*b)->hnext) {
+		if (*b == p) {
+			*b = p->hnext;
+			db->name_index_count--;
+			return;
+		}
+	}
+}
+
+static void name_index_free (struct commonio_db *db)
+{
+	free (db->name_index);
+	db->name_index = NULL;
+	db->name_index_size = 0;
+	db->name_index_count = 0;
+}
+
+static void name_index_build (struct commonio_db *db)
+{
+	size_t                 n, size;
+	struct commonio_entry  *p;
+
+	name_index_free (db);
+	if (NULL == db->ops->cio_getname) {
+		return;
+	}
+
+	n = 0;
+	for (p = db->head; NULL != p; p = p->next) {
+		if (entry_is_named (p)) {
+			n++;
+		}
+	}
+	for (size = NAME_INDEX_MIN_SIZE; size < n; size *= 2)
+		continue;
+
+	db->name_index = calloc_T(size, struct commonio_entry *);
+	if (NULL == db->name_index) {
+		return;
+	}
+	db->name_index_size = size;
+
+	for (p = db->head; NULL != p; p = p->next) {
+		name_index_add (db, p);
+	}
+}
+
+
+/*
+ * ID index.
+ *
+ * Same as the name index, for the databases which provide cio_getid,
+ * but chained through the inext field.  As only a few tools look up
+ * entries by ID, it is built on the first lookup, and then kept up to
+ * date like the name index.
+ */
+static size_t id_hash (id_t id)
+{
+	return (size_t) id * 2654435761U;	/* Knuth's multiplicative hash */
+}
+
+static struct commonio_entry **id_bucket (const struct commonio_db *db,
+                                          id_t id)
+{
+	return &db->id_index[id_hash (id) & (db->id_index_size - 1)];
+}
+
+static int id_index_resize (struct commonio_db *db, size_t size)
+{
+	size_t                 i;
+	struct commonio_entry  **buckets, **b, *p, *next;
+
+	buckets = calloc_T(size, struct commonio_entry *);
+	if (NULL == buckets) {
+		return -1;
+	}
+
+	for (i = 0; i < db->id_index_size; i++) {
+		for (p = db->id_index[i]; NULL != p; p = next) {
+			next = p->inext;
+			b = &buckets[  id_hash (db->ops->cio_getid(p->eptr))
+			             & (size - 1)];
+			p->inext = *b;
+			*b = p;
+		}
+	}
+
+	free (db->id_index);
+	db->id_index = buckets;
+	db->id_index_size = size;
+	return 0;
+}
+
+static void id_index_add (struct commonio_db *db, struct commonio_entry *p)
+{
+	struct commonio_entry  **b;
+
+	if ((NULL == db->id_index) || (NULL == p->eptr)) {
+		return;
+	}
+
+	if (db->id_index_count >= db->id_index_size) {
+		(void) id_index_resize (db, db->id_index_size * 2);
+	}
+
+	b = id_bucket (db, db->ops->cio_getid(p->eptr));
+	p->inext = *b;
+	*b = p;
+	db->id_index_count++;
+}
+
+static void id_index_del (struct commonio_db *db,
+                          const struct commonio_entry *p)
+{
+	struct commonio_entry  **b;
+
+	if ((NULL == db->id_index) || (NULL == p->eptr)) {
+		return;
+	}
+
+	for (b = id_bucket (db, db->ops->cio_getid(p->eptr));
+	     NULL != *b;
+	     b = &(*b)->inext) {
+		if (*b == p) {
+			*b = p->inext;
+			db->id_index_count--;
+			return;
+		}
+	}
+}
+
+static void id_index_free (struct commonio_db *db)
+{
+	free (db->id_index);
+	db->id_index = NULL;
+	db->id_index_size = 0;
+	db->id_index_count = 0;
+}
+
+static void id_index_build (struct commonio_db *db)
+{
+	size_t                 size;
+	struct commonio_entry  *p;
+
+	/* Without the index, commonio_locate_id() reports the failure */
+	if (parse_all (db) != 0) {
+		return;
+	}
+
+	for (size = NAME_INDEX_MIN_SIZE; size < db->name_index_count; size *= 2)
+		continue;
+
+	db->id_index = calloc_T(size, struct commonio_entry *);
+	if (NULL == db->id_index) {
+		return;
+	}
+	db->id_index_size = size;
+
+	for (p = db->head; NULL != p; p = p->next) {
+		id_index_add (db, p);
 	}
-	db->tail = NULL;
 }
 
 
@@ -338,8 +953,10 @@ int commonio_lock_nowait (struct commonio_db *db, bool log)
 	if (lock == NULL)
 		goto cleanup_ENOMEM;
 
-	if (do_lock_file (file, lock, log) != 0) {
+	if (do_lock_file (file, lock, log, &db->lock_holder) != 0) {
 		db->locked = true;
+		db->lock_time = monotonic_ns ();
+		db->lock_wait = 0;
 		lock_count++;
 		err = 1;
 	}
@@ -351,9 +968,120 @@ cleanup_ENOMEM:
 }
 
 
+/*
+ * Delays between two attempts to take a lock, in nanoseconds.
+ *
+ *	The delay doubles after each attempt, so that a lock which is
+ *	released quickly is taken quickly, while a lock which is held for
+ *	long is not polled too often.
+ */
+#define LOCK_DELAY_MIN  100000		/* 100 µs */
+#define LOCK_DELAY_MAX  100000000	/* 100 ms */
+
+/*
+ * monotonic_ns - Current CLOCK_MONOTONIC time, in nanoseconds.
+ *
+ *	It returns -1 if the clock cannot be read.
+ */
+static intmax_t monotonic_ns (void)
+{
+	struct timespec  now;
+
+	if (clock_gettime (CLOCK_MONOTONIC, &now) != 0) {
+		return -1;
+	}
+	return (intmax_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void lock_sleep (intmax_t ns)
+{
+	struct timespec  ts;
+
+	ts.tv_sec = ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	(void) nanosleep (&ts, NULL);
+}
+
+
+/*
+ * lock_stats_report - Report how long a database lock was waited for
+ * and held.
+ *
+ *	This is enabled by the SHADOW_LOCK_STATS environment variable.
+ *	If it is "syslog", the report is logged with syslog(3).  If it is
+ *	an absolute path, a line is appended to that file.  Set-ID
+ *	programs ignore it.
+ *
+ *	The holder is the last process seen holding the lock while
+ *	waiting for it, or 0.  hold is -1 if the lock could not be taken.
+ */
+static void lock_stats_report (const struct commonio_db *db, intmax_t hold)
+{
+	int         fd;
+	char        buf[sizeof(db->filename) + 128];
+	char        hbuf[64];
+	const char  *dest, *held;
+
+	if ((getuid () != geteuid ()) || (getgid () != getegid ())) {
+		return;
+	}
+	dest = shadow_getenv ("SHADOW_LOCK_STATS");
+	if (NULL == dest) {
+		return;
+	}
+
+	held = "failed";
+	if (hold >= 0) {
+		stprintf_a(hbuf, "hold=%jdus", hold / 1000);
+		held = hbuf;
+	}
+
+	if (streq(dest, "syslog")) {
+		SYSLOG(LOG_INFO, "lock %s: wait=%jdus %s holder=%jd",
+		       db->filename, db->lock_wait / 1000, held,
+		       (intmax_t) db->lock_holder);
+		return;
+	}
+	if (!strprefix(dest, "/")) {
+		return;
+	}
+
+	if (stprintf_a(buf, "%s[%jd]: lock %s: wait=%jdus %s holder=%jd\n",
+	               log_get_progname(), (intmax_t) getpid(), db->filename,
+	               db->lock_wait / 1000, held,
+	               (intmax_t) db->lock_holder) == -1)
+	{
+		return;
+	}
+	fd = open (dest, O_WRONLY | O_APPEND | O_CREAT | O_NOFOLLOW | O_CLOEXEC,
+	           0600);
+	if (-1 == fd) {
+		return;
+	}
+	(void) write_full (fd, buf, strlen (buf));
+	(void) close (fd);
+}
+
+
 int commonio_lock (struct commonio_db *db)
 {
-	int i;
+	int       ret;
+	intmax_t  start;
+
+	db->lock_holder = 0;
+	start = monotonic_ns ();
+	ret = lock_db (db);
+	db->lock_wait = monotonic_ns () - start;
+	if (0 == ret) {
+		lock_stats_report (db, -1);
+	}
+	return ret;
+}
+
+
+static int lock_db (struct commonio_db *db)
+{
+	intmax_t  delay, deadline, left;
 
 #ifdef HAVE_LCKPWDF
 	/*
@@ -388,20 +1116,18 @@ int commonio_lock (struct commonio_db *db)
 #endif				/* !HAVE_LCKPWDF */
 
 	/*
-	 * lckpwdf() not used - do it the old way.
+	 * lckpwdf() not used - retry until the lock is released, or
+	 * LOCK_TIMEOUT is reached.
 	 */
-#ifndef LOCK_TRIES
-#define LOCK_TRIES 15
-#endif
+	deadline = monotonic_ns ();
+	if (-1 == deadline) {
+		return commonio_lock_nowait (db, true);
+	}
+	deadline += (intmax_t) MAX(0, getdef_num ("LOCK_TIMEOUT", 15)) * 1000000000;
 
-#ifndef LOCK_SLEEP
-#define LOCK_SLEEP 1
-#endif
-	for (i = 0; i < LOCK_TRIES; i++) {
-		if (i > 0) {
-			sleep (LOCK_SLEEP);	/* delay between retries */
-		}
-		if (commonio_lock_nowait (db, i==LOCK_TRIES-1) != 0) {
+	for (delay = LOCK_DELAY_MIN;; delay = MIN(delay * 2, LOCK_DELAY_MAX)) {
+		left = deadline - monotonic_ns ();
+		if (commonio_lock_nowait (db, left <= 0) != 0) {
 			return 1;	/* success */
 		}
 		/* no unnecessary retries on "permission denied" errors */
@@ -410,8 +1136,11 @@ int commonio_lock (struct commonio_db *db)
 			                log_get_progname());
 			return 0;
 		}
+		if (left <= 0) {
+			return 0;	/* failure */
+		}
+		lock_sleep (MIN(delay, left));
 	}
-	return 0;		/* failure */
 }
 
 static void dec_lock_count (void)
@@ -434,6 +1163,15 @@ static void dec_lock_count (void)
 	}
 }
 
+/*
+ * lock_released - Account for the release of the lock of db.
+ */
+static void lock_released (struct commonio_db *db)
+{
+	lock_stats_report (db, monotonic_ns () - db->lock_time);
+	dec_lock_count ();
+}
+
 
 int commonio_unlock (struct commonio_db *db, bool process_selinux)
 {
@@ -443,7 +1181,7 @@ int commonio_unlock (struct commonio_db *db, bool process_selinux)
 		db->readonly = true;
 		if (commonio_close (db, process_selinux) == 0) {
 			if (db->locked) {
-				dec_lock_count ();
+				lock_released (db);
 			}
 			return 0;
 		}
@@ -456,7 +1194,7 @@ int commonio_unlock (struct commonio_db *db, bool process_selinux)
 		db->locked = false;
 		stprintf_a(lock, "%s.lock", db->filename);
 		unlink (lock);
-		dec_lock_count ();
+		lock_released (db);
 		return 1;
 	}
 	return 0;
@@ -539,11 +1277,11 @@ static void add_one_entry_nis (struct commonio_db *db,
 int
 commonio_open(struct commonio_db *db, int mode)
 {
-	char *buf;
 	char *line;
-	void *eptr = NULL;
+	char *next;
+	const char *end;
 	int flags = mode;
-	size_t buflen;
+	size_t n;
 	int fd;
 	int saved_errno;
 
@@ -565,6 +1303,7 @@ commonio_open(struct commonio_db *db, int mode)
 	db->tail = NULL;
 	db->cursor = NULL;
 	db->changed = false;
+	db->committed = false;
 
 	fd = open (db->filename,
 	             (db->readonly ? O_RDONLY : O_RDWR)
@@ -593,70 +1332,77 @@ commonio_open(struct commonio_db *db, int mode)
 	 */
 	if (NULL == db->fp) {
 		if (((flags & O_CREAT) != 0) && (ENOENT == errno)) {
+			name_index_build (db);
 			db->isopen = true;
 			return 1;
 		}
 		return 0;
 	}
 
-	buf = NULL;
-	while (getline(&buf, &buflen, db->fp) != -1) {
-		struct commonio_entry  *p;
+	/*
+	 * Read the file in a single buffer (or map it if it will not be
+	 * modified), and allocate all the entries at once.  The lines are
+	 * split in place, unless the file is mapped.
+	 */
+	if (   (!db->readonly || (map_slab_text (db) != 0))
+	    && (read_slab_text (db) != 0)) {
+		goto cleanup_errno;
+	}
 
-		if (stpsep(buf, "\n") == NULL) {
-			fprintf(log_get_logfd(), _("%s: Non-text file.\n"), db->filename);
-			goto cleanup_buf;
-		}
+	end = db->slab_text + db->slab_text_size;
+	if ((end != db->slab_text) && ('\n' != end[-1])) {
+		goto non_text;
+	}
 
-		line = strdup (buf);
-		if (NULL == line) {
-			goto cleanup_buf;
+	n = 0;
+	for (line = db->slab_text; line < end; line = next + 1) {
+		next = memchr (line, '\n', end - line);
+		n++;
+	}
+	if (n > 0) {
+		db->slab_entries = malloc_T(n, struct commonio_entry);
+		if (NULL == db->slab_entries) {
+			goto cleanup_ENOMEM;
 		}
+	}
 
-		if (name_is_nis (line)) {
-			eptr = NULL;
-		} else {
-			eptr = db->ops->cio_parse(line);
-			if (NULL != eptr) {
-				eptr = db->ops->cio_dup(eptr);
-				if (NULL == eptr) {
-					goto cleanup_line;
-				}
-			}
-		}
+	n = 0;
+	for (line = db->slab_text; line < end; line = next + 1) {
+		struct commonio_entry  *p;
 
-		p = malloc_T(1, struct commonio_entry);
-		if (NULL == p) {
-			goto cleanup_entry;
+		next = memchr (line, '\n', end - line);
+		if (memchr (line, '\0', next - line) != NULL) {
+			goto non_text;
+		}
+		if (!db->slab_text_mapped) {
+			stpcpy (next, "");
 		}
 
-		p->eptr = eptr;
+		p = &db->slab_entries[n];
+		db->slab_entries_count = ++n;
+
+		/* The line is only parsed when the entry is needed */
+		p->eptr = NULL;
 		p->line = line;
 		p->changed = false;
+		p->parsed = name_is_nis (line);
 
 		add_one_entry (db, p);
 	}
 
-	free (buf);
-
-	if (ferror (db->fp) != 0) {
-		goto cleanup_errno;
-	}
-
 	if ((NULL != db->ops->cio_open_hook) && (db->ops->cio_open_hook() == 0)) {
 		goto cleanup_errno;
 	}
 
+	/* The open hook may have merged entries, index what remains. */
+	name_index_build (db);
+
 	db->isopen = true;
 	return 1;
 
-      cleanup_entry:
-	if (NULL != eptr)
-		db->ops->cio_free(eptr);
-      cleanup_line:
-	free (line);
-      cleanup_buf:
-	free (buf);
+      non_text:
+	fprintf(log_get_logfd(), _("%s: Non-text file.\n"), db->filename);
+      cleanup_ENOMEM:
 	errno = ENOMEM;
       cleanup_errno:
 	saved_errno = errno;
@@ -680,6 +1426,10 @@ commonio_sort (struct commonio_db *db, int (*cmp) (const void *, const void *))
 	struct commonio_entry *nis = NULL;
 #endif
 
+	if (parse_all (db) != 0) {
+		return -1;
+	}
+
 	for (ptr = db->head;
 	        (NULL != ptr)
 #if KEEP_NIS_AT_END
@@ -746,9 +1496,54 @@ commonio_sort (struct commonio_db *db, int (*cmp) (const void *, const void *))
 		entries[i]->next = entries[i + 1];
 	}
 
-	free (entries);
-	db->changed = true;
+	free (entries);
+	db->changed = true;
+
+	return 0;
+}
+
+/*
+ * commonio_get_head - Return the first entry of the database.
+ *
+ *	This is for the callers which walk the linked list themselves, so
+ *	all the entries are parsed first.
+ *	It returns NULL if the database is empty, or if there was not
+ *	enough memory (with errno set).
+ */
+/*@dependent@*/ /*@null@*/struct commonio_entry *commonio_get_head (
+	struct commonio_db *db)
+{
+	if (parse_all (db) != 0) {
+		return NULL;
+	}
+	return db->head;
+}
+
+/*
+ * commonio_split_lines - NUL terminate the lines read from the file.
+ *
+ *	The lines of a file open read-only are not split when it is
+ *	mapped.  This is for the callers which use the lines of the
+ *	entries as strings: the private mapping is made writable, and the
+ *	lines are split in place.
+ *	It returns 0 on success, -1 on failure (with errno set).
+ */
+int commonio_split_lines (struct commonio_db *db)
+{
+	char  *s, *end;
+
+	if (!db->slab_text_mapped) {
+		return 0;
+	}
+	if (mprotect (db->slab_text, db->slab_text_size,
+	              PROT_READ | PROT_WRITE) != 0) {
+		return -1;
+	}
 
+	end = db->slab_text + db->slab_text_size;
+	for (s = db->slab_text; NULL != (s = memchr (s, '\n', end - s)); s++) {
+		stpcpy (s, "");
+	}
 	return 0;
 }
 
@@ -756,7 +1551,7 @@ commonio_sort (struct commonio_db *db, int (*cmp) (const void *, const void *))
  * Sort entries in db according to order in another.
  */
 int commonio_sort_wrt (struct commonio_db *shadow,
-                       const struct commonio_db *passwd)
+                       struct commonio_db *passwd)
 {
 	struct commonio_entry *head = NULL, *pw_ptr, *spw_ptr;
 	const char *name;
@@ -765,20 +1560,17 @@ int commonio_sort_wrt (struct commonio_db *shadow,
 		return 0;
 	}
 
+	/* Nothing can fail once the entries are moved */
+	if ((parse_all (passwd) != 0) || (parse_all (shadow) != 0)) {
+		return -1;
+	}
+
 	for (pw_ptr = passwd->head; NULL != pw_ptr; pw_ptr = pw_ptr->next) {
 		if (NULL == pw_ptr->eptr) {
 			continue;
 		}
 		name = passwd->ops->cio_getname(pw_ptr->eptr);
-		for (spw_ptr = shadow->head;
-		     NULL != spw_ptr;
-		     spw_ptr = spw_ptr->next) {
-			if (NULL == spw_ptr->eptr) {
-				continue;
-			}
-			if (streq(name, shadow->ops->cio_getname(spw_ptr->eptr)))
-				break;
-		}
+		spw_ptr = find_entry_by_name (shadow, name);
 		if (NULL == spw_ptr) {
 			continue;
 		}
@@ -795,6 +1587,8 @@ int commonio_sort_wrt (struct commonio_db *shadow,
 		}
 		spw_ptr->next = shadow->head;
 		shadow->head = spw_ptr;
+		name_index_add (shadow, spw_ptr);
+		id_index_add (shadow, spw_ptr);
 	}
 
 	shadow->head->prev = NULL;
@@ -806,15 +1600,45 @@ int commonio_sort_wrt (struct commonio_db *shadow,
 /*
  * write_all - Write the database to its file.
  *
+ * The unchanged lines which were read from the file open as fd, and
+ * which are still contiguous, are copied from it in a single span
+ * rather than written line by line.  fd can be -1 if there was no file.
+ *
  * It returns 0 if all the entries could be written correctly.
  */
-static int write_all (const struct commonio_db *db)
+static int write_all (const struct commonio_db *db, int fd)
 	/*@requires notnull db->fp@*/
 {
 	const struct commonio_entry *p;
 	void *eptr;
+	off_t span_off = 0;
+	off_t span_len = 0;
 
 	for (p = db->head; NULL != p; p = p->next) {
+		if (   !p->changed
+		    && (-1 != fd)
+		    && !db->slab_text_mapped
+		    && in_slab_text (db, p->line)) {
+			off_t  off = p->line - db->slab_text;
+			off_t  len = strlen (p->line) + 1;  /* with the '\n' */
+
+			if ((span_len > 0) && (span_off + span_len == off)) {
+				span_len += len;
+				continue;
+			}
+			if (copy_range (fd, span_off, span_len, db->fp) != 0) {
+				return -1;
+			}
+			span_off = off;
+			span_len = len;
+			continue;
+		}
+
+		if (copy_range (fd, span_off, span_len, db->fp) != 0) {
+			return -1;
+		}
+		span_len = 0;
+
 		if (p->changed) {
 			eptr = p->eptr;
 			assert (NULL != eptr);
@@ -830,41 +1654,86 @@ static int write_all (const struct commonio_db *db)
 			}
 		}
 	}
-	return 0;
+	return copy_range (fd, span_off, span_len, db->fp);
 }
 
 
 int
-commonio_close(struct commonio_db *db, MAYBE_UNUSED bool process_selinux)
+commonio_close(struct commonio_db *db, bool process_selinux)
 {
-	bool         errors = false;
-	char         tmpf[PATH_MAX];
-	struct stat  sb;
+	return commonio_close_all (&db, 1, process_selinux, NULL);
+}
 
-	if (!db->isopen) {
-		errno = EINVAL;
-		return 0;
+
+/*
+ * State of a database being written by commonio_close_all().
+ */
+struct close_state {
+	/*@dependent@*/ /*@null@*/FILE *orig;	/* the file being replaced */
+	char tmpf[PATH_MAX];			/* its replacement */
+	bool install;				/* tmpf shall be renamed */
+	bool installed;				/* tmpf was renamed */
+};
+
+
+/*
+ * restore_file - Put back the file replaced by commonio_close_all().
+ *
+ *	The original file is still open in st->orig; it is copied back.
+ *	A database which did not exist is removed.
+ *	It returns 0 on success, -1 on failure.
+ */
+static int restore_file (const struct commonio_db *db,
+                         const struct close_state *st,
+                         MAYBE_UNUSED bool process_selinux)
+{
+	int  ret;
+
+	if (NULL == st->orig) {
+		return unlink (db->filename);
 	}
-	db->isopen = false;
 
-	if (!db->changed || db->readonly) {
-		if (NULL != db->fp) {
-			(void) fclose (db->fp);
-			db->fp = NULL;
-		}
-		goto success;
+#ifdef WITH_SELINUX
+	if (process_selinux
+	    && set_selinux_file_context (db->filename, S_IFREG) != 0) {
+		return -1;
 	}
+#endif
+	ret = copy_file (db->filename, st->orig, db->filename);
+#ifdef WITH_SELINUX
+	if (process_selinux
+	    && reset_selinux_file_context () != 0) {
+		ret = -1;
+	}
+#endif
+	return ret;
+}
+
+
+/*
+ * prepare_close - Write the new content of a database to a temporary file.
+ *
+ *	The temporary file is left open in db->fp, and is not synced.
+ *	It returns 0 on success, -1 on failure.
+ */
+static int prepare_close (struct commonio_db *db, struct close_state *st,
+                          MAYBE_UNUSED bool process_selinux)
+{
+	bool         errors = false;
+	struct stat  sb;
 
 	if ((NULL != db->ops->cio_close_hook) && (db->ops->cio_close_hook() == 0)) {
-		goto fail;
+		return -1;
 	}
 
 	memzero(&sb, sizeof(sb));
 	if (NULL != db->fp) {
-		if (fstat (fileno (db->fp), &sb) != 0) {
-			(void) fclose (db->fp);
-			db->fp = NULL;
-			goto fail;
+		/* Keep it open, to copy the unchanged lines from it. */
+		st->orig = db->fp;
+		db->fp = NULL;
+
+		if (fstat (fileno (st->orig), &sb) != 0) {
+			return -1;
 		}
 
 		/*
@@ -876,16 +1745,10 @@ commonio_close(struct commonio_db *db, MAYBE_UNUSED bool process_selinux)
 			errors = true;
 		}
 #endif
-		if (create_backup(db->filename, db->fp) != 0) {
-			errors = true;
-		}
-
-		if (fclose (db->fp) != 0) {
+		if (create_backup(db->filename, st->orig) != 0) {
 			errors = true;
 		}
 
-		db->fp = NULL;
-
 #ifdef WITH_SELINUX
 		if (process_selinux
 		    && reset_selinux_file_context () != 0) {
@@ -893,7 +1756,7 @@ commonio_close(struct commonio_db *db, MAYBE_UNUSED bool process_selinux)
 		}
 #endif
 		if (errors)
-			goto fail;
+			return -1;
 	} else {
 		/*
 		 * Default permissions for new [g]shadow files.
@@ -903,8 +1766,8 @@ commonio_close(struct commonio_db *db, MAYBE_UNUSED bool process_selinux)
 		sb.st_gid = db->st_gid;
 	}
 
-	if (stprintf_a(tmpf, "%s.cioXXXXXX", db->filename) == -1)
-		goto fail;
+	if (stprintf_a(st->tmpf, "%s.cioXXXXXX", db->filename) == -1)
+		return -1;
 
 #ifdef WITH_SELINUX
 	if (process_selinux
@@ -913,12 +1776,21 @@ commonio_close(struct commonio_db *db, MAYBE_UNUSED bool process_selinux)
 	}
 #endif
 
-	db->fp = fmkstemp_set_perms(tmpf, &sb);
+	db->fp = fmkstemp_set_perms(st->tmpf, &sb);
+
+#ifdef WITH_SELINUX
+	if (process_selinux
+	    && reset_selinux_file_context () != 0) {
+		errors = true;
+	}
+#endif
+
 	if (NULL == db->fp) {
-		goto fail;
+		return -1;
 	}
+	st->install = true;
 
-	if (write_all (db) != 0) {
+	if (write_all (db, (NULL != st->orig) ? fileno (st->orig) : -1) != 0) {
 		errors = true;
 	}
 
@@ -926,74 +1798,306 @@ commonio_close(struct commonio_db *db, MAYBE_UNUSED bool process_selinux)
 		errors = true;
 	}
 
-	if (fsync (fileno (db->fp)) != 0) {
-		errors = true;
+	return errors ? -1 : 0;
+}
+
+
+/*
+ * commonio_close_all - Close several databases at once.
+ *
+ *	The databases which were changed are all written to temporary
+ *	files first.  Only if this succeeded for all of them, they are
+ *	synced, and then renamed over the original files.  If any database
+ *	cannot be written, none of the files is replaced.  If one of the
+ *	renames fails, the files which were already replaced are restored
+ *	from a copy of the original files, so that the databases are
+ *	changed together or not at all.  Each file is replaced atomically,
+ *	but a reader may see some of the new files before the others.
+ *
+ *	The databases are closed in any case, and their committed flag
+ *	tells whether this succeeded.
+ *	It returns 1 on success, 0 on failure.  On failure, the index of
+ *	the database which could not be written is stored in *failed,
+ *	unless failed is NULL.
+ */
+int
+commonio_close_all(struct commonio_db *const dbs[], size_t n,
+                   bool process_selinux, /*@null@*/size_t *failed)
+{
+	bool                errors = false;
+	size_t              i, bad = n;
+	struct close_state  single, *states;
+	struct commonio_db  *db;
+
+	for (i = 0; i < n; i++) {
+		if (!dbs[i]->isopen) {
+			if (NULL != failed) {
+				*failed = i;
+			}
+			errno = EINVAL;
+			return 0;
+		}
 	}
 
-	if (fclose (db->fp) != 0) {
-		errors = true;
+	/* Do not fail to close a single database for lack of memory */
+	if (1 == n) {
+		memzero(&single, sizeof(single));
+		states = &single;
+	} else {
+		states = calloc_T(n, struct close_state);
+		if (NULL == states) {
+			for (i = 0; i < n; i++) {
+				dbs[i]->isopen = false;
+				if (NULL != dbs[i]->fp) {
+					(void) fclose (dbs[i]->fp);
+					dbs[i]->fp = NULL;
+				}
+				free_linked_list (dbs[i]);
+			}
+			if (NULL != failed) {
+				*failed = 0;
+			}
+			return 0;
+		}
 	}
 
-	db->fp = NULL;
+	for (i = 0; i < n; i++) {
+		db = dbs[i];
+		db->isopen = false;
 
-	if (errors) {
-		unlink(tmpf);
-		goto fail;
+		if (!db->changed || db->readonly) {
+			if (NULL != db->fp) {
+				(void) fclose (db->fp);
+				db->fp = NULL;
+			}
+			continue;
+		}
+
+		if (errors) {
+			continue;
+		}
+		if (prepare_close (db, &states[i], process_selinux) != 0) {
+			errors = true;
+			if (bad == n) {
+				bad = i;
+			}
+		}
 	}
 
-	if (rename(tmpf, db->filename) != 0) {
-		goto fail;
+	/* Sync all the new files, before installing any of them */
+	for (i = 0; i < n; i++) {
+		db = dbs[i];
+		if (NULL == db->fp) {
+			continue;
+		}
+		if (!errors && (fsync (fileno (db->fp)) != 0)) {
+			errors = true;
+			if (bad == n) {
+				bad = i;
+			}
+		}
+		if (fclose (db->fp) != 0) {
+			errors = true;
+			if (bad == n) {
+				bad = i;
+			}
+		}
+		db->fp = NULL;
 	}
 
-#ifdef WITH_SELINUX
-	if (process_selinux
-	    && reset_selinux_file_context () != 0) {
-		goto fail;
+	for (i = 0; i < n; i++) {
+		if (!states[i].install) {
+			continue;
+		}
+		if (errors) {
+			unlink(states[i].tmpf);
+		} else if (rename(states[i].tmpf, dbs[i]->filename) != 0) {
+			errors = true;
+			if (bad == n) {
+				bad = i;
+			}
+			unlink(states[i].tmpf);
+		} else {
+			states[i].installed = true;
+			nscd_need_reload = true;
+		}
 	}
-#endif
 
-	nscd_need_reload = true;
-	goto success;
-      fail:
-	errors = true;
-      success:
+	/* Undo the renames which succeeded before one failed */
+	for (i = 0; errors && (i < n); i++) {
+		if (!states[i].installed) {
+			continue;
+		}
+		if (restore_file (dbs[i], &states[i], process_selinux) != 0) {
+			fprintf(log_get_logfd(),
+			        _("%s: cannot restore %s after a failed update\n"),
+			        log_get_progname(), dbs[i]->filename);
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		if (NULL != states[i].orig) {
+			(void) fclose (states[i].orig);
+		}
+		free_linked_list (dbs[i]);
+		dbs[i]->committed = !errors;
+	}
+	if (states != &single) {
+		free (states);
+	}
+	if (errors && (NULL != failed)) {
+		*failed = bad;
+	}
 
-	free_linked_list (db);
 	return !errors;
 }
 
+/*
+ * next_entry_by_name - Find the first entry with the given name, from
+ *                      pos.
+ *
+ *	If there is none, it returns NULL with errno set to ENOENT.  If
+ *	there was not enough memory to parse the entries, it returns NULL
+ *	with errno set to ENOMEM.
+ */
 static /*@dependent@*/ /*@null@*/struct commonio_entry *next_entry_by_name (
 	struct commonio_db *db,
 	/*@null@*/struct commonio_entry *pos,
 	const char *name)
 {
+	int ret;
+	size_t len;
 	struct commonio_entry *p;
-	void *ep;
-
-	if (NULL == pos) {
-		return NULL;
-	}
 
+	len = strlen (name);
 	for (p = pos; NULL != p; p = p->next) {
-		ep = p->eptr;
-		if (   (NULL != ep)
-		    && streq(db->ops->cio_getname(ep), name)) {
-			break;
+		ret = entry_has_name (db, p, name, len);
+		if (1 == ret) {
+			return p;
+		}
+		if (-1 == ret) {
+			return NULL;
 		}
 	}
-	return p;
+	errno = ENOENT;
+	return NULL;
 }
 
+/*
+ * find_entry_by_name - Find the first entry with the given name.
+ *
+ *	It fails like next_entry_by_name().
+ */
 static /*@dependent@*/ /*@null@*/struct commonio_entry *find_entry_by_name (
 	struct commonio_db *db,
 	const char *name)
 {
-	return next_entry_by_name (db, db->head, name);
+	int ret;
+	size_t len;
+	struct commonio_entry *p, *found;
+
+	if (NULL == db->name_index) {
+		return next_entry_by_name (db, db->head, name);
+	}
+
+	len = strlen (name);
+	found = NULL;
+	for (p = *name_bucket (db, name, len); NULL != p; p = p->hnext) {
+		ret = entry_has_name (db, p, name, len);
+		if (-1 == ret) {
+			return NULL;
+		}
+		if (0 == ret) {
+			continue;
+		}
+		if (NULL != found) {
+			/* Duplicated name: return the first one in the list */
+			return next_entry_by_name (db, db->head, name);
+		}
+		found = p;
+	}
+	if (NULL == found) {
+		errno = ENOENT;
+	}
+	return found;
+}
+
+/*
+ * name_is_duplicated - Check if an entry other than p has the given name.
+ *
+ *	p shall be the first entry with this name.
+ *	It returns 1 if there is one, 0 if there is none, and -1 if there
+ *	was not enough memory (with errno set).
+ */
+static int name_is_duplicated (struct commonio_db *db,
+                               const struct commonio_entry *p,
+                               const char *name)
+{
+	int ret;
+	size_t len;
+	struct commonio_entry *q;
+
+	if (NULL == db->name_index) {
+		if (NULL != next_entry_by_name (db, p->next, name)) {
+			return 1;
+		}
+		return (ENOENT == errno) ? 0 : -1;
+	}
+
+	len = strlen (name);
+	for (q = *name_bucket (db, name, len); NULL != q; q = q->hnext) {
+		if (q == p) {
+			continue;
+		}
+		ret = entry_has_name (db, q, name, len);
+		if (0 != ret) {
+			return ret;
+		}
+	}
+	return 0;
+}
+
+
+/*
+ * commonio_count_named - Count the entries other than p with the name
+ *                        of p.
+ *
+ *	Only the entries which can be parsed are counted, and p shall be
+ *	one of them.  With the name index, only the bucket of this name is
+ *	walked, so that checking all the entries of a file for duplicates
+ *	is linear in its size.
+ */
+size_t commonio_count_named (struct commonio_db *db,
+                             const struct commonio_entry *p)
+{
+	size_t                 len, n;
+	const char             *name;
+	struct commonio_entry  *q;
+
+	name = db->ops->cio_getname(p->eptr);
+	len = strlen (name);
+	n = 0;
+	if (NULL == db->name_index) {
+		for (q = db->head; NULL != q; q = q->next) {
+			if ((q != p) && (entry_has_name (db, q, name, len) == 1)) {
+				n++;
+			}
+		}
+		return n;
+	}
+
+	for (q = *name_bucket (db, name, len); NULL != q; q = q->hnext) {
+		if ((q != p) && (entry_has_name (db, q, name, len) == 1)) {
+			n++;
+		}
+	}
+	return n;
 }
 
 
 int commonio_update (struct commonio_db *db, const void *eptr)
 {
+	int dup;
 	struct commonio_entry *p;
 	void *nentry;
 
@@ -1007,15 +2111,28 @@ int commonio_update (struct commonio_db *db, const void *eptr)
 		return 0;
 	}
 	p = find_entry_by_name(db, db->ops->cio_getname(eptr));
+	if ((NULL == p) && (ENOENT != errno)) {
+		db->ops->cio_free(nentry);
+		return 0;
+	}
 	if (NULL != p) {
-		if (next_entry_by_name(db, p->next, db->ops->cio_getname(eptr)) != NULL) {
+		dup = name_is_duplicated (db, p, db->ops->cio_getname(eptr));
+		if (-1 == dup) {
+			db->ops->cio_free(nentry);
+			return 0;
+		}
+		if (1 == dup) {
 			fprintf(log_get_logfd(), _("Multiple entries named '%s' in %s. Please fix this with pwck or grpck.\n"), db->ops->cio_getname(eptr), db->filename);
 			db->ops->cio_free(nentry);
 			return 0;
 		}
+		name_index_del (db, p);
+		id_index_del (db, p);
 		db->ops->cio_free(p->eptr);
 		p->eptr = nentry;
 		p->changed = true;
+		name_index_add (db, p);
+		id_index_add (db, p);
 		db->cursor = p;
 
 		db->changed = true;
@@ -1038,6 +2155,8 @@ int commonio_update (struct commonio_db *db, const void *eptr)
 #else				/* !KEEP_NIS_AT_END */
 	add_one_entry (db, p);
 #endif				/* !KEEP_NIS_AT_END */
+	name_index_add (db, p);
+	id_index_add (db, p);
 
 	db->changed = true;
 	return 1;
@@ -1070,6 +2189,8 @@ int commonio_append (struct commonio_db *db, const void *eptr)
 	p->line = NULL;
 	p->changed = true;
 	add_one_entry (db, p);
+	name_index_add (db, p);
+	id_index_add (db, p);
 
 	db->changed = true;
 	return 1;
@@ -1078,6 +2199,9 @@ int commonio_append (struct commonio_db *db, const void *eptr)
 
 void commonio_del_entry (struct commonio_db *db, const struct commonio_entry *p)
 {
+	name_index_del (db, p);
+	id_index_del (db, p);
+
 	if (p == db->cursor) {
 		db->cursor = p->next;
 	}
@@ -1102,6 +2226,7 @@ void commonio_del_entry (struct commonio_db *db, const struct commonio_entry *p)
  */
 int commonio_remove (struct commonio_db *db, const char *name)
 {
+	int dup;
 	struct commonio_entry *p;
 
 	if (!db->isopen || db->readonly) {
@@ -1110,22 +2235,19 @@ int commonio_remove (struct commonio_db *db, const char *name)
 	}
 	p = find_entry_by_name (db, name);
 	if (NULL == p) {
-		errno = ENOENT;
 		return 0;
 	}
-	if (next_entry_by_name (db, p->next, name) != NULL) {
+	dup = name_is_duplicated (db, p, name);
+	if (-1 == dup) {
+		return 0;
+	}
+	if (1 == dup) {
 		fprintf (log_get_logfd(), _("Multiple entries named '%s' in %s. Please fix this with pwck or grpck.\n"), name, db->filename);
 		return 0;
 	}
 
 	commonio_del_entry (db, p);
-
-	free (p->line);
-
-	if (NULL != p->eptr)
-		db->ops->cio_free(p->eptr);
-
-	free(p);
+	free_entry (db, p);
 
 	return 1;
 }
@@ -1137,7 +2259,8 @@ int commonio_remove (struct commonio_db *db, const char *name)
  *	If found, it returns the entry and set the cursor of the database to
  *	that entry.
  *
- *	Otherwise, it returns NULL.
+ *	Otherwise, it returns NULL with errno set to ENOENT, or to ENOMEM
+ *	if there was not enough memory to parse the entries.
  */
 /*@observer@*/ /*@null@*/const void *commonio_locate (struct commonio_db *db, const char *name)
 {
@@ -1149,13 +2272,73 @@ int commonio_remove (struct commonio_db *db, const char *name)
 	}
 	p = find_entry_by_name (db, name);
 	if (NULL == p) {
-		errno = ENOENT;
 		return NULL;
 	}
 	db->cursor = p;
 	return p->eptr;
 }
 
+/*
+ * commonio_locate_id - Find the first entry with the specified ID in
+ *                      the database.
+ *
+ *	If found, it returns the entry and set the cursor of the database to
+ *	that entry.
+ *
+ *	Otherwise, it returns NULL with errno set to ENOENT, or to ENOMEM
+ *	if there was not enough memory to parse the entries.
+ */
+/*@observer@*/ /*@null@*/const void *commonio_locate_id (struct commonio_db *db, id_t id)
+{
+	struct commonio_entry *p, *found;
+
+	if (!db->isopen || (NULL == db->ops->cio_getid)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (NULL == db->id_index) {
+		id_index_build (db);
+	}
+
+	found = NULL;
+	if (NULL != db->id_index) {
+		for (p = *id_bucket (db, id); NULL != p; p = p->inext) {
+			if (db->ops->cio_getid(p->eptr) != id) {
+				continue;
+			}
+			if (NULL != found) {
+				/* Duplicated ID: search the first one below */
+				found = NULL;
+				break;
+			}
+			found = p;
+		}
+		if (NULL == p) {
+			goto done;
+		}
+	}
+
+	for (found = db->head; NULL != found; found = found->next) {
+		const void  *eptr = entry_eptr (db, found);
+
+		if ((NULL == eptr) && !found->parsed) {
+			return NULL;
+		}
+		if ((NULL != eptr) && (db->ops->cio_getid(eptr) == id)) {
+			break;
+		}
+	}
+
+done:
+	if (NULL == found) {
+		errno = ENOENT;
+		return NULL;
+	}
+	db->cursor = found;
+	return found->eptr;
+}
+
 /*
  * commonio_rewind - Restore the database cursor to the first entry.
  *
@@ -1175,6 +2358,8 @@ int commonio_rewind (struct commonio_db *db)
  * commonio_next - Return the next entry of the specified database
  *
  * It returns the next entry, or NULL if no other entries could be found.
+ * If there was not enough memory to parse the next entry, it returns NULL
+ * with errno set to ENOMEM, and the next call tries this entry again.
  */
 /*@observer@*/ /*@null@*/const void *commonio_next (struct commonio_db *db)
 {
@@ -1191,10 +2376,14 @@ int commonio_rewind (struct commonio_db *db)
 	}
 
 	while (NULL != db->cursor) {
-		eptr = db->cursor->eptr;
+		eptr = entry_eptr (db, db->cursor);
 		if (NULL != eptr) {
 			return eptr;
 		}
+		if (!db->cursor->parsed) {
+			db->cursor = db->cursor->prev;
+			return NULL;
+		}
 
 		db->cursor = db->cursor->next;
 	}
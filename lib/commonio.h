@@ -12,6 +12,9 @@
 #define COMMONIO_H
 
 
+#include <stdint.h>
+#include <sys/types.h>
+
 #include "attr.h"
 #include "defines.h" /* bool */
 
@@ -20,11 +23,14 @@
  * Linked list entry.
  */
 struct commonio_entry {
-	/*@null@*/char *line;
+	/*@null@*/char *line;		/* see commonio_split_lines() */
 	/*@null@*/void *eptr;		/* struct passwd, struct spwd, ... */
 	/*@dependent@*/ /*@null@*/struct commonio_entry *prev;
 	/*@owned@*/ /*@null@*/struct commonio_entry *next;
+	/*@dependent@*/ /*@null@*/struct commonio_entry *hnext;	/* name index chain */
+	/*@dependent@*/ /*@null@*/struct commonio_entry *inext;	/* ID index chain */
 	bool changed:1;
+	bool parsed:1;		/* eptr is set, even if NULL */
 };
 
 /*
@@ -68,6 +74,14 @@ struct commonio_ops {
 	 */
 	/*@null@*/int (*cio_open_hook)(void);
 	/*@null@*/int (*cio_close_hook)(void);
+
+	/*
+	 * Return the numerical ID of the object (for example, pw_uid
+	 * for struct passwd).
+	 * NULL if the objects have no ID; commonio_locate_id() cannot
+	 * be used on such databases.
+	 */
+	/*@null@*/id_t (*cio_getid)(const void *);
 };
 
 /*
@@ -113,6 +127,42 @@ struct commonio_db {
 	bool locked:1;
 	bool readonly:1;
 	bool setname:1;
+	bool committed:1;	/* the last commonio_close() succeeded */
+
+	/*
+	 * Hash index of the named entries, chained through hnext.
+	 * If NULL, lookups by name walk the linked list.
+	 */
+	/*@only@*/ /*@null@*/struct commonio_entry **name_index;
+	size_t name_index_size;		/* number of buckets, a power of 2 */
+	size_t name_index_count;	/* number of indexed entries */
+
+	/*
+	 * Hash index of the named entries by ID, chained through inext.
+	 * It is only built on the first lookup by ID.
+	 */
+	/*@only@*/ /*@null@*/struct commonio_entry **id_index;
+	size_t id_index_size;		/* number of buckets, a power of 2 */
+	size_t id_index_count;		/* number of indexed entries */
+
+	/*
+	 * Slabs holding the text of the file, where the lines of the
+	 * entries read by commonio_open() are, and these entries.
+	 * Lines and entries which are not in these slabs (for example
+	 * entries added by commonio_update()) are allocated individually.
+	 */
+	/*@only@*/ /*@null@*/char *slab_text;
+	size_t slab_text_size;
+	bool slab_text_mapped;		/* mmap(2)ed read-only, unsplit lines */
+	/*@only@*/ /*@null@*/struct commonio_entry *slab_entries;
+	size_t slab_entries_count;
+
+	/*
+	 * Lock statistics, in CLOCK_MONOTONIC nanoseconds.
+	 */
+	intmax_t lock_time;		/* when the lock was taken */
+	intmax_t lock_wait;		/* time waited for the lock */
+	pid_t lock_holder;		/* last PID seen holding the lock */
 };
 
 extern int commonio_setname (struct commonio_db *, const char *);
@@ -122,6 +172,7 @@ extern int commonio_lock_nowait (struct commonio_db *, bool log);
 extern int do_fcntl_lock (const char *file, bool log, short type);
 extern int commonio_open (struct commonio_db *, int);
 extern /*@observer@*/ /*@null@*/const void *commonio_locate (struct commonio_db *, const char *);
+extern /*@observer@*/ /*@null@*/const void *commonio_locate_id (struct commonio_db *, id_t);
 extern int commonio_update (struct commonio_db *, const void *);
 #ifdef ENABLE_SUBIDS
 extern int commonio_append (struct commonio_db *, const void *);
@@ -130,12 +181,20 @@ extern int commonio_remove (struct commonio_db *, const char *);
 extern int commonio_rewind (struct commonio_db *);
 extern /*@observer@*/ /*@null@*/const void *commonio_next (struct commonio_db *);
 extern int commonio_close (struct commonio_db *, bool);
+extern int commonio_close_all (struct commonio_db *const dbs[], size_t n,
+                               bool process_selinux,
+                               /*@null@*/size_t *failed);
 extern int commonio_unlock (struct commonio_db *, bool);
 extern void commonio_del_entry (struct commonio_db *,
                                 const struct commonio_entry *);
+extern size_t commonio_count_named (struct commonio_db *,
+                                    const struct commonio_entry *);
 extern int commonio_sort_wrt (struct commonio_db *shadow,
-                              const struct commonio_db *passwd);
+                              struct commonio_db *passwd);
 extern int commonio_sort (struct commonio_db *db,
                           int (*cmp) (const void *, const void *));
+extern /*@dependent@*/ /*@null@*/struct commonio_entry *commonio_get_head (
+	struct commonio_db *db);
+extern int commonio_split_lines (struct commonio_db *db);
 
 #endif
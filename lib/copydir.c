@@ -9,12 +9,21 @@
 
 #include "config.h"
 
+#include <sys/ioctl.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 #include <fcntl.h>
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "alloc/malloc.h"
 #include "attr.h"
@@ -34,6 +43,7 @@
 #include "string/sprintf/aprintf.h"
 #include "string/strcmp/streq.h"
 #include "string/strcmp/strprefix.h"
+#include "workpool.h"
 
 #undef NDEBUG
 #include <assert.h>
@@ -57,6 +67,26 @@ struct path_info {
 	const char *name;
 };
 
+/*
+ * The contents of the large regular files are copied by a pool of
+ * threads.  The tree is still walked, and every entry created, owned,
+ * and given its mode, ACLs and SELinux context, by the calling thread,
+ * in the same order as without the pool: only this thread uses links,
+ * src_orig and dst_orig, and a file already exists when a hardlink to
+ * it is made.  Writing to a file does not change the times of its
+ * directory, so these are still set once all its entries are created.
+ */
+#define COPY_ASYNC_MIN  (64 * 1024)	/* smaller files are copied inline */
+
+struct copy_job {
+	int              ifd;
+	int              ofd;
+	struct stat      sb;
+	struct timespec  mt[2];
+};
+
+static struct workpool pool;
+
 static int copy_entry (const struct path_info *src, const struct path_info *dst,
                        uid_t old_uid, uid_t new_uid,
                        gid_t old_gid, gid_t new_gid);
@@ -84,6 +114,9 @@ static int chownat_if_needed (const struct path_info *dst, const struct stat *st
 static int fchown_if_needed (int fdst, const struct stat *statp,
                              uid_t old_uid, uid_t new_uid,
                              gid_t old_gid, gid_t new_gid);
+static int copy_data (int ifd, int ofd, const struct stat *statp);
+static int copy_async (int ifd, int ofd, const struct stat *statp,
+                       const struct timespec mt[]);
 
 #if defined(WITH_ACL)
 /*
@@ -634,7 +667,8 @@ copy_special(MAYBE_UNUSED const struct path_info *src, const struct path_info *d
 /*
  * copy_file - copy a file
  *
- *	Copy a file from src to dst.
+ *	Copy a file from src to dst.  The contents of a large file may be
+ *	copied after return, by the pool of threads.
  *
  *	statp, mt, old_uid, new_uid, old_gid, and new_gid are used to set
  *	the access and modification and the access rights.
@@ -677,42 +711,218 @@ static int copy_file (const struct path_info *src, const struct path_info *dst,
 		return -1;
 	}
 
-	while (true) {
-		char buf[8192];
-		ssize_t cnt;
+	if (pool.nthreads > 0 && statp->st_size >= COPY_ASYNC_MIN) {
+		return copy_async (ifd, ofd, statp, mt);
+	}
+
+	if (copy_data (ifd, ofd, statp) != 0) {
+		(void) close (ofd);
+		(void) close (ifd);
+		return -1;
+	}
+
+	(void) close (ifd);
+	if (close (ofd) != 0 && errno != EINTR) {
+		return -1;
+	}
+
+	if (utimensat (dst->dirfd, dst->name, mt, AT_SYMLINK_NOFOLLOW) != 0) {
+		return -1;
+	}
+
+	return err;
+}
+
+/*
+ * copy_segment - copy a part of a file
+ *
+ *	Copy len bytes from the offset off of ifd to the same offset of
+ *	ofd, or up to the end of ifd.  The data is copied by the kernel
+ *	when possible, with copy_file_range(2), or else with sendfile(2).
+ *
+ *	Return 0 on success, -1 on error.
+ */
+static int copy_segment (int ifd, int ofd, off_t off, off_t len)
+{
+	char buf[8192];
+	ssize_t n = -1;
+
+#ifdef HAVE_COPY_FILE_RANGE
+	while (len > 0) {
+		off_t ioff = off;
+		off_t ooff = off;
+
+		n = copy_file_range (ifd, &ioff, ofd, &ooff, len, 0);
+		if (n <= 0) {
+			break;	/* end of file, or fall back */
+		}
+		off += n;
+		len -= n;
+	}
+	if (0 == n) {
+		return 0;
+	}
+#endif
+
+	if (len > 0 && lseek (ofd, off, SEEK_SET) == -1) {
+		return -1;
+	}
+
+#ifdef HAVE_SENDFILE
+	while (len > 0) {
+		n = sendfile (ofd, ifd, &off, MIN(len, (off_t) SSIZE_MAX));
+		if (n <= 0) {
+			break;	/* end of file, or fall back */
+		}
+		len -= n;
+	}
+	if (0 == n) {
+		return 0;
+	}
+#endif
 
-		cnt = read(ifd, buf, sizeof(buf));
-		if (cnt < 0) {
+	while (len > 0) {
+		n = pread (ifd, buf, MIN(len, (off_t) sizeof (buf)), off);
+		if (n < 0) {
 			if (errno == EINTR) {
 				continue;
 			}
-			(void) close (ofd);
-			(void) close (ifd);
 			return -1;
 		}
-		if (cnt == 0) {
+		if (n == 0) {
 			break;
 		}
 
-		if (write_full(ofd, buf, cnt) == -1) {
-			(void) close (ofd);
-			(void) close (ifd);
+		if (write_full(ofd, buf, n) == -1) {
 			return -1;
 		}
+		off += n;
+		len -= n;
 	}
 
-	(void) close (ifd);
-	if (close (ofd) != 0 && errno != EINTR) {
-		return -1;
+	return 0;
+}
+
+/*
+ * copy_data - copy the contents of a file
+ *
+ *	Copy the contents of ifd, whose status is statp, to the empty
+ *	file ofd.  If the file system supports it, the blocks of ifd are
+ *	shared with a reflink.  Otherwise, only the data of a sparse file
+ *	is copied, and its holes are kept.
+ *
+ *	Return 0 on success, -1 on error.
+ */
+static int copy_data (int ifd, int ofd, const struct stat *statp)
+{
+#ifdef FICLONE
+	if (ioctl (ofd, FICLONE, ifd) == 0) {
+		return 0;
 	}
+#endif
 
-	if (utimensat (dst->dirfd, dst->name, mt, AT_SYMLINK_NOFOLLOW) != 0) {
-		return -1;
+#ifdef SEEK_DATA
+	if (statp->st_blocks * 512 < statp->st_size) {
+		off_t off, data, hole;
+
+		for (off = 0; off < statp->st_size; off = hole) {
+			data = lseek (ifd, off, SEEK_DATA);
+			if (-1 == data) {
+				if (ENXIO == errno) {
+					break;	/* a hole up to the end */
+				}
+				data = off;	/* SEEK_DATA is not supported */
+				hole = statp->st_size;
+			} else {
+				hole = lseek (ifd, data, SEEK_HOLE);
+				if (-1 == hole || hole > statp->st_size) {
+					hole = statp->st_size;
+				}
+			}
+
+			if (copy_segment (ifd, ofd, data, hole - data) != 0) {
+				return -1;
+			}
+		}
+
+		/* Keep the hole at the end of the file */
+		return ftruncate (ofd, statp->st_size);
+	}
+#endif
+
+	return copy_segment (ifd, ofd, 0, statp->st_size);
+}
+
+/*
+ * finish_file - copy the contents of a file queued by copy_file()
+ *
+ *	The directory of the file may already be closed, so the times are
+ *	set with the file descriptor.  Both file descriptors are closed.
+ *
+ *	Return 0 on success, -1 on error.
+ */
+static int finish_file (const struct copy_job *job)
+{
+	int err = 0;
+
+	if (   (copy_data (job->ifd, job->ofd, &job->sb) != 0)
+	    || (futimens (job->ofd, job->mt) != 0)) {
+		err = -1;
+	}
+
+	(void) close (job->ifd);
+	if (close (job->ofd) != 0 && errno != EINTR) {
+		err = -1;
 	}
 
 	return err;
 }
 
+static void copy_job_run (struct workpool *wp, void *arg)
+{
+	struct copy_job *job = arg;
+
+	/* After a failure, the copy is abandoned */
+	if (workpool_failed (wp)) {
+		(void) close (job->ifd);
+		(void) close (job->ofd);
+	} else if (finish_file (job) != 0) {
+		workpool_fail (wp);
+	}
+
+	free (job);
+}
+
+/*
+ * copy_async - queue the copy of the contents of a file
+ *
+ *	This waits for a free slot in the queue, so that the number of
+ *	open files stays bounded.  ifd and ofd are closed once copied.
+ *
+ *	Return 0, or -1 on error, or if a previous copy failed.
+ */
+static int copy_async (int ifd, int ofd, const struct stat *statp,
+                       const struct timespec mt[])
+{
+	struct copy_job *job;
+
+	job = malloc_T (1, struct copy_job);
+	if (NULL == job) {
+		(void) close (ifd);
+		(void) close (ofd);
+		return -1;
+	}
+
+	job->ifd = ifd;
+	job->ofd = ofd;
+	job->sb = *statp;
+	job->mt[0] = mt[0];
+	job->mt[1] = mt[1];
+	workpool_submit (&pool, copy_job_run, job);
+
+	return workpool_failed (&pool) ? -1 : 0;
+}
+
 #define def_chown_if_needed(chown_function, type_dst)                  \
 static int chown_function ## _if_needed (type_dst dst,                 \
                                          const struct stat *statp,     \
@@ -804,5 +1014,13 @@ int copy_tree (const char *src_root, const char *dst_root,
 		.name = dst_root
 	};
 
-	return copy_tree_impl(&src, &dst, copy_root, old_uid, new_uid, old_gid, new_gid);
+	int err;
+
+	workpool_start (&pool, 0);
+	err = copy_tree_impl(&src, &dst, copy_root, old_uid, new_uid, old_gid, new_gid);
+	if (workpool_stop (&pool) != 0) {
+		err = -1;
+	}
+
+	return err;
 }
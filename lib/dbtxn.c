@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "commonio.h"
+#include "dbtxn.h"
+#include "defines.h"
+#include "getdef.h"
+#include "groupio.h"
+#include "prototypes.h"
+#include "pwio.h"
+#ifdef SHADOWGRP
+#include "sgroupio.h"
+#endif
+#include "shadowio.h"
+#include "sizeof.h"
+#ifdef ENABLE_SUBIDS
+#include "subordinateio.h"
+#endif
+
+
+/*
+ * The accessors of a database which can take part in a transaction.
+ */
+struct dbtxn_ops {
+	unsigned int  flag;
+	struct commonio_db *(*get_db) (void);
+	int (*lock) (void);
+	int (*open) (int mode);
+	int (*close) (bool process_selinux);
+	int (*unlock) (bool process_selinux);
+	/*@observer@*/const char *(*dbname) (void);
+};
+
+static const struct dbtxn_ops dbtxn_ops[] = {
+	{DBTXN_PASSWD, __pw_get_db, pw_lock, pw_open, pw_close, pw_unlock,
+	 pw_dbname},
+	{DBTXN_SHADOW, __spw_get_db, spw_lock, spw_open, spw_close, spw_unlock,
+	 spw_dbname},
+	{DBTXN_GROUP, __gr_get_db, gr_lock, gr_open, gr_close, gr_unlock,
+	 gr_dbname},
+#ifdef SHADOWGRP
+	{DBTXN_GSHADOW, __sgr_get_db, sgr_lock, sgr_open, sgr_close, sgr_unlock,
+	 sgr_dbname},
+#endif
+#ifdef ENABLE_SUBIDS
+	{DBTXN_SUBUID, __sub_uid_get_db, sub_uid_lock, sub_uid_open,
+	 sub_uid_close, sub_uid_unlock, sub_uid_dbname},
+	{DBTXN_SUBGID, __sub_gid_get_db, sub_gid_lock, sub_gid_open,
+	 sub_gid_close, sub_gid_unlock, sub_gid_dbname},
+#endif
+};
+
+
+/*
+ * batched - Whether a database can be written by commonio_close_all().
+ *
+ *	The TCB shadow files need their own privilege handling, which only
+ *	spw_close() does.
+ */
+static bool batched (MAYBE_UNUSED const struct dbtxn_ops *op)
+{
+#ifdef WITH_TCB
+	if ((DBTXN_SHADOW == op->flag) && getdef_bool ("USE_TCB")) {
+		return false;
+	}
+#endif
+	return true;
+}
+
+
+/*
+ * dbtxn_init - Prepare a transaction on the dbs databases.
+ *
+ *	dbs is a mask of DBTXN_* values.  The databases which are not
+ *	supported by this build are ignored.
+ */
+void dbtxn_init (struct dbtxn *txn, unsigned int dbs, bool process_selinux)
+{
+	txn->dbs = dbs;
+	txn->locked = 0;
+	txn->opened = 0;
+	txn->process_selinux = process_selinux;
+	txn->failed = NULL;
+}
+
+
+/*
+ * dbtxn_lock - Lock all the databases of the transaction.
+ *
+ *	It returns 1 on success.  On failure, it returns 0 and the
+ *	database which could not be locked is named by txn->failed.  The
+ *	databases locked before are left locked; dbtxn_unlock() releases
+ *	them.
+ */
+int dbtxn_lock (struct dbtxn *txn)
+{
+	const struct dbtxn_ops  *op;
+
+	txn->failed = NULL;
+	for (op = dbtxn_ops; op < dbtxn_ops + countof(dbtxn_ops); op++) {
+		if (!(txn->dbs & op->flag) || (txn->locked & op->flag)) {
+			continue;
+		}
+		if (op->lock () == 0) {
+			txn->failed = op->dbname ();
+			return 0;
+		}
+		txn->locked |= op->flag;
+	}
+	return 1;
+}
+
+
+/*
+ * dbtxn_open - Open all the databases of the transaction.
+ *
+ *	It returns 1 on success.  On failure, it returns 0 and the
+ *	database which could not be opened is named by txn->failed.
+ */
+int dbtxn_open (struct dbtxn *txn, int mode)
+{
+	const struct dbtxn_ops  *op;
+
+	txn->failed = NULL;
+	for (op = dbtxn_ops; op < dbtxn_ops + countof(dbtxn_ops); op++) {
+		if (!(txn->dbs & op->flag) || (txn->opened & op->flag)) {
+			continue;
+		}
+		if (op->open (mode) == 0) {
+			txn->failed = op->dbname ();
+			return 0;
+		}
+		txn->opened |= op->flag;
+	}
+	return 1;
+}
+
+
+/*
+ * dbtxn_commit - Write the changes of all the open databases.
+ *
+ *	The new files are all written and synced before the first one is
+ *	installed, and if one of them cannot be installed, the files which
+ *	already were are restored, so that a failure leaves none of the
+ *	databases changed.  The TCB shadow files are written on their own,
+ *	before the others, and are not restored.
+ *	The databases remain locked; the caches of nscd and sssd are
+ *	flushed once, when dbtxn_unlock() releases the last lock.
+ *
+ *	It returns 1 on success.  On failure, it returns 0 and the
+ *	database which could not be written is named by txn->failed.
+ */
+int dbtxn_commit (struct dbtxn *txn)
+{
+	int                     ret = 1;
+	size_t                  n = 0, failed;
+	struct commonio_db      *dbs[countof(dbtxn_ops)];
+	const struct dbtxn_ops  *op, *ops[countof(dbtxn_ops)];
+
+	txn->failed = NULL;
+	for (op = dbtxn_ops; op < dbtxn_ops + countof(dbtxn_ops); op++) {
+		if (!(txn->opened & op->flag)) {
+			continue;
+		}
+		if (batched (op)) {
+			ops[n] = op;
+			dbs[n] = op->get_db ();
+			n++;
+		} else if (op->close (txn->process_selinux) == 0) {
+			txn->failed = op->dbname ();
+			ret = 0;
+		}
+	}
+	txn->opened = 0;
+
+	if ((n > 0) && (commonio_close_all (dbs, n, txn->process_selinux,
+	                                    &failed) == 0)) {
+		if (NULL == txn->failed) {
+			txn->failed = ops[failed]->dbname ();
+		}
+		ret = 0;
+	}
+	return ret;
+}
+
+
+/*
+ * dbtxn_unlock - Unlock all the databases of the transaction.
+ *
+ *	The changes which were not committed are discarded.
+ *	All the databases are unlocked, even if one of them fails.  In
+ *	that case, it returns 0 and the first database which could not be
+ *	unlocked is named by txn->failed.  Otherwise it returns 1.
+ */
+int dbtxn_unlock (struct dbtxn *txn)
+{
+	int                     ret = 1;
+	const struct dbtxn_ops  *op;
+
+	txn->failed = NULL;
+	for (op = dbtxn_ops + countof(dbtxn_ops); op-- > dbtxn_ops;) {
+		if (!(txn->locked & op->flag)) {
+			continue;
+		}
+		if ((op->unlock (txn->process_selinux) == 0) && (1 == ret)) {
+			txn->failed = op->dbname ();
+			ret = 0;
+		}
+	}
+	txn->locked = 0;
+	txn->opened = 0;
+	return ret;
+}
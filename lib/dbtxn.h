@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#ifndef _DBTXN_H
+#define _DBTXN_H
+
+#include "config.h"
+
+#include <stdbool.h>
+
+/*
+ * Databases which can take part in a transaction.
+ *
+ * They are locked and opened in this order, and unlocked in the reverse
+ * order.
+ */
+#define DBTXN_PASSWD   0x01u
+#define DBTXN_SHADOW   0x02u
+#define DBTXN_GROUP    0x04u
+#define DBTXN_GSHADOW  0x08u
+#define DBTXN_SUBUID   0x10u
+#define DBTXN_SUBGID   0x20u
+
+/*
+ * A set of databases which are changed in memory, and then written
+ * together by dbtxn_commit(): either all the files are replaced, or none
+ * of them is.
+ */
+struct dbtxn {
+	unsigned int  dbs;	/* DBTXN_* databases in the transaction */
+	unsigned int  locked;	/* databases locked */
+	unsigned int  opened;	/* databases open */
+	bool          process_selinux;
+	/* database which caused the last failure */
+	/*@observer@*/ /*@null@*/const char *failed;
+};
+
+extern void dbtxn_init (struct dbtxn *txn, unsigned int dbs,
+                        bool process_selinux);
+extern int dbtxn_lock (struct dbtxn *txn);
+extern int dbtxn_open (struct dbtxn *txn, int mode);
+extern int dbtxn_commit (struct dbtxn *txn);
+extern int dbtxn_unlock (struct dbtxn *txn);
+
+#endif
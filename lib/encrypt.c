@@ -13,11 +13,20 @@
 
 #include <unistd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "attr.h"
 #include "prototypes.h"
 #include "defines.h"
+#include "getdef.h"
+#include "io/fgets/fgets.h"
 #include "shadowlog.h"
+#include "string/memset/memzero.h"
 #include "string/strcmp/strprefix.h"
+#include "string/strdup/strdup.h"
+#include "string/strtok/stpsep.h"
+#include "workpool.h"
 
 
 /*@exposed@*//*@null@*/char *pw_encrypt (const char *clear, const char *salt)
@@ -80,3 +89,198 @@
 	return cipher;
 }
 
+#ifdef HAVE_CRYPT_R
+static void crypt_job (MAYBE_UNUSED struct workpool *wp, void *arg)
+{
+	struct pw_crypt *pc = arg;
+	struct crypt_data *data;
+	const char *cp;
+
+	data = calloc (1, sizeof (*data));
+	if (NULL == data) {
+		return;
+	}
+
+	/*
+	 * Only the hashes which pw_encrypt() would return as they are
+	 * are kept.  pw_encrypt() reports the failures.
+	 */
+	cp = crypt_r (pc->clear, pc->salt, data);
+	if ((NULL != cp) && (strlen (cp) > 13)) {
+		pc->hash = strdup (cp);
+	}
+
+	memzero (data, sizeof (*data));
+	free (data);
+}
+#endif				/* HAVE_CRYPT_R */
+
+/*
+ * pw_encrypt_all - encrypt several passwords in parallel
+ *
+ *	The passwords are encrypted by CRYPT_THREADS threads, or one per
+ *	online processor.  The hash of each password is allocated in
+ *	pc[i].hash, or it is left NULL, and pw_encrypt() should then be
+ *	used instead, to get the hash or report the failure.  The entries
+ *	with a NULL clear or salt are skipped.
+ */
+void pw_encrypt_all (struct pw_crypt *pc, size_t n)
+{
+	size_t i;
+#ifdef HAVE_CRYPT_R
+	struct workpool wp;
+#endif
+
+	for (i = 0; i < n; i++) {
+		pc[i].hash = NULL;
+	}
+
+#ifdef HAVE_CRYPT_R
+	workpool_start (&wp, getdef_num ("CRYPT_THREADS", 0));
+	if (0 == wp.nthreads) {
+		(void) workpool_stop (&wp);
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		if ((NULL != pc[i].clear) && (NULL != pc[i].salt)) {
+			workpool_submit (&wp, crypt_job, &pc[i]);
+		}
+	}
+	(void) workpool_stop (&wp);
+#endif				/* HAVE_CRYPT_R */
+}
+
+/*
+ * pw_input_read - read the next PW_CHUNK_LINES lines of stdin
+ *
+ *	The lines up to in->skip are skipped.  The rest of the lines which
+ *	are too long is dropped, and their buf is left NULL, so that they
+ *	are reported in order.  It returns the number of lines read.
+ */
+static size_t pw_input_read (struct pw_input *in)
+{
+	char buf[BUFSIZ];
+	size_t n = 0;
+
+	while ((n < PW_CHUNK_LINES) && (fgets_a(buf, stdin) != NULL)) {
+		in->line++;
+		if (in->line <= in->skip) {
+			/* Committed by a previous run */
+			continue;
+		}
+
+		in->lines[n].line = in->line;
+		in->lines[n].buf = NULL;
+		in->lines[n].hash = NULL;
+		if (stpsep(buf, "\n") == NULL && feof(stdin) == 0) {
+			// Drop all remaining characters on this line.
+			while (fgets_a(buf, stdin) != NULL) {
+				if (strchr(buf, '\n'))
+					break;
+			}
+		} else {
+			in->lines[n].buf = xstrdup (buf);
+		}
+		n++;
+	}
+
+	memzero_a (buf);
+	return n;
+}
+
+/*
+ * pw_input_encrypt - encrypt the passwords of the chunk of lines
+ *
+ *	The password is the text after the first ':', or only the second
+ *	field if in->field is set, and the empty passwords are then not
+ *	encrypted.
+ */
+static void pw_input_encrypt (struct pw_input *in)
+{
+	struct pw_crypt *pc;
+	char *cp;
+	size_t i;
+
+	for (i = 0; i < in->n; i++) {
+		pc = &in->pc[i];
+		pc->clear = NULL;
+		pc->salt = NULL;
+		cp = (NULL != in->lines[i].buf) ? strchr (in->lines[i].buf, ':') : NULL;
+		if (NULL == cp) {
+			continue;
+		}
+		cp = xstrdup (cp + 1);
+		if (in->field) {
+			(void) stpsep (cp, ":");
+			if ('\0' == cp[0]) {
+				free (cp);
+				continue;
+			}
+		}
+		pc->clear = cp;
+		/* crypt_make_salt() returns a static buffer */
+		pc->salt = xstrdup ((NULL != in->salt)
+		                    ? in->salt
+		                    : crypt_make_salt (in->crypt_method,
+		                                       in->crypt_arg));
+	}
+
+	pw_encrypt_all (in->pc, in->n);
+
+	for (i = 0; i < in->n; i++) {
+		pc = &in->pc[i];
+		in->lines[i].hash = pc->hash;
+		if (NULL != pc->clear) {
+			strzero ((char *)(pc->clear));
+			free ((void *)(pc->clear));
+			free ((void *)(pc->salt));
+		}
+	}
+}
+
+/*
+ * pw_input_next - get the next line of stdin
+ *
+ *	The lines of the previous chunk are erased when the next chunk is
+ *	read.  If in->encrypt is set, the new passwords of the chunk are
+ *	encrypted with in->salt, or with a new salt of in->crypt_method
+ *	for each password.  The hash of a line is NULL if its password
+ *	could not be encrypted in advance.  It returns NULL at the end of
+ *	the input.
+ */
+/*@null@*/struct pw_line *pw_input_next (struct pw_input *in)
+{
+	struct pw_line *l;
+	size_t i;
+
+	if (in->i < in->n) {
+		return &in->lines[in->i++];
+	}
+
+	for (i = 0; i < in->n; i++) {
+		l = &in->lines[i];
+		if (NULL != l->buf) {
+			strzero (l->buf);
+			free (l->buf);
+			l->buf = NULL;
+		}
+		if (NULL != l->hash) {
+			strzero (l->hash);
+			free (l->hash);
+			l->hash = NULL;
+		}
+	}
+
+	in->i = 0;
+	in->n = pw_input_read (in);
+	if (0 == in->n) {
+		return NULL;
+	}
+
+	if (in->encrypt) {
+		pw_input_encrypt (in);
+	}
+
+	return &in->lines[in->i++];
+}
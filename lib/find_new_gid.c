@@ -12,18 +12,26 @@
 #include <stdio.h>
 #include <errno.h>
 
-#include "alloc/calloc.h"
 #include "groupio.h"
+#include "attr.h"
 #include "getdef.h"
+#include "idhint.h"
+#include "idset.h"
 #include "io/fprintf.h"
 #include "prototypes.h"
 #include "shadowlog.h"
+#include "workpool.h"
 
 
 #undef NDEBUG
 #include <assert.h>
 
 
+/* Where the search resumes, saved when the group database is unlocked */
+static struct idhint gid_hint;
+static bool gid_hint_pending = false;
+
+
 /*
  * get_ranges - Get the minimum and maximum ID ranges for the search
  *
@@ -108,11 +116,15 @@ static int get_ranges (bool sys_group, gid_t *min_id, gid_t *max_id,
  * If the ID might clash with -1, return EINVAL
  * If the ID is outside the range, return ERANGE
  * In other cases, return errno from getgrgid()
+ *
+ * The IDs found in use with getgrgid() are added to used_gids, and the
+ * others to unused_gids, which are not looked up again.
  */
 static int check_gid (const gid_t gid,
 		      const gid_t gid_min,
 		      const gid_t gid_max,
-		      const bool *used_gids)
+		      struct idset *used_gids,
+		      struct idset *unused_gids)
 {
 	/* First test that the preferred ID is in the range */
 	if (gid < gid_min || gid > gid_max) {
@@ -128,12 +140,20 @@ static int check_gid (const gid_t gid,
 	 * Check whether we already detected this GID
 	 * using the gr_next() loop
 	 */
-	if (used_gids != NULL && used_gids[gid]) {
+	if (used_gids != NULL && idset_has (used_gids, gid)) {
 		return EEXIST;
 	}
+	/* Or that NSS did not know it */
+	if (unused_gids != NULL && idset_has (unused_gids, gid)) {
+		return 0;
+	}
 	/* Check if the GID exists according to NSS */
 	errno = 0;
 	if (prefix_getgrgid (gid) != NULL) {
+		/* Remember it, in case the search wraps around */
+		if (used_gids != NULL) {
+			(void) idset_insert (used_gids, gid);
+		}
 		return EEXIST;
 	} else {
 		/* getgrgid() was NULL
@@ -141,6 +161,9 @@ static int check_gid (const gid_t gid,
 		 * failures of remote user identity services
 		 * would completely block user/group creation
 		 */
+		if (unused_gids != NULL) {
+			(void) idset_insert (unused_gids, gid);
+		}
 	}
 
 	/* If we've made it here, the GID must be available */
@@ -148,76 +171,184 @@ static int check_gid (const gid_t gid,
 }
 
 /*
- * find_new_gid - Find a new unused GID.
+ * A candidate GID looked up by probe_gids().
+ */
+struct gid_probe {
+	gid_t gid;
+	bool used;
+};
+
+static void probe_gid_job (MAYBE_UNUSED struct workpool *wp, void *arg)
+{
+	struct gid_probe *probe = arg;
+	struct group *grp;
+
+	/* getgrgid() is not reentrant */
+	grp = xgetgrgid (probe->gid);
+	probe->used = (NULL != grp);
+	if (NULL != grp) {
+		gr_free (grp);
+	}
+}
+
+/*
+ * probe_gids - Look up a chunk of candidate GIDs with NSS.
  *
- * If successful, find_new_gid provides an unused group ID in the
- * [GID_MIN:GID_MAX] range.
- * This ID should be higher than all the used GID, but if not possible,
- * the lowest unused ID in the range will be returned.
+ * The candidates are the GIDs from start in the direction of the
+ * search which were not looked up yet.  The GIDs in use are added to
+ * pool->used, and the others to pool->unused, for the rest of the
+ * allocation.
  *
- * Return 0 on success, -1 if no unused GIDs are available.
+ * A chunk starts with a single GID, and doubles each time a GID is
+ * found in use, up to ID_PROBE_CHUNK GIDs.  When the first candidate is
+ * free, this costs a single lookup.  In a dense range, the lookups of a
+ * chunk are made in parallel, so that they take about as long as one of
+ * them.  The files of a --prefix are read sequentially.
+ *
+ * Failures to allocate memory are ignored: check_gid() then looks the
+ * candidates up one by one.
  */
-int find_new_gid (bool sys_group,
-                 gid_t *gid,
-                 /*@null@*/gid_t const *preferred_gid)
+static void probe_gids (struct id_pool *pool, gid_t start)
 {
-	bool *used_gids;
-	const struct group *grp;
-	gid_t gid_min, gid_max, preferred_min;
+	size_t n, i;
 	gid_t id;
-	gid_t lowest_found, highest_found;
-	int result;
-	int nospam = 0;
-
-	assert(gid != NULL);
+	bool found = false;
+	struct workpool wp;
+	struct gid_probe probes[ID_PROBE_CHUNK];
+
+	n = 0;
+	for (id = start; n < pool->chunk; id = pool->sys ? id - 1 : id + 1) {
+		if (   !idset_has (&pool->used, id)
+		    && !idset_has (&pool->unused, id)
+		    && id != UINT16_MAX && id != UINT32_MAX) {
+			probes[n].gid = id;
+			probes[n].used = false;
+			n++;
+		}
+		if (id == (pool->sys ? pool->min : pool->max)) {
+			break;
+		}
+	}
 
-	/*
-	 * First, figure out what ID range is appropriate for
-	 * automatic assignment
-	 */
-	result = get_ranges (sys_group, &gid_min, &gid_max, &preferred_min);
-	if (result == EINVAL) {
-		return -1;
+	if (n > 1 && !prefix_is_set ()) {
+		workpool_start (&wp, n);
+		for (i = 0; i < n; i++) {
+			workpool_submit (&wp, probe_gid_job, &probes[i]);
+		}
+		(void) workpool_stop (&wp);
+	} else {
+		for (i = 0; i < n; i++) {
+			probes[i].used = (prefix_getgrgid (probes[i].gid) != NULL);
+		}
 	}
 
-	/* Check if the preferred GID is available */
-	if (preferred_gid) {
-		result = check_gid (*preferred_gid, preferred_min, gid_max, NULL);
-		if (result == 0) {
-			/*
-			 * Make sure the GID isn't queued for use already
-			 */
-			if (gr_locate_gid (*preferred_gid) == NULL) {
-				*gid = *preferred_gid;
-				return 0;
-			}
-			/*
-			 * gr_locate_gid() found the GID in an as-yet uncommitted
-			 * entry. We'll proceed below and auto-set a GID.
-			 */
-		} else if (result == EEXIST || result == ERANGE || result == EINVAL) {
-			/*
-			 * Continue on below. At this time, we won't
-			 * treat these three cases differently.
-			 */
+	for (i = 0; i < n; i++) {
+		if (probes[i].used) {
+			(void) idset_insert (&pool->used, probes[i].gid);
+			found = true;
 		} else {
-			/*
-			 * An unexpected error occurred. We should report
-			 * this and fail the group creation.
-			 * This differs from the automatic creation
-			 * behavior below, since if a specific GID was
-			 * requested and generated an error, the user is
-			 * more likely to want to stop and address the
-			 * issue.
-			 */
-			fprintf (log_get_logfd(),
-				_("%s: Encountered error attempting to use "
-				  "preferred GID: %s\n"),
-				log_get_progname(), strerror (result));
-			return -1;
+			(void) idset_insert (&pool->unused, probes[i].gid);
+		}
+	}
+
+	if (found && pool->chunk < ID_PROBE_CHUNK) {
+		pool->chunk *= 2;
+	}
+}
+
+/*
+ * add_nss_gids - Add the GIDs in [gid_min:gid_max] which NSS can
+ * enumerate to used_gids.
+ *
+ * With ID_NSS_ENUM_ENAB, this walks the remote databases once, instead
+ * of looking the candidates up with getgrgid().  Services which do not
+ * enumerate their entries are still probed by probe_gids().
+ *
+ * Return 0 on success, -1 on failure to allocate memory.
+ */
+static int add_nss_gids (struct idset *used_gids,
+			 gid_t gid_min, gid_t gid_max)
+{
+	int ret = 0;
+	const struct group *grp;
+
+	prefix_setgrent ();
+	while (NULL != (grp = prefix_getgrent ())) {
+		if (grp->gr_gid < gid_min || grp->gr_gid > gid_max) {
+			continue;
 		}
+		if (idset_add (used_gids, grp->gr_gid) == -1) {
+			ret = -1;
+			break;
+		}
+	}
+	prefix_endgrent ();
+
+	return ret;
+}
+
+/*
+ * check_preferred_gid - See if the preferred GID can be used
+ *
+ * used_gids, if not NULL, holds the GIDs already handed out.
+ *
+ * Return 0 if the GID can be used, 1 if a GID should be selected
+ * automatically instead, and -1 on unexpected errors.
+ */
+static int check_preferred_gid (gid_t preferred_gid,
+				gid_t preferred_min,
+				gid_t gid_max,
+				/*@null@*/const struct idset *used_gids)
+{
+	int result;
+
+	result = check_gid (preferred_gid, preferred_min, gid_max, NULL, NULL);
+	if (result == 0) {
+		/*
+		 * Make sure the GID isn't queued for use already
+		 */
+		if (   gr_locate_gid (preferred_gid) == NULL
+		    && (used_gids == NULL || !idset_has (used_gids, preferred_gid))) {
+			return 0;
+		}
+		/*
+		 * gr_locate_gid() found the GID in an as-yet uncommitted
+		 * entry. We'll proceed below and auto-set a GID.
+		 */
+	} else if (result == EEXIST || result == ERANGE || result == EINVAL) {
+		/*
+		 * Continue on below. At this time, we won't
+		 * treat these three cases differently.
+		 */
+	} else {
+		/*
+		 * An unexpected error occurred. We should report
+		 * this and fail the group creation.
+		 * This differs from the automatic creation
+		 * behavior below, since if a specific GID was
+		 * requested and generated an error, the user is
+		 * more likely to want to stop and address the
+		 * issue.
+		 */
+		fprintf (log_get_logfd(),
+			_("%s: Encountered error attempting to use "
+			  "preferred GID: %s\n"),
+			log_get_progname(), strerror (result));
+		return -1;
 	}
 
+	return 1;
+}
+
+/*
+ * scan_gids - Add the GIDs in use to the pool
+ *
+ * Return 0 on success, -1 on failure to allocate memory.
+ */
+static int scan_gids (struct id_pool *pool)
+{
+	const struct group *grp;
+
 	/*
 	 * Search the entire group file,
 	 * looking for the next unused value.
@@ -237,44 +368,160 @@ int find_new_gid (bool sys_group,
 	 *
 	 */
 
-	/* Create an array to hold all of the discovered GIDs */
-	used_gids = calloc_T(gid_max + 1, bool);
-	if (NULL == used_gids) {
-		fprinte(log_get_logfd(), _("%s: failed to allocate memory"),
-			log_get_progname());
-		return -1;
-	}
-
 	/* First look for the lowest and highest value in the local database */
 	(void) gr_rewind ();
-	highest_found = gid_min;
-	lowest_found = gid_max;
+	pool->highest_found = pool->min;
+	pool->lowest_found = pool->max;
 	while (NULL != (grp = gr_next())) {
 		/*
 		 * Does this entry have a lower GID than the lowest we've found
 		 * so far?
 		 */
-		if ((grp->gr_gid <= lowest_found) && (grp->gr_gid >= gid_min)) {
-			lowest_found = grp->gr_gid - 1;
+		if ((grp->gr_gid <= pool->lowest_found) && (grp->gr_gid >= pool->min)) {
+			pool->lowest_found = grp->gr_gid - 1;
 		}
 
 		/*
 		 * Does this entry have a higher GID than the highest we've found
 		 * so far?
 		 */
-		if ((grp->gr_gid >= highest_found) && (grp->gr_gid <= gid_max)) {
-			highest_found = grp->gr_gid + 1;
+		if ((grp->gr_gid >= pool->highest_found) && (grp->gr_gid <= pool->max)) {
+			pool->highest_found = grp->gr_gid + 1;
 		}
 
 		/* create index of used GIDs */
-		if (grp->gr_gid >= gid_min
-			&& grp->gr_gid <= gid_max) {
+		if (grp->gr_gid >= pool->min
+			&& grp->gr_gid <= pool->max) {
+
+			if (idset_add (&pool->used, grp->gr_gid) == -1) {
+				fprinte(log_get_logfd(),
+					_("%s: failed to allocate memory"),
+					log_get_progname());
+				return -1;
+			}
+		}
+	}
+	if (   getdef_bool ("ID_NSS_ENUM_ENAB")
+	    && add_nss_gids (&pool->used, pool->min, pool->max) == -1) {
+		fprinte(log_get_logfd(), _("%s: failed to allocate memory"),
+			log_get_progname());
+		return -1;
+	}
+	idset_sort (&pool->used);
+	pool->hinted = false;
+
+	return 0;
+}
+
+/*
+ * search_gids - Search count consecutive unused GIDs
+ *
+ * For system groups, the search goes from start down to the bottom of
+ * the range, and for non-system groups from start up to the top of the
+ * range.  The GIDs found are not reserved.
+ *
+ * Return 0 with the lowest of the GIDs in *gid on success, -1 if they
+ * could not be found.
+ */
+static int search_gids (struct id_pool *pool, gid_t start, size_t count,
+			gid_t *gid)
+{
+	gid_t id, cand;
+	size_t k;
+	int result;
+
+	id = start;
+	while (pool->sys ? idset_prev_free (&pool->used, &id, pool->min)
+	                 : idset_next_free (&pool->used, &id, pool->max)) {
+		for (k = 0; k < count; k++) {
+			if (pool->sys ? (id - pool->min < k) : (pool->max - id < k)) {
+				/* Not enough GIDs left in the range */
+				return -1;
+			}
+			cand = pool->sys ? id - k : id + k;
+			if (   !idset_has (&pool->used, cand)
+			    && !idset_has (&pool->unused, cand)) {
+				probe_gids (pool, cand);
+			}
+			result = check_gid (cand, pool->min, pool->max,
+			                    &pool->used, &pool->unused);
+			if (   result == 0 && !pool->hinted
+			    && gr_locate_gid (cand) != NULL) {
+				/* Added to the local database after the scan */
+				(void) idset_insert (&pool->used, cand);
+				result = EEXIST;
+			}
+			if (result == 0) {
+				continue;
+			}
+			if (result != EEXIST && result != EINVAL) {
+				/*
+				 * An unexpected error occurred.
+				 *
+				 * Only report it the first time to avoid spamming
+				 * the logs
+				 *
+				 */
+				if (!pool->nospam) {
+					fprintf (log_get_logfd(),
+						pool->sys
+						? _("%s: Can't get unique system GID (%s). "
+						    "Suppressing additional messages.\n")
+						: _("%s: Can't get unique GID (%s). "
+						    "Suppressing additional messages.\n"),
+						log_get_progname(), strerror (result));
+					SYSLOG(LOG_ERR,
+						"Error checking available GIDs: %s",
+						strerror(result));
+					pool->nospam = true;
+				}
+				/*
+				 * We will continue anyway. Hopefully a later GID
+				 * will work properly.
+				 */
+			}
+			break;
+		}
+		if (k == count) {
+			/* These GIDs are available. */
+			*gid = pool->sys ? id - (count - 1) : id;
+			return 0;
+		}
 
-			used_gids[grp->gr_gid] = true;
+		/* Continue after the GID which is in use or unusable */
+		cand = pool->sys ? id - k : id + k;
+		if (cand == (pool->sys ? pool->min : pool->max)) {
+			return -1;
 		}
+		id = pool->sys ? cand - 1 : cand + 1;
 	}
 
-	if (sys_group) {
+	return -1;
+}
+
+/*
+ * pick_gids - Select count consecutive unused GIDs from the pool
+ *
+ * Return 0 with the lowest of the GIDs in *gid on success, -1 if no
+ * unused GIDs are available.
+ */
+static int pick_gids (struct id_pool *pool, size_t count, gid_t *gid)
+{
+	gid_t start;
+
+	if (pool->hinted) {
+		if (search_gids (pool, pool->sys ? pool->lowest_found
+		                                : pool->highest_found,
+		                count, gid) == 0) {
+			return 0;
+		}
+		/* The range is full beyond the hint: look for gaps */
+		if (scan_gids (pool) == -1) {
+			return -1;
+		}
+	}
+
+	if (pool->sys) {
 		/*
 		 * For system groups, we want to start from the
 		 * top of the range and work downwards.
@@ -284,7 +531,8 @@ int find_new_gid (bool sys_group,
 		 * At the conclusion of the gr_next() search, we will either
 		 * have a presumed-free GID or we will be at GID_MIN - 1.
 		 */
-		if (lowest_found < gid_min) {
+		start = pool->lowest_found;
+		if (start < pool->min) {
 			/*
 			 * In this case, a GID is in use at GID_MIN.
 			 *
@@ -296,45 +544,12 @@ int find_new_gid (bool sys_group,
 			 * auto-detection with care (and prefer to assign GIDs
 			 * explicitly).
 			 */
-			lowest_found = gid_max;
+			start = pool->max;
 		}
 
 		/* Search through all of the IDs in the range */
-		for (id = lowest_found; id >= gid_min; id--) {
-			result = check_gid (id, gid_min, gid_max, used_gids);
-			if (result == 0) {
-				/* This GID is available. Return it. */
-				*gid = id;
-				free (used_gids);
-				return 0;
-			} else if (result == EEXIST || result == EINVAL) {
-				/*
-				 * This GID is in use or unusable, we'll
-				 * continue to the next.
-				 */
-			} else {
-				/*
-				 * An unexpected error occurred.
-				 *
-				 * Only report it the first time to avoid spamming
-				 * the logs
-				 *
-				 */
-				if (!nospam) {
-					fprintf (log_get_logfd(),
-						_("%s: Can't get unique system GID (%s). "
-						  "Suppressing additional messages.\n"),
-						log_get_progname(), strerror (result));
-					SYSLOG(LOG_ERR,
-						"Error checking available GIDs: %s",
-						strerror(result));
-					nospam = 1;
-				}
-				/*
-				 * We will continue anyway. Hopefully a later GID
-				 * will work properly.
-				 */
-			}
+		if (search_gids (pool, start, count, gid) == 0) {
+			return 0;
 		}
 
 		/*
@@ -345,43 +560,8 @@ int find_new_gid (bool sys_group,
 		 * GID_MAX - 1, all groups in the range in use and maintained by
 		 * network services such as LDAP.)
 		 */
-		if (lowest_found != gid_max) {
-			for (id = gid_max; id >= gid_min; id--) {
-				result = check_gid (id, gid_min, gid_max, used_gids);
-				if (result == 0) {
-					/* This GID is available. Return it. */
-					*gid = id;
-					free (used_gids);
-					return 0;
-				} else if (result == EEXIST || result == EINVAL) {
-					/*
-					 * This GID is in use or unusable, we'll
-					 * continue to the next.
-					 */
-				} else {
-					/*
-					 * An unexpected error occurred.
-					 *
-					 * Only report it the first time to avoid spamming
-					 * the logs
-					 *
-					 */
-					if (!nospam) {
-						fprintf (log_get_logfd(),
-							_("%s: Can't get unique system GID (%s). "
-							  "Suppressing additional messages.\n"),
-							log_get_progname(), strerror (result));
-						SYSLOG(LOG_ERR,
-							"Error checking available GIDs: %s",
-							strerror(result));
-						nospam = 1;
-					}
-					/*
-					 * We will continue anyway. Hopefully a later GID
-					 * will work properly.
-					 */
-				}
-			}
+		if (start != pool->max) {
+			return search_gids (pool, pool->max, count, gid);
 		}
 	} else { /* !sys_group */
 		/*
@@ -393,7 +573,8 @@ int find_new_gid (bool sys_group,
 		 * At the conclusion of the gr_next() search, we will either
 		 * have a presumed-free GID or we will be at GID_MAX + 1.
 		 */
-		if (highest_found > gid_max) {
+		start = pool->highest_found;
+		if (start > pool->max) {
 			/*
 			 * In this case, a GID is in use at GID_MAX.
 			 *
@@ -405,45 +586,12 @@ int find_new_gid (bool sys_group,
 			 * auto-detection with care (and prefer to assign GIDs
 			 * explicitly).
 			 */
-			highest_found = gid_min;
+			start = pool->min;
 		}
 
 		/* Search through all of the IDs in the range */
-		for (id = highest_found; id <= gid_max; id++) {
-			result = check_gid (id, gid_min, gid_max, used_gids);
-			if (result == 0) {
-				/* This GID is available. Return it. */
-				*gid = id;
-				free (used_gids);
-				return 0;
-			} else if (result == EEXIST || result == EINVAL) {
-				/*
-				 * This GID is in use or unusable, we'll
-				 * continue to the next.
-				 */
-			} else {
-				/*
-				 * An unexpected error occurred.
-				 *
-				 * Only report it the first time to avoid spamming
-				 * the logs
-				 *
-				 */
-				if (!nospam) {
-					fprintf (log_get_logfd(),
-						_("%s: Can't get unique GID (%s). "
-						  "Suppressing additional messages.\n"),
-						log_get_progname(), strerror (result));
-					SYSLOG(LOG_ERR,
-						"Error checking available GIDs: %s",
-						strerror(result));
-					nospam = 1;
-				}
-				/*
-				 * We will continue anyway. Hopefully a later GID
-				 * will work properly.
-				 */
-			}
+		if (search_gids (pool, start, count, gid) == 0) {
+			return 0;
 		}
 
 		/*
@@ -454,52 +602,301 @@ int find_new_gid (bool sys_group,
 		 * GID_MIN + 1, all groups in the range in use and maintained by
 		 * network services such as LDAP.)
 		 */
-		if (highest_found != gid_min) {
-			for (id = gid_min; id <= gid_max; id++) {
-				result = check_gid (id, gid_min, gid_max, used_gids);
-				if (result == 0) {
-					/* This GID is available. Return it. */
-					*gid = id;
-					free (used_gids);
-					return 0;
-				} else if (result == EEXIST || result == EINVAL) {
-					/*
-					 * This GID is in use or unusable, we'll
-					 * continue to the next.
-					 */
-				} else {
-					/*
-					 * An unexpected error occurred.
-					 *
-					 * Only report it the first time to avoid spamming
-					 * the logs
-					 *
-					 */
-					if (!nospam) {
-						fprintf (log_get_logfd(),
-							_("%s: Can't get unique GID (%s). "
-							  "Suppressing additional messages.\n"),
-							log_get_progname(), strerror (result));
-						SYSLOG(LOG_ERR,
-							"Error checking available GIDs: %s",
-							strerror(result));
-						nospam = 1;
-					}
-					/*
-					 * We will continue anyway. Hopefully a later GID
-					 * will work properly.
-					 */
-				}
-			}
+		if (start != pool->min) {
+			return search_gids (pool, pool->min, count, gid);
 		}
 	}
 
-	/* The code reached here and found no available IDs in the range */
-	fprintf (log_get_logfd(),
-		_("%s: Can't get unique GID (no more available GIDs)\n"),
-		log_get_progname());
-	SYSLOG(LOG_WARN, "no more available GIDs on the system");
-	free (used_gids);
 	return -1;
 }
 
+/*
+ * reserve_gids - Mark count GIDs starting at gid as used in the pool
+ *
+ * The next search then starts beyond them, as it would after a new scan
+ * of the group database.
+ *
+ * Return 0 on success, -1 on failure to allocate memory.
+ */
+static int reserve_gids (struct id_pool *pool, gid_t gid, size_t count)
+{
+	size_t k;
+
+	for (k = 0; k < count; k++) {
+		if (idset_insert (&pool->used, gid + k) == -1) {
+			fprinte(log_get_logfd(), _("%s: failed to allocate memory"),
+				log_get_progname());
+			return -1;
+		}
+	}
+	if (gid + (count - 1) >= pool->highest_found) {
+		pool->highest_found = gid + count;
+	}
+	if ((gid <= pool->lowest_found) && (gid >= pool->min)) {
+		pool->lowest_found = gid - 1;
+	}
+
+	gid_hint.sys = pool->sys;
+	gid_hint.min = pool->min;
+	gid_hint.max = pool->max;
+	gid_hint.next = pool->sys ? pool->lowest_found : pool->highest_found;
+	gid_hint_pending = true;
+
+	return 0;
+}
+
+/*
+ * gid_pool_open - Prepare the automatic assignment of several GIDs.
+ *
+ * The local database is scanned once, and the remote databases are
+ * enumerated with ID_NSS_ENUM_ENAB; otherwise, the candidates are looked
+ * up in chunks, whose results are kept in the pool.  The GIDs are then
+ * handed out by gid_pool_get() and gid_pool_get_range(), in the order
+ * in which successive calls to find_new_gid() would select them.
+ *
+ * With ID_HINT_ENAB, the scan is skipped if the group database did not
+ * change since the last GID was assigned, and the search resumes from
+ * there.
+ *
+ * The group database shall remain locked while the pool is used, and the
+ * GIDs of the entries added without the pool shall be recorded with
+ * gid_pool_add().
+ *
+ * Return the pool on success, NULL on failure.  It shall be freed with
+ * id_pool_free().
+ */
+/*@null@*//*@only@*/struct id_pool *gid_pool_open (bool sys_group)
+{
+	struct id_pool *pool;
+	struct idhint hint;
+	gid_t gid_min, gid_max, preferred_min;
+
+	/*
+	 * First, figure out what ID range is appropriate for
+	 * automatic assignment
+	 */
+	if (get_ranges (sys_group, &gid_min, &gid_max, &preferred_min) == EINVAL) {
+		return NULL;
+	}
+
+	pool = malloc (sizeof (*pool));
+	if (NULL == pool) {
+		fprinte(log_get_logfd(), _("%s: failed to allocate memory"),
+			log_get_progname());
+		return NULL;
+	}
+	pool->used = (struct idset) IDSET_INIT;
+	pool->unused = (struct idset) IDSET_INIT;
+	pool->chunk = 1;
+	pool->min = gid_min;
+	pool->max = gid_max;
+	pool->preferred_min = preferred_min;
+	pool->sys = sys_group;
+	pool->nospam = false;
+	pool->hinted = false;
+
+	if (   getdef_bool ("ID_HINT_ENAB")
+	    && !__gr_get_db ()->changed
+	    && idhint_read ("gid", gr_dbname (), &hint) == 0
+	    && hint.sys == sys_group && hint.min == gid_min && hint.max == gid_max) {
+		/*
+		 * The group database did not change since the last GID
+		 * was assigned: resume the search from there, and only
+		 * check the candidates.
+		 */
+		pool->hinted = true;
+		pool->highest_found = hint.next;
+		pool->lowest_found = hint.next;
+		return pool;
+	}
+
+	if (scan_gids (pool) == -1) {
+		id_pool_free (pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+/*
+ * gid_pool_get - Hand out an unused GID from the pool.
+ *
+ * The preferred GID is used if it is available, as with find_new_gid().
+ *
+ * Return 0 on success, -1 if no unused GIDs are available.
+ */
+int gid_pool_get (struct id_pool *pool,
+                  gid_t *gid,
+                  /*@null@*/gid_t const *preferred_gid)
+{
+	int result;
+
+	assert (gid != NULL);
+
+	if (preferred_gid) {
+		result = check_preferred_gid (*preferred_gid,
+		                              pool->preferred_min, pool->max,
+		                              &pool->used);
+		if (result == -1) {
+			return -1;
+		}
+		if (result == 0) {
+			if (reserve_gids (pool, *preferred_gid, 1) == -1) {
+				return -1;
+			}
+			*gid = *preferred_gid;
+			return 0;
+		}
+	}
+
+	return gid_pool_get_range (pool, gid, 1);
+}
+
+/*
+ * gid_pool_get_range - Hand out count consecutive unused GIDs from the
+ * pool.
+ *
+ * Return 0 with the lowest of the GIDs in *gid on success, -1 if not
+ * enough consecutive unused GIDs are available.
+ */
+int gid_pool_get_range (struct id_pool *pool, gid_t *gid, size_t count)
+{
+	assert (gid != NULL);
+	assert (count > 0);
+
+	if (pick_gids (pool, count, gid) == -1) {
+		/* The code reached here and found no available IDs in the range */
+		fprintf (log_get_logfd(),
+			_("%s: Can't get unique GID (no more available GIDs)\n"),
+			log_get_progname());
+		SYSLOG(LOG_WARN, "no more available GIDs on the system");
+		return -1;
+	}
+
+	return reserve_gids (pool, *gid, count);
+}
+
+/*
+ * gid_pool_add - Record a GID which was assigned without the pool.
+ *
+ * The pool then hands out GIDs as if the group database had been scanned
+ * again.
+ *
+ * Return 0 on success, -1 on failure to allocate memory.
+ */
+int gid_pool_add (struct id_pool *pool, gid_t gid)
+{
+	if (gid < pool->min || gid > pool->max) {
+		return 0;
+	}
+
+	return reserve_gids (pool, gid, 1);
+}
+
+/*
+ * gid_hint_save - Save where the automatic assignment of GIDs resumes.
+ *
+ * It is called by gr_unlock().  written tells whether the changes of the
+ * group database were written; otherwise the GIDs handed out are not used.
+ */
+void gid_hint_save (bool written)
+{
+	if (!gid_hint_pending) {
+		return;
+	}
+	gid_hint_pending = false;
+
+	if (written && getdef_bool ("ID_HINT_ENAB")) {
+		(void) idhint_write ("gid", gr_dbname (), &gid_hint);
+	}
+}
+
+/*
+ * find_new_gid - Find a new unused GID.
+ *
+ * If successful, find_new_gid provides an unused group ID in the
+ * [GID_MIN:GID_MAX] range.
+ * This ID should be higher than all the used GID, but if not possible,
+ * the lowest unused ID in the range will be returned.
+ *
+ * Return 0 on success, -1 if no unused GIDs are available.
+ */
+int find_new_gid(bool sys_group,
+                 gid_t *gid,
+                 /*@null@*/gid_t const *preferred_gid)
+{
+	struct id_pool *pool;
+	gid_t gid_min, gid_max, preferred_min;
+	int result;
+
+	assert (gid != NULL);
+
+	/* Check if the preferred GID is available */
+	if (preferred_gid) {
+		result = get_ranges (sys_group, &gid_min, &gid_max,
+		                     &preferred_min);
+		if (result == EINVAL) {
+			return -1;
+		}
+
+		result = check_preferred_gid (*preferred_gid, preferred_min,
+		                              gid_max, NULL);
+		if (result == 0) {
+			*gid = *preferred_gid;
+			return 0;
+		}
+		if (result == -1) {
+			return -1;
+		}
+	}
+
+	pool = gid_pool_open (sys_group);
+	if (NULL == pool) {
+		return -1;
+	}
+	result = gid_pool_get_range (pool, gid, 1);
+	id_pool_free (pool);
+
+	return result;
+}
+
+/*
+ * find_new_gids - Find n new unused GIDs.
+ *
+ * The GIDs are selected after a single scan of the databases, as n
+ * successive calls to find_new_gid() would select them.  If contiguous
+ * is true, they are consecutive, and stored in ascending order.
+ *
+ * Return 0 on success, -1 if not enough unused GIDs are available.
+ */
+int find_new_gids (bool sys_group, gid_t *gids, size_t n, bool contiguous)
+{
+	struct id_pool *pool;
+	size_t i;
+	int result = 0;
+
+	assert (gids != NULL);
+
+	if (n == 0) {
+		return 0;
+	}
+
+	pool = gid_pool_open (sys_group);
+	if (NULL == pool) {
+		return -1;
+	}
+	if (contiguous) {
+		result = gid_pool_get_range (pool, &gids[0], n);
+		for (i = 1; i < n && result == 0; i++) {
+			gids[i] = gids[0] + i;
+		}
+	} else {
+		for (i = 0; i < n && result == 0; i++) {
+			result = gid_pool_get_range (pool, &gids[i], 1);
+		}
+	}
+	id_pool_free (pool);
+
+	return result;
+}
+
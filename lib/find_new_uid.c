@@ -12,17 +12,25 @@
 #include <stdio.h>
 #include <errno.h>
 
-#include "alloc/calloc.h"
+#include "attr.h"
 #include "prototypes.h"
 #include "pwio.h"
 #include "getdef.h"
+#include "idhint.h"
+#include "idset.h"
 #include "io/fprintf.h"
 #include "shadowlog.h"
+#include "workpool.h"
 
 #undef NDEBUG
 #include <assert.h>
 
 
+/* Where the search resumes, saved when the passwd database is unlocked */
+static struct idhint uid_hint;
+static bool uid_hint_pending = false;
+
+
 /*
  * get_ranges - Get the minimum and maximum ID ranges for the search
  *
@@ -107,11 +115,15 @@ static int get_ranges (bool sys_user, uid_t *min_id, uid_t *max_id,
  * If the ID might clash with -1, return EINVAL
  * If the ID is outside the range, return ERANGE
  * In other cases, return errno from getpwuid()
+ *
+ * The IDs found in use with getpwuid() are added to used_uids, and the
+ * others to unused_uids, which are not looked up again.
  */
 static int check_uid(const uid_t uid,
 		     const uid_t uid_min,
 		     const uid_t uid_max,
-		     const bool *used_uids)
+		     struct idset *used_uids,
+		     struct idset *unused_uids)
 {
 	/* First test that the preferred ID is in the range */
 	if (uid < uid_min || uid > uid_max) {
@@ -127,12 +139,20 @@ static int check_uid(const uid_t uid,
 	 * Check whether we already detected this UID
 	 * using the pw_next() loop
 	 */
-	if (used_uids != NULL && used_uids[uid]) {
+	if (used_uids != NULL && idset_has (used_uids, uid)) {
 		return EEXIST;
 	}
+	/* Or that NSS did not know it */
+	if (unused_uids != NULL && idset_has (unused_uids, uid)) {
+		return 0;
+	}
 	/* Check if the UID exists according to NSS */
 	errno = 0;
 	if (prefix_getpwuid(uid) != NULL) {
+		/* Remember it, in case the search wraps around */
+		if (used_uids != NULL) {
+			(void) idset_insert (used_uids, uid);
+		}
 		return EEXIST;
 	} else {
 		/* getpwuid() was NULL
@@ -140,6 +160,9 @@ static int check_uid(const uid_t uid,
 		 * failures of remote user identity services
 		 * would completely block user/group creation
 		 */
+		if (unused_uids != NULL) {
+			(void) idset_insert (unused_uids, uid);
+		}
 	}
 
 	/* If we've made it here, the UID must be available */
@@ -147,75 +170,183 @@ static int check_uid(const uid_t uid,
 }
 
 /*
- * find_new_uid - Find a new unused UID.
+ * A candidate UID looked up by probe_uids().
+ */
+struct uid_probe {
+	uid_t uid;
+	bool used;
+};
+
+static void probe_uid_job (MAYBE_UNUSED struct workpool *wp, void *arg)
+{
+	struct uid_probe *probe = arg;
+	struct passwd *pwd;
+
+	/* getpwuid() is not reentrant */
+	pwd = xgetpwuid (probe->uid);
+	probe->used = (NULL != pwd);
+	if (NULL != pwd) {
+		pw_free (pwd);
+	}
+}
+
+/*
+ * probe_uids - Look up a chunk of candidate UIDs with NSS.
  *
- * If successful, find_new_uid provides an unused user ID in the
- * [UID_MIN:UID_MAX] range.
- * This ID should be higher than all the used UID, but if not possible,
- * the lowest unused ID in the range will be returned.
+ * The candidates are the UIDs from start in the direction of the
+ * search which were not looked up yet.  The UIDs in use are added to
+ * pool->used, and the others to pool->unused, for the rest of the
+ * allocation.
  *
- * Return 0 on success, -1 if no unused UIDs are available.
+ * A chunk starts with a single UID, and doubles each time a UID is
+ * found in use, up to ID_PROBE_CHUNK UIDs.  When the first candidate is
+ * free, this costs a single lookup.  In a dense range, the lookups of a
+ * chunk are made in parallel, so that they take about as long as one of
+ * them.  The files of a --prefix are read sequentially.
+ *
+ * Failures to allocate memory are ignored: check_uid() then looks the
+ * candidates up one by one.
  */
-int find_new_uid(bool sys_user,
-                 uid_t *uid,
-                 /*@null@*/uid_t const *preferred_uid)
+static void probe_uids (struct id_pool *pool, uid_t start)
 {
-	bool *used_uids;
-	const struct passwd *pwd;
-	uid_t uid_min, uid_max, preferred_min;
+	size_t n, i;
 	uid_t id;
-	uid_t lowest_found, highest_found;
-	int result;
-	int nospam = 0;
-
-	assert (uid != NULL);
+	bool found = false;
+	struct workpool wp;
+	struct uid_probe probes[ID_PROBE_CHUNK];
+
+	n = 0;
+	for (id = start; n < pool->chunk; id = pool->sys ? id - 1 : id + 1) {
+		if (   !idset_has (&pool->used, id)
+		    && !idset_has (&pool->unused, id)
+		    && id != UINT16_MAX && id != UINT32_MAX) {
+			probes[n].uid = id;
+			probes[n].used = false;
+			n++;
+		}
+		if (id == (pool->sys ? pool->min : pool->max)) {
+			break;
+		}
+	}
 
-	/*
-	 * First, figure out what ID range is appropriate for
-	 * automatic assignment
-	 */
-	result = get_ranges (sys_user, &uid_min, &uid_max, &preferred_min);
-	if (result == EINVAL) {
-		return -1;
+	if (n > 1 && !prefix_is_set ()) {
+		workpool_start (&wp, n);
+		for (i = 0; i < n; i++) {
+			workpool_submit (&wp, probe_uid_job, &probes[i]);
+		}
+		(void) workpool_stop (&wp);
+	} else {
+		for (i = 0; i < n; i++) {
+			probes[i].used = (prefix_getpwuid (probes[i].uid) != NULL);
+		}
 	}
 
-	/* Check if the preferred UID is available */
-	if (preferred_uid) {
-		result = check_uid (*preferred_uid, preferred_min, uid_max, NULL);
-		if (result == 0) {
-			/*
-			 * Make sure the UID isn't queued for use already
-			 */
-			if (pw_locate_uid (*preferred_uid) == NULL) {
-				*uid = *preferred_uid;
-				return 0;
-			}
-			/*
-			 * pw_locate_uid() found the UID in an as-yet uncommitted
-			 * entry. We'll proceed below and auto-set an UID.
-			 */
-		} else if (result == EEXIST || result == ERANGE || result == EINVAL) {
-			/*
-			 * Continue on below. At this time, we won't
-			 * treat these three cases differently.
-			 */
+	for (i = 0; i < n; i++) {
+		if (probes[i].used) {
+			(void) idset_insert (&pool->used, probes[i].uid);
+			found = true;
 		} else {
-			/*
-			 * An unexpected error occurred. We should report
-			 * this and fail the user creation.
-			 * This differs from the automatic creation
-			 * behavior below, since if a specific UID was
-			 * requested and generated an error, the user is
-			 * more likely to want to stop and address the
-			 * issue.
-			 */
-			fprintf (log_get_logfd(),
-				_("%s: Encountered error attempting to use "
-				  "preferred UID: %s\n"),
-				log_get_progname(), strerror (result));
-			return -1;
+			(void) idset_insert (&pool->unused, probes[i].uid);
+		}
+	}
+
+	if (found && pool->chunk < ID_PROBE_CHUNK) {
+		pool->chunk *= 2;
+	}
+}
+
+/*
+ * add_nss_uids - Add the UIDs in [uid_min:uid_max] which NSS can
+ * enumerate to used_uids.
+ *
+ * With ID_NSS_ENUM_ENAB, this walks the remote databases once, instead
+ * of looking the candidates up with getpwuid().  Services which do not
+ * enumerate their entries are still probed by probe_uids().
+ *
+ * Return 0 on success, -1 on failure to allocate memory.
+ */
+static int add_nss_uids (struct idset *used_uids,
+			 uid_t uid_min, uid_t uid_max)
+{
+	int ret = 0;
+	const struct passwd *pwd;
+
+	prefix_setpwent ();
+	while (NULL != (pwd = prefix_getpwent ())) {
+		if (pwd->pw_uid < uid_min || pwd->pw_uid > uid_max) {
+			continue;
+		}
+		if (idset_add (used_uids, pwd->pw_uid) == -1) {
+			ret = -1;
+			break;
 		}
 	}
+	prefix_endpwent ();
+
+	return ret;
+}
+
+/*
+ * check_preferred_uid - See if the preferred UID can be used
+ *
+ * used_uids, if not NULL, holds the UIDs already handed out.
+ *
+ * Return 0 if the UID can be used, 1 if a UID should be selected
+ * automatically instead, and -1 on unexpected errors.
+ */
+static int check_preferred_uid (uid_t preferred_uid,
+				uid_t preferred_min,
+				uid_t uid_max,
+				/*@null@*/const struct idset *used_uids)
+{
+	int result;
+
+	result = check_uid (preferred_uid, preferred_min, uid_max, NULL, NULL);
+	if (result == 0) {
+		/*
+		 * Make sure the UID isn't queued for use already
+		 */
+		if (   pw_locate_uid (preferred_uid) == NULL
+		    && (used_uids == NULL || !idset_has (used_uids, preferred_uid))) {
+			return 0;
+		}
+		/*
+		 * pw_locate_uid() found the UID in an as-yet uncommitted
+		 * entry. We'll proceed below and auto-set an UID.
+		 */
+	} else if (result == EEXIST || result == ERANGE || result == EINVAL) {
+		/*
+		 * Continue on below. At this time, we won't
+		 * treat these three cases differently.
+		 */
+	} else {
+		/*
+		 * An unexpected error occurred. We should report
+		 * this and fail the user creation.
+		 * This differs from the automatic creation
+		 * behavior below, since if a specific UID was
+		 * requested and generated an error, the user is
+		 * more likely to want to stop and address the
+		 * issue.
+		 */
+		fprintf (log_get_logfd(),
+			_("%s: Encountered error attempting to use "
+			  "preferred UID: %s\n"),
+			log_get_progname(), strerror (result));
+		return -1;
+	}
+
+	return 1;
+}
+
+/*
+ * scan_uids - Add the UIDs in use to the pool
+ *
+ * Return 0 on success, -1 on failure to allocate memory.
+ */
+static int scan_uids (struct id_pool *pool)
+{
+	const struct passwd *pwd;
 
 	/*
 	 * Search the entire passwd file,
@@ -236,44 +367,160 @@ int find_new_uid(bool sys_user,
 	 *
 	 */
 
-	/* Create an array to hold all of the discovered UIDs */
-	used_uids = calloc_T(uid_max + 1, bool);
-	if (NULL == used_uids) {
-		fprinte(log_get_logfd(), _("%s: failed to allocate memory"),
-			log_get_progname());
-		return -1;
-	}
-
 	/* First look for the lowest and highest value in the local database */
 	(void) pw_rewind ();
-	highest_found = uid_min;
-	lowest_found = uid_max;
+	pool->highest_found = pool->min;
+	pool->lowest_found = pool->max;
 	while (NULL != (pwd = pw_next())) {
 		/*
 		 * Does this entry have a lower UID than the lowest we've found
 		 * so far?
 		 */
-		if ((pwd->pw_uid <= lowest_found) && (pwd->pw_uid >= uid_min)) {
-			lowest_found = pwd->pw_uid - 1;
+		if ((pwd->pw_uid <= pool->lowest_found) && (pwd->pw_uid >= pool->min)) {
+			pool->lowest_found = pwd->pw_uid - 1;
 		}
 
 		/*
 		 * Does this entry have a higher UID than the highest we've found
 		 * so far?
 		 */
-		if ((pwd->pw_uid >= highest_found) && (pwd->pw_uid <= uid_max)) {
-			highest_found = pwd->pw_uid + 1;
+		if ((pwd->pw_uid >= pool->highest_found) && (pwd->pw_uid <= pool->max)) {
+			pool->highest_found = pwd->pw_uid + 1;
 		}
 
 		/* create index of used UIDs */
-		if (pwd->pw_uid >= uid_min
-			&& pwd->pw_uid <= uid_max) {
+		if (pwd->pw_uid >= pool->min
+			&& pwd->pw_uid <= pool->max) {
+
+			if (idset_add (&pool->used, pwd->pw_uid) == -1) {
+				fprinte(log_get_logfd(),
+					_("%s: failed to allocate memory"),
+					log_get_progname());
+				return -1;
+			}
+		}
+	}
+	if (   getdef_bool ("ID_NSS_ENUM_ENAB")
+	    && add_nss_uids (&pool->used, pool->min, pool->max) == -1) {
+		fprinte(log_get_logfd(), _("%s: failed to allocate memory"),
+			log_get_progname());
+		return -1;
+	}
+	idset_sort (&pool->used);
+	pool->hinted = false;
+
+	return 0;
+}
 
-			used_uids[pwd->pw_uid] = true;
+/*
+ * search_uids - Search count consecutive unused UIDs
+ *
+ * For system users, the search goes from start down to the bottom of
+ * the range, and for non-system users from start up to the top of the
+ * range.  The UIDs found are not reserved.
+ *
+ * Return 0 with the lowest of the UIDs in *uid on success, -1 if they
+ * could not be found.
+ */
+static int search_uids (struct id_pool *pool, uid_t start, size_t count,
+			uid_t *uid)
+{
+	uid_t id, cand;
+	size_t k;
+	int result;
+
+	id = start;
+	while (pool->sys ? idset_prev_free (&pool->used, &id, pool->min)
+	                 : idset_next_free (&pool->used, &id, pool->max)) {
+		for (k = 0; k < count; k++) {
+			if (pool->sys ? (id - pool->min < k) : (pool->max - id < k)) {
+				/* Not enough UIDs left in the range */
+				return -1;
+			}
+			cand = pool->sys ? id - k : id + k;
+			if (   !idset_has (&pool->used, cand)
+			    && !idset_has (&pool->unused, cand)) {
+				probe_uids (pool, cand);
+			}
+			result = check_uid (cand, pool->min, pool->max,
+			                    &pool->used, &pool->unused);
+			if (   result == 0 && !pool->hinted
+			    && pw_locate_uid (cand) != NULL) {
+				/* Added to the local database after the scan */
+				(void) idset_insert (&pool->used, cand);
+				result = EEXIST;
+			}
+			if (result == 0) {
+				continue;
+			}
+			if (result != EEXIST && result != EINVAL) {
+				/*
+				 * An unexpected error occurred.
+				 *
+				 * Only report it the first time to avoid spamming
+				 * the logs
+				 *
+				 */
+				if (!pool->nospam) {
+					fprintf (log_get_logfd(),
+						pool->sys
+						? _("%s: Can't get unique system UID (%s). "
+						    "Suppressing additional messages.\n")
+						: _("%s: Can't get unique UID (%s). "
+						    "Suppressing additional messages.\n"),
+						log_get_progname(), strerror (result));
+					SYSLOG(LOG_ERR,
+						"Error checking available UIDs: %s",
+						strerror(result));
+					pool->nospam = true;
+				}
+				/*
+				 * We will continue anyway. Hopefully a later UID
+				 * will work properly.
+				 */
+			}
+			break;
+		}
+		if (k == count) {
+			/* These UIDs are available. */
+			*uid = pool->sys ? id - (count - 1) : id;
+			return 0;
+		}
+
+		/* Continue after the UID which is in use or unusable */
+		cand = pool->sys ? id - k : id + k;
+		if (cand == (pool->sys ? pool->min : pool->max)) {
+			return -1;
 		}
+		id = pool->sys ? cand - 1 : cand + 1;
 	}
 
-	if (sys_user) {
+	return -1;
+}
+
+/*
+ * pick_uids - Select count consecutive unused UIDs from the pool
+ *
+ * Return 0 with the lowest of the UIDs in *uid on success, -1 if no
+ * unused UIDs are available.
+ */
+static int pick_uids (struct id_pool *pool, size_t count, uid_t *uid)
+{
+	uid_t start;
+
+	if (pool->hinted) {
+		if (search_uids (pool, pool->sys ? pool->lowest_found
+		                                : pool->highest_found,
+		                count, uid) == 0) {
+			return 0;
+		}
+		/* The range is full beyond the hint: look for gaps */
+		if (scan_uids (pool) == -1) {
+			return -1;
+		}
+	}
+
+	if (pool->sys) {
 		/*
 		 * For system users, we want to start from the
 		 * top of the range and work downwards.
@@ -283,7 +530,8 @@ int find_new_uid(bool sys_user,
 		 * At the conclusion of the pw_next() search, we will either
 		 * have a presumed-free UID or we will be at UID_MIN - 1.
 		 */
-		if (lowest_found < uid_min) {
+		start = pool->lowest_found;
+		if (start < pool->min) {
 			/*
 			 * In this case, an UID is in use at UID_MIN.
 			 *
@@ -295,45 +543,12 @@ int find_new_uid(bool sys_user,
 			 * auto-detection with care (and prefer to assign UIDs
 			 * explicitly).
 			 */
-			lowest_found = uid_max;
+			start = pool->max;
 		}
 
 		/* Search through all of the IDs in the range */
-		for (id = lowest_found; id >= uid_min; id--) {
-			result = check_uid (id, uid_min, uid_max, used_uids);
-			if (result == 0) {
-				/* This UID is available. Return it. */
-				*uid = id;
-				free (used_uids);
-				return 0;
-			} else if (result == EEXIST || result == EINVAL) {
-				/*
-				 * This UID is in use or unusable, we'll
-				 * continue to the next.
-				 */
-			} else {
-				/*
-				 * An unexpected error occurred.
-				 *
-				 * Only report it the first time to avoid spamming
-				 * the logs
-				 *
-				 */
-				if (!nospam) {
-					fprintf (log_get_logfd(),
-						_("%s: Can't get unique system UID (%s). "
-						  "Suppressing additional messages.\n"),
-						log_get_progname(), strerror (result));
-					SYSLOG(LOG_ERR,
-						"Error checking available UIDs: %s",
-						strerror(result));
-					nospam = 1;
-				}
-				/*
-				 * We will continue anyway. Hopefully a later UID
-				 * will work properly.
-				 */
-			}
+		if (search_uids (pool, start, count, uid) == 0) {
+			return 0;
 		}
 
 		/*
@@ -344,43 +559,8 @@ int find_new_uid(bool sys_user,
 		 * UID_MAX - 1, all users in the range in use and maintained by
 		 * network services such as LDAP.)
 		 */
-		if (lowest_found != uid_max) {
-			for (id = uid_max; id >= uid_min; id--) {
-				result = check_uid (id, uid_min, uid_max, used_uids);
-				if (result == 0) {
-					/* This UID is available. Return it. */
-					*uid = id;
-					free (used_uids);
-					return 0;
-				} else if (result == EEXIST || result == EINVAL) {
-					/*
-					 * This UID is in use or unusable, we'll
-					 * continue to the next.
-					 */
-				} else {
-					/*
-					 * An unexpected error occurred.
-					 *
-					 * Only report it the first time to avoid spamming
-					 * the logs
-					 *
-					 */
-					if (!nospam) {
-						fprintf (log_get_logfd(),
-							_("%s: Can't get unique system UID (%s). "
-							  "Suppressing additional messages.\n"),
-							log_get_progname(), strerror (result));
-						SYSLOG(LOG_ERR,
-							"Error checking available UIDs: %s",
-							strerror(result));
-						nospam = 1;
-					}
-					/*
-					 * We will continue anyway. Hopefully a later UID
-					 * will work properly.
-					 */
-				}
-			}
+		if (start != pool->max) {
+			return search_uids (pool, pool->max, count, uid);
 		}
 	} else { /* !sys_user */
 		/*
@@ -392,7 +572,8 @@ int find_new_uid(bool sys_user,
 		 * At the conclusion of the pw_next() search, we will either
 		 * have a presumed-free UID or we will be at UID_MAX + 1.
 		 */
-		if (highest_found > uid_max) {
+		start = pool->highest_found;
+		if (start > pool->max) {
 			/*
 			 * In this case, a UID is in use at UID_MAX.
 			 *
@@ -404,45 +585,12 @@ int find_new_uid(bool sys_user,
 			 * auto-detection with care (and prefer to assign UIDs
 			 * explicitly).
 			 */
-			highest_found = uid_min;
+			start = pool->min;
 		}
 
 		/* Search through all of the IDs in the range */
-		for (id = highest_found; id <= uid_max; id++) {
-			result = check_uid (id, uid_min, uid_max, used_uids);
-			if (result == 0) {
-				/* This UID is available. Return it. */
-				*uid = id;
-				free (used_uids);
-				return 0;
-			} else if (result == EEXIST || result == EINVAL) {
-				/*
-				 * This UID is in use or unusable, we'll
-				 * continue to the next.
-				 */
-			} else {
-				/*
-				 * An unexpected error occurred.
-				 *
-				 * Only report it the first time to avoid spamming
-				 * the logs
-				 *
-				 */
-				if (!nospam) {
-					fprintf (log_get_logfd(),
-						_("%s: Can't get unique UID (%s). "
-						  "Suppressing additional messages.\n"),
-						log_get_progname(), strerror (result));
-					SYSLOG(LOG_ERR,
-						"Error checking available UIDs: %s",
-						strerror(result));
-					nospam = 1;
-				}
-				/*
-				 * We will continue anyway. Hopefully a later UID
-				 * will work properly.
-				 */
-			}
+		if (search_uids (pool, start, count, uid) == 0) {
+			return 0;
 		}
 
 		/*
@@ -453,52 +601,301 @@ int find_new_uid(bool sys_user,
 		 * UID_MIN + 1, all users in the range in use and maintained by
 		 * network services such as LDAP.)
 		 */
-		if (highest_found != uid_min) {
-			for (id = uid_min; id <= uid_max; id++) {
-				result = check_uid (id, uid_min, uid_max, used_uids);
-				if (result == 0) {
-					/* This UID is available. Return it. */
-					*uid = id;
-					free (used_uids);
-					return 0;
-				} else if (result == EEXIST || result == EINVAL) {
-					/*
-					 * This UID is in use or unusable, we'll
-					 * continue to the next.
-					 */
-				} else {
-					/*
-					 * An unexpected error occurred.
-					 *
-					 * Only report it the first time to avoid spamming
-					 * the logs
-					 *
-					 */
-					if (!nospam) {
-						fprintf (log_get_logfd(),
-							_("%s: Can't get unique UID (%s). "
-							  "Suppressing additional messages.\n"),
-							log_get_progname(), strerror (result));
-						SYSLOG(LOG_ERR,
-							"Error checking available UIDs: %s",
-							strerror(result));
-						nospam = 1;
-					}
-					/*
-					 * We will continue anyway. Hopefully a later UID
-					 * will work properly.
-					 */
-				}
-			}
+		if (start != pool->min) {
+			return search_uids (pool, pool->min, count, uid);
 		}
 	}
 
-	/* The code reached here and found no available IDs in the range */
-	fprintf (log_get_logfd(),
-		_("%s: Can't get unique UID (no more available UIDs)\n"),
-		log_get_progname());
-	SYSLOG(LOG_WARN, "no more available UIDs on the system");
-	free (used_uids);
 	return -1;
 }
 
+/*
+ * reserve_uids - Mark count UIDs starting at uid as used in the pool
+ *
+ * The next search then starts beyond them, as it would after a new scan
+ * of the passwd database.
+ *
+ * Return 0 on success, -1 on failure to allocate memory.
+ */
+static int reserve_uids (struct id_pool *pool, uid_t uid, size_t count)
+{
+	size_t k;
+
+	for (k = 0; k < count; k++) {
+		if (idset_insert (&pool->used, uid + k) == -1) {
+			fprinte(log_get_logfd(), _("%s: failed to allocate memory"),
+				log_get_progname());
+			return -1;
+		}
+	}
+	if (uid + (count - 1) >= pool->highest_found) {
+		pool->highest_found = uid + count;
+	}
+	if ((uid <= pool->lowest_found) && (uid >= pool->min)) {
+		pool->lowest_found = uid - 1;
+	}
+
+	uid_hint.sys = pool->sys;
+	uid_hint.min = pool->min;
+	uid_hint.max = pool->max;
+	uid_hint.next = pool->sys ? pool->lowest_found : pool->highest_found;
+	uid_hint_pending = true;
+
+	return 0;
+}
+
+/*
+ * uid_pool_open - Prepare the automatic assignment of several UIDs.
+ *
+ * The local database is scanned once, and the remote databases are
+ * enumerated with ID_NSS_ENUM_ENAB; otherwise, the candidates are looked
+ * up in chunks, whose results are kept in the pool.  The UIDs are then
+ * handed out by uid_pool_get() and uid_pool_get_range(), in the order
+ * in which successive calls to find_new_uid() would select them.
+ *
+ * With ID_HINT_ENAB, the scan is skipped if the passwd database did not
+ * change since the last UID was assigned, and the search resumes from
+ * there.
+ *
+ * The passwd database shall remain locked while the pool is used, and the
+ * UIDs of the entries added without the pool shall be recorded with
+ * uid_pool_add().
+ *
+ * Return the pool on success, NULL on failure.  It shall be freed with
+ * id_pool_free().
+ */
+/*@null@*//*@only@*/struct id_pool *uid_pool_open (bool sys_user)
+{
+	struct id_pool *pool;
+	struct idhint hint;
+	uid_t uid_min, uid_max, preferred_min;
+
+	/*
+	 * First, figure out what ID range is appropriate for
+	 * automatic assignment
+	 */
+	if (get_ranges (sys_user, &uid_min, &uid_max, &preferred_min) == EINVAL) {
+		return NULL;
+	}
+
+	pool = malloc (sizeof (*pool));
+	if (NULL == pool) {
+		fprinte(log_get_logfd(), _("%s: failed to allocate memory"),
+			log_get_progname());
+		return NULL;
+	}
+	pool->used = (struct idset) IDSET_INIT;
+	pool->unused = (struct idset) IDSET_INIT;
+	pool->chunk = 1;
+	pool->min = uid_min;
+	pool->max = uid_max;
+	pool->preferred_min = preferred_min;
+	pool->sys = sys_user;
+	pool->nospam = false;
+	pool->hinted = false;
+
+	if (   getdef_bool ("ID_HINT_ENAB")
+	    && !__pw_get_db ()->changed
+	    && idhint_read ("uid", pw_dbname (), &hint) == 0
+	    && hint.sys == sys_user && hint.min == uid_min && hint.max == uid_max) {
+		/*
+		 * The passwd database did not change since the last UID
+		 * was assigned: resume the search from there, and only
+		 * check the candidates.
+		 */
+		pool->hinted = true;
+		pool->highest_found = hint.next;
+		pool->lowest_found = hint.next;
+		return pool;
+	}
+
+	if (scan_uids (pool) == -1) {
+		id_pool_free (pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+/*
+ * uid_pool_get - Hand out an unused UID from the pool.
+ *
+ * The preferred UID is used if it is available, as with find_new_uid().
+ *
+ * Return 0 on success, -1 if no unused UIDs are available.
+ */
+int uid_pool_get (struct id_pool *pool,
+                  uid_t *uid,
+                  /*@null@*/uid_t const *preferred_uid)
+{
+	int result;
+
+	assert (uid != NULL);
+
+	if (preferred_uid) {
+		result = check_preferred_uid (*preferred_uid,
+		                              pool->preferred_min, pool->max,
+		                              &pool->used);
+		if (result == -1) {
+			return -1;
+		}
+		if (result == 0) {
+			if (reserve_uids (pool, *preferred_uid, 1) == -1) {
+				return -1;
+			}
+			*uid = *preferred_uid;
+			return 0;
+		}
+	}
+
+	return uid_pool_get_range (pool, uid, 1);
+}
+
+/*
+ * uid_pool_get_range - Hand out count consecutive unused UIDs from the
+ * pool.
+ *
+ * Return 0 with the lowest of the UIDs in *uid on success, -1 if not
+ * enough consecutive unused UIDs are available.
+ */
+int uid_pool_get_range (struct id_pool *pool, uid_t *uid, size_t count)
+{
+	assert (uid != NULL);
+	assert (count > 0);
+
+	if (pick_uids (pool, count, uid) == -1) {
+		/* The code reached here and found no available IDs in the range */
+		fprintf (log_get_logfd(),
+			_("%s: Can't get unique UID (no more available UIDs)\n"),
+			log_get_progname());
+		SYSLOG(LOG_WARN, "no more available UIDs on the system");
+		return -1;
+	}
+
+	return reserve_uids (pool, *uid, count);
+}
+
+/*
+ * uid_pool_add - Record a UID which was assigned without the pool.
+ *
+ * The pool then hands out UIDs as if the passwd database had been scanned
+ * again.
+ *
+ * Return 0 on success, -1 on failure to allocate memory.
+ */
+int uid_pool_add (struct id_pool *pool, uid_t uid)
+{
+	if (uid < pool->min || uid > pool->max) {
+		return 0;
+	}
+
+	return reserve_uids (pool, uid, 1);
+}
+
+/*
+ * uid_hint_save - Save where the automatic assignment of UIDs resumes.
+ *
+ * It is called by pw_unlock().  written tells whether the changes of the
+ * passwd database were written; otherwise the UIDs handed out are not used.
+ */
+void uid_hint_save (bool written)
+{
+	if (!uid_hint_pending) {
+		return;
+	}
+	uid_hint_pending = false;
+
+	if (written && getdef_bool ("ID_HINT_ENAB")) {
+		(void) idhint_write ("uid", pw_dbname (), &uid_hint);
+	}
+}
+
+/*
+ * find_new_uid - Find a new unused UID.
+ *
+ * If successful, find_new_uid provides an unused user ID in the
+ * [UID_MIN:UID_MAX] range.
+ * This ID should be higher than all the used UID, but if not possible,
+ * the lowest unused ID in the range will be returned.
+ *
+ * Return 0 on success, -1 if no unused UIDs are available.
+ */
+int find_new_uid(bool sys_user,
+                 uid_t *uid,
+                 /*@null@*/uid_t const *preferred_uid)
+{
+	struct id_pool *pool;
+	uid_t uid_min, uid_max, preferred_min;
+	int result;
+
+	assert (uid != NULL);
+
+	/* Check if the preferred UID is available */
+	if (preferred_uid) {
+		result = get_ranges (sys_user, &uid_min, &uid_max,
+		                     &preferred_min);
+		if (result == EINVAL) {
+			return -1;
+		}
+
+		result = check_preferred_uid (*preferred_uid, preferred_min,
+		                              uid_max, NULL);
+		if (result == 0) {
+			*uid = *preferred_uid;
+			return 0;
+		}
+		if (result == -1) {
+			return -1;
+		}
+	}
+
+	pool = uid_pool_open (sys_user);
+	if (NULL == pool) {
+		return -1;
+	}
+	result = uid_pool_get_range (pool, uid, 1);
+	id_pool_free (pool);
+
+	return result;
+}
+
+/*
+ * find_new_uids - Find n new unused UIDs.
+ *
+ * The UIDs are selected after a single scan of the databases, as n
+ * successive calls to find_new_uid() would select them.  If contiguous
+ * is true, they are consecutive, and stored in ascending order.
+ *
+ * Return 0 on success, -1 if not enough unused UIDs are available.
+ */
+int find_new_uids (bool sys_user, uid_t *uids, size_t n, bool contiguous)
+{
+	struct id_pool *pool;
+	size_t i;
+	int result = 0;
+
+	assert (uids != NULL);
+
+	if (n == 0) {
+		return 0;
+	}
+
+	pool = uid_pool_open (sys_user);
+	if (NULL == pool) {
+		return -1;
+	}
+	if (contiguous) {
+		result = uid_pool_get_range (pool, &uids[0], n);
+		for (i = 1; i < n && result == 0; i++) {
+			uids[i] = uids[0] + i;
+		}
+	} else {
+		for (i = 0; i < n && result == 0; i++) {
+			result = uid_pool_get_range (pool, &uids[i], 1);
+		}
+	}
+	id_pool_free (pool);
+
+	return result;
+}
+
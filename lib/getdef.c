@@ -89,6 +89,7 @@ static struct itemdef def_table[] = {
 	{"CONSOLE_GROUPS", NULL},
 	{"CONSOLE", NULL},
 	{"CREATE_HOME", NULL},
+	{"CRYPT_THREADS", NULL},
 	{"DEFAULT_HOME", NULL},
 	{"ENCRYPT_METHOD", NULL},
 	{"ENV_PATH", NULL},
@@ -100,8 +101,11 @@ static struct itemdef def_table[] = {
 	{"GID_MIN", NULL},
 	{"HOME_MODE", NULL},
 	{"HUSHLOGIN_FILE", NULL},
+	{"ID_HINT_ENAB", NULL},
+	{"ID_NSS_ENUM_ENAB", NULL},
 	{"KILLCHAR", NULL},
 	{"LASTLOG_UID_MAX", NULL},
+	{"LOCK_TIMEOUT", NULL},
 	{"LOGIN_RETRIES", NULL},
 	{"LOGIN_TIMEOUT", NULL},
 	{"LOG_OK_LOGINS", NULL},
@@ -147,6 +151,7 @@ static struct itemdef def_table[] = {
 	{"UNSAFE_SUB_GID_DETERMINISTIC_WRAP", NULL},
 	{"UNSAFE_SUB_UID_DETERMINISTIC_WRAP", NULL},
 	{"USERDEL_CMD", NULL},
+	{"USERDEL_DEFER_REMOVE", NULL},
 	{"USERGROUPS_ENAB", NULL},
 #ifndef USE_PAM
 	PAMDEFS
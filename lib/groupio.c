@@ -56,6 +56,13 @@ static const char *group_getname (const void *ent)
 	return gr->gr_name;
 }
 
+static id_t group_getid (const void *ent)
+{
+	const struct group *gr = ent;
+
+	return gr->gr_gid;
+}
+
 static void *group_parse (const char *line)
 {
 	return sgetgrent (line);
@@ -103,7 +110,8 @@ static struct commonio_ops group_ops = {
 	group_parse,
 	group_put,
 	group_open_hook,
-	group_close_hook
+	group_close_hook,
+	group_getid
 };
 
 static /*@owned@*/struct commonio_db group_db = {
@@ -123,7 +131,22 @@ static /*@owned@*/struct commonio_db group_db = {
 	false,			/* isopen */
 	false,			/* locked */
 	false,			/* readonly */
-	false			/* setname */
+	false,			/* setname */
+	false,			/* committed */
+	NULL,			/* name_index */
+	0,			/* name_index_size */
+	0,			/* name_index_count */
+	NULL,			/* id_index */
+	0,			/* id_index_size */
+	0,			/* id_index_count */
+	NULL,			/* slab_text */
+	0,			/* slab_text_size */
+	false,			/* slab_text_mapped */
+	NULL,			/* slab_entries */
+	0,			/* slab_entries_count */
+	0,			/* lock_time */
+	0,			/* lock_wait */
+	0			/* lock_holder */
 };
 
 int gr_setdbname (const char *filename)
@@ -153,14 +176,7 @@ int gr_open (int mode)
 
 /*@observer@*/ /*@null@*/const struct group *gr_locate_gid (gid_t gid)
 {
-	const struct group *grp;
-
-	gr_rewind ();
-	while (   ((grp = gr_next ()) != NULL)
-	       && (grp->gr_gid != gid)) {
-	}
-
-	return grp;
+	return commonio_locate_id (&group_db, gid);
 }
 
 int gr_update (const struct group *gr)
@@ -190,6 +206,7 @@ int gr_close (bool process_selinux)
 
 int gr_unlock (bool process_selinux)
 {
+	gid_hint_save (group_db.committed);
 	return commonio_unlock (&group_db, process_selinux);
 }
 
@@ -200,10 +217,13 @@ void __gr_set_changed (void)
 
 /*@dependent@*/ /*@null@*/struct commonio_entry *__gr_get_head (void)
 {
-	return group_db.head;
+	if (commonio_split_lines (&group_db) != 0) {
+		return NULL;
+	}
+	return commonio_get_head (&group_db);
 }
 
-/*@observer@*/const struct commonio_db *__gr_get_db (void)
+struct commonio_db *__gr_get_db (void)
 {
 	return &group_db;
 }
@@ -253,13 +273,23 @@ int gr_sort ()
 static int group_open_hook (void)
 {
 	unsigned int max_members = getdef_unum("MAX_MEMBERS_PER_GROUP", 0);
-	struct commonio_entry *gr1, *gr2;
+	struct commonio_entry *head, *gr1, *gr2;
 
 	if (0 == max_members) {
 		return 1;
 	}
 
-	for (gr1 = group_db.head; NULL != gr1; gr1 = gr1->next) {
+	/* merge_group_entries() concatenates the lines */
+	if (commonio_split_lines (&group_db) != 0) {
+		return 0;
+	}
+
+	head = commonio_get_head (&group_db);
+	if ((NULL == head) && (NULL != group_db.head)) {
+		return 0;
+	}
+
+	for (gr1 = head; NULL != gr1; gr1 = gr1->next) {
 		for (gr2 = gr1->next; NULL != gr2; gr2 = gr2->next) {
 			struct group *g1 = gr1->eptr;
 			struct group *g2 = gr2->eptr;
@@ -0,0 +1,180 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "idhint.h"
+#include "prototypes.h"
+#include "string/sprintf/aprintf.h"
+#include "string/sprintf/stprintf.h"
+
+
+#define IDHINT_VERSION  1
+
+
+static const char  *idhint_dir = IDHINT_DIR;
+
+
+/*
+ * The identity of a database file.  The tools replace the file on every
+ * change, and other editors at least update its size or time stamp.
+ */
+struct dbstamp {
+	uintmax_t  dev, ino, size;
+	intmax_t   sec;
+	long       nsec;
+};
+
+
+static int
+dbstamp(const char *dbfile, struct dbstamp *st)
+{
+	struct stat  sb;
+
+	if (stat(dbfile, &sb) == -1)
+		return -1;
+
+	st->dev = sb.st_dev;
+	st->ino = sb.st_ino;
+	st->size = sb.st_size;
+	st->sec = sb.st_mtim.tv_sec;
+	st->nsec = sb.st_mtim.tv_nsec;
+	return 0;
+}
+
+
+/*
+ * idhint_setdir - Keep the hints in dir instead of IDHINT_DIR.
+ */
+void
+idhint_setdir(const char *dir)
+{
+	idhint_dir = dir;
+}
+
+
+/*
+ * idhint_read - Read the hint saved for the database file dbfile.
+ *
+ *	It returns 0 on success, and -1 if there is no valid hint, or if
+ *	dbfile changed since the hint was saved.
+ */
+int
+idhint_read(const char *name, const char *dbfile, struct idhint *hint)
+{
+	int             version, sys, n = -1;
+	char            buf[256];
+	FILE            *fp;
+	char            *path;
+	uintmax_t       min, max, next;
+	struct dbstamp  cur, st;
+
+	path = aprintf("%s/%s.hint", idhint_dir, name);
+	if (NULL == path)
+		return -1;
+	fp = fopen(path, "r");
+	free(path);
+	if (NULL == fp)
+		return -1;
+	if (fgets(buf, sizeof(buf), fp) == NULL) {
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+
+	if (sscanf(buf, "v%d %d %ju %ju %ju %ju %ju %ju %jd %ld\n%n",
+	           &version, &sys, &min, &max, &next,
+	           &st.dev, &st.ino, &st.size, &st.sec, &st.nsec, &n) != 10
+	    || n == -1 || buf[n] != '\0' || version != IDHINT_VERSION)
+	{
+		return -1;
+	}
+	if (min > max || next > (uintmax_t) max + 1 || max > (id_t) -1)
+		return -1;
+
+	if (dbstamp(dbfile, &cur) == -1)
+		return -1;
+	if (   cur.dev != st.dev || cur.ino != st.ino || cur.size != st.size
+	    || cur.sec != st.sec || cur.nsec != st.nsec)
+	{
+		return -1;
+	}
+
+	hint->sys = sys;
+	hint->min = min;
+	hint->max = max;
+	hint->next = next;
+	return 0;
+}
+
+
+/*
+ * idhint_write - Save the hint for the database file dbfile.
+ *
+ *	It shall be called with the database locked, after its changes
+ *	are written.  It returns 0 on success, -1 on failure.
+ */
+int
+idhint_write(const char *name, const char *dbfile, const struct idhint *hint)
+{
+	int             fd, len;
+	char            buf[256];
+	char            *path, *tmp;
+	struct dbstamp  st;
+
+	if (dbstamp(dbfile, &st) == -1)
+		return -1;
+
+	len = stprintf_a(buf, "v%d %d %ju %ju %ju %ju %ju %ju %jd %ld\n",
+	                 IDHINT_VERSION, hint->sys, (uintmax_t) hint->min,
+	                 (uintmax_t) hint->max, (uintmax_t) hint->next,
+	                 st.dev, st.ino, st.size, st.sec, st.nsec);
+	if (len == -1)
+		return -1;
+
+	if (mkdir(idhint_dir, 0700) == -1 && errno != EEXIST)
+		return -1;
+
+	path = aprintf("%s/%s.hint", idhint_dir, name);
+	if (NULL == path)
+		return -1;
+	tmp = aprintf("%s+", path);
+	if (NULL == tmp)
+		goto fail_path;
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC,
+	          0600);
+	if (fd == -1)
+		goto fail_tmp;
+	if (write_full(fd, buf, len) == -1) {
+		close(fd);
+		goto fail_unlink;
+	}
+	if (close(fd) == -1)
+		goto fail_unlink;
+	if (rename(tmp, path) == -1)
+		goto fail_unlink;
+
+	free(tmp);
+	free(path);
+	return 0;
+
+fail_unlink:
+	unlink(tmp);
+fail_tmp:
+	free(tmp);
+fail_path:
+	free(path);
+	return -1;
+}
@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+
+#ifndef SHADOW_INCLUDE_LIB_IDHINT_H_
+#define SHADOW_INCLUDE_LIB_IDHINT_H_
+
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+
+#define IDHINT_DIR  "/var/lib/shadow"
+
+
+/*
+ * Where the automatic assignment of IDs resumes in a range.  It is
+ * saved with the identity of the database file it was computed from,
+ * and only trusted while that file is not replaced or modified.
+ */
+struct idhint {
+	bool  sys;		/* range of system accounts */
+	id_t  min, max;		/* bounds of the range */
+	id_t  next;		/* first ID to try */
+};
+
+
+void idhint_setdir(const char *dir);
+int idhint_read(const char *name, const char *dbfile, struct idhint *hint);
+int idhint_write(const char *name, const char *dbfile,
+    const struct idhint *hint);
+
+
+#endif  // include guard
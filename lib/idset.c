@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "alloc/realloc.h"
+#include "alloc/reallocf.h"
+#include "idset.h"
+#include "search/sort/qsort.h"
+
+
+/*
+ * lower_bound - Index of the first ID of the sorted set which is not
+ * lower than id, or set->n.
+ */
+static size_t
+lower_bound(const struct idset *set, id_t id)
+{
+	size_t  lo, hi, mid;
+
+	lo = 0;
+	hi = set->n;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (set->ids[mid] < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+/*
+ * idset_add - Append id to the set.
+ *
+ *	The set has to be sorted again before it is searched.
+ *	It returns 0 on success, -1 on failure to allocate memory.
+ */
+int
+idset_add(struct idset *set, id_t id)
+{
+	if (set->n == set->size) {
+		set->size = (0 == set->size) ? 64 : set->size * 2;
+		set->ids = reallocf_T(set->ids, set->size, id_t);
+		if (NULL == set->ids) {
+			set->n = 0;
+			set->size = 0;
+			return -1;
+		}
+	}
+	set->ids[set->n++] = id;
+	return 0;
+}
+
+
+/*
+ * idset_insert - Insert id into the sorted set, keeping it sorted.
+ *
+ *	It returns 0 on success, -1 on failure to allocate memory.  The
+ *	set is not changed on failure.
+ */
+int
+idset_insert(struct idset *set, id_t id)
+{
+	id_t    *ids;
+	size_t  i, size;
+
+	i = lower_bound(set, id);
+	if (i < set->n && set->ids[i] == id)
+		return 0;
+
+	if (set->n == set->size) {
+		size = (0 == set->size) ? 64 : set->size * 2;
+		ids = realloc_T(set->ids, size, id_t);
+		if (NULL == ids)
+			return -1;
+		set->ids = ids;
+		set->size = size;
+	}
+	memmove(&set->ids[i + 1], &set->ids[i], (set->n - i) * sizeof(id_t));
+	set->ids[i] = id;
+	set->n++;
+	return 0;
+}
+
+
+/*
+ * idset_sort - Sort the set, and remove duplicated IDs.
+ */
+void
+idset_sort(struct idset *set)
+{
+	size_t  i, j;
+
+	if (0 == set->n)
+		return;
+
+	QSORT(id_t, set->ids, set->n);
+
+	for (i = 0, j = 1; j < set->n; j++) {
+		if (set->ids[j] != set->ids[i])
+			set->ids[++i] = set->ids[j];
+	}
+	set->n = i + 1;
+}
+
+
+/*
+ * idset_has - Whether id is in the sorted set.
+ */
+bool
+idset_has(const struct idset *set, id_t id)
+{
+	size_t  i;
+
+	i = lower_bound(set, id);
+	return (i < set->n) && (set->ids[i] == id);
+}
+
+
+/*
+ * idset_next_free - Find the lowest ID not lower than *id which is not
+ * in the sorted set.
+ *
+ *	It returns false if there is none up to max.  Otherwise, the ID is
+ *	stored in *id.
+ */
+bool
+idset_next_free(const struct idset *set, id_t *id, id_t max)
+{
+	size_t  i;
+
+	if (*id > max)
+		return false;
+
+	for (i = lower_bound(set, *id); i < set->n && set->ids[i] == *id; i++) {
+		if (*id == max)
+			return false;
+		(*id)++;
+	}
+	return true;
+}
+
+
+/*
+ * idset_prev_free - Find the highest ID not higher than *id which is
+ * not in the sorted set.
+ *
+ *	It returns false if there is none down to min.  Otherwise, the ID
+ *	is stored in *id.
+ */
+bool
+idset_prev_free(const struct idset *set, id_t *id, id_t min)
+{
+	size_t  i;
+
+	if (*id < min)
+		return false;
+
+	i = lower_bound(set, *id);
+	if (i == set->n || set->ids[i] != *id)
+		return true;
+
+	for (;;) {
+		if (*id == min)
+			return false;
+		(*id)--;
+		if (i == 0 || set->ids[--i] != *id)
+			return true;
+	}
+}
+
+
+void
+idset_free(struct idset *set)
+{
+	free(set->ids);
+	set->ids = NULL;
+	set->n = 0;
+	set->size = 0;
+}
+
+
+void
+id_pool_free(struct id_pool *pool)
+{
+	if (NULL == pool)
+		return;
+
+	idset_free(&pool->used);
+	idset_free(&pool->unused);
+	free(pool);
+}
@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+
+#ifndef SHADOW_INCLUDE_LIB_IDSET_H_
+#define SHADOW_INCLUDE_LIB_IDSET_H_
+
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+
+/*
+ * A set of IDs, kept as a vector.  IDs are appended with idset_add(),
+ * and then idset_sort() sorts them and removes duplicates, after which
+ * the set can be searched.  idset_insert() adds an ID to a sorted set.
+ * Its size depends on the number of IDs in it, not on their range.
+ */
+struct idset {
+	/*@only@*/ /*@null@*/id_t  *ids;
+	size_t                     n;
+	size_t                     size;	/* allocated elements */
+};
+
+#define IDSET_INIT  {NULL, 0, 0}
+
+/* Maximum number of candidate IDs looked up at once with NSS */
+#define ID_PROBE_CHUNK  16
+
+/*
+ * The state of the automatic assignment of IDs, kept between the IDs
+ * handed out after a single scan of the databases.  See uid_pool_open()
+ * and gid_pool_open().
+ */
+struct id_pool {
+	struct idset  used;	/* IDs in use, or already handed out */
+	struct idset  unused;	/* IDs which NSS did not know */
+	size_t        chunk;	/* IDs looked up at once with NSS */
+	id_t          min, max;	/* range of the automatic assignment */
+	id_t          preferred_min;
+	id_t          lowest_found, highest_found;
+	bool          sys;
+	bool          nospam;
+	bool          hinted;	/* resumed from a hint, without a scan */
+};
+
+
+int idset_add(struct idset *set, id_t id);
+int idset_insert(struct idset *set, id_t id);
+void idset_sort(struct idset *set);
+bool idset_has(const struct idset *set, id_t id);
+bool idset_next_free(const struct idset *set, id_t *id, id_t max);
+bool idset_prev_free(const struct idset *set, id_t *id, id_t min);
+void idset_free(struct idset *set);
+void id_pool_free(/*@only@*/ /*@null@*/struct id_pool *pool);
+
+
+#endif  // include guard
@@ -21,47 +21,20 @@
  */
 int lckpwdf (void)
 {
-	int i;
-
-	/*
-	 * We have 15 seconds to lock the whole mess
-	 */
-
-	for (i = 0; i < 15; i++)
-		if (pw_lock ())
-			break;
-		else
-			sleep (1);
-
 	/*
-	 * Did we run out of time?
+	 * pw_lock() and spw_lock() wait for the files to be released, up
+	 * to LOCK_TIMEOUT each.
 	 */
-
-	if (i == 15)
+	if (pw_lock () == 0) {
 		return -1;
-
-	/*
-	 * Nope, use any remaining time to lock the shadow password
-	 * file.
-	 */
-
-	for (; i < 15; i++)
-		if (spw_lock ())
-			break;
-		else
-			sleep (1);
-
-	/*
-	 * Out of time yet?
-	 */
-
-	if (i == 15) {
+	}
+	if (spw_lock () == 0) {
 		pw_unlock (true);
 		return -1;
 	}
 
 	/*
-	 * Nope - and both files are now locked.
+	 * Both files are now locked.
 	 */
 
 	return 0;
@@ -16,6 +16,7 @@
 /*@-exitarg@*/
 #include "exitcodes.h"
 #include "groupio.h"
+#include "idhint.h"
 #include "io/fprintf.h"
 #include "pwio.h"
 #ifdef	SHADOWGRP
@@ -39,6 +40,7 @@ static char *group_db_file = NULL;
 static char *sgroup_db_file = NULL;
 static char *suid_db_file = NULL;
 static char *sgid_db_file = NULL;
+static char *idhint_dir = NULL;
 MAYBE_UNUSED static char *def_conf_file = NULL;
 static FILE* fp_pwent = NULL;
 static FILE* fp_grent = NULL;
@@ -129,6 +131,9 @@ extern const char* process_prefix_flag (const char* short_opt, int argc, char **
 		sub_gid_setdbname(sgid_db_file);
 #endif
 
+		idhint_dir = xaprintf("%s/%s", prefix, IDHINT_DIR);
+		idhint_setdir(idhint_dir);
+
 #ifdef USE_ECONF
 		setdef_config_file(prefix);
 #else
@@ -267,6 +272,18 @@ extern struct spwd *prefix_getspnam(const char* name)
 	}
 }
 
+/*
+ * prefix_is_set - Whether --prefix was given.
+ *
+ * The prefix_get* functions then read the files of the prefix with
+ * fgetpwent() and fgetgrent(), and must not be called by several
+ * threads at once.
+ */
+extern bool prefix_is_set(void)
+{
+	return NULL != passwd_db_file;
+}
+
 extern void prefix_setpwent(void)
 {
 	if (!passwd_db_file) {
@@ -319,6 +336,9 @@ extern struct group* prefix_getgrent(void)
 	if (!group_db_file) {
 		return getgrent();
 	}
+	if (!fp_grent) {
+		return NULL;
+	}
 	return fgetgrent(fp_grent);
 }
 extern void prefix_endgrent(void)
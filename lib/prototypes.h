@@ -27,6 +27,7 @@
 #include <pwd.h>
 #include <grp.h>
 #include <shadow.h>
+#include <stdint.h>
 #ifdef ENABLE_LASTLOG
 #include <lastlog.h>
 #endif /* ENABLE_LASTLOG */
@@ -34,6 +35,7 @@
 #include "attr.h"
 #include "defines.h"
 #include "commonio.h"
+#include "idset.h"
 #include "shadow/gshadow/sgrp.h"
 
 
@@ -102,7 +104,43 @@ extern int copy_tree (const char *src_root, const char *dst_root,
                       gid_t old_gid, gid_t new_gid);
 
 /* encrypt.c */
+struct pw_crypt {
+	/*@null@*/const char  *clear;
+	/*@null@*/const char  *salt;
+	/*@only@*//*@null@*/char *hash;
+};
 extern /*@exposed@*//*@null@*/char *pw_encrypt (const char *, const char *);
+extern void pw_encrypt_all (struct pw_crypt *pc, size_t n);
+
+/*
+ * The input of chpasswd, chgpasswd, and newusers is read by chunks of
+ * PW_CHUNK_LINES lines, and the passwords of a chunk are encrypted in
+ * parallel before the lines are processed.
+ */
+#define PW_CHUNK_LINES 1024
+struct pw_line {
+	intmax_t  line;
+	/*@only@*//*@null@*/char *buf;	/* NULL if the line is too long */
+	/*@only@*//*@null@*/char *hash;	/* NULL if not encrypted in advance */
+};
+struct pw_input {
+	/* Set by the caller */
+	bool      encrypt;	/* encrypt the passwords in advance */
+	bool      drain;	/* drop the rest of the lines too long */
+	bool      field;	/* the password is the second field only */
+	intmax_t  skip;		/* lines committed by a previous run */
+	/*@null@*/const char *salt;	/* salt of all the passwords, or */
+	/*@null@*/const char *crypt_method;	/* a new salt for each */
+	/*@null@*/void *crypt_arg;
+
+	/* Private */
+	intmax_t  line;
+	size_t    n;
+	size_t    i;
+	struct pw_line   lines[PW_CHUNK_LINES];
+	struct pw_crypt  pc[PW_CHUNK_LINES];
+};
+extern /*@null@*/struct pw_line *pw_input_next (struct pw_input *in);
 
 /* env.c */
 extern void addenv (const char *, /*@null@*/const char *);
@@ -117,11 +155,31 @@ extern void check_fds (void);
 extern int find_new_gid (bool sys_group,
                          gid_t *gid,
                          /*@null@*/gid_t const *preferred_gid);
+extern int find_new_gids (bool sys_group, gid_t *gids, size_t n,
+                          bool contiguous);
+extern /*@null@*//*@only@*/struct id_pool *gid_pool_open (bool sys_group);
+extern int gid_pool_get (struct id_pool *pool,
+                         gid_t *gid,
+                         /*@null@*/gid_t const *preferred_gid);
+extern int gid_pool_get_range (struct id_pool *pool, gid_t *gid,
+                               size_t count);
+extern int gid_pool_add (struct id_pool *pool, gid_t gid);
+extern void gid_hint_save (bool written);
 
 /* find_new_uid.c */
 extern int find_new_uid (bool sys_user,
                          uid_t *uid,
                          /*@null@*/uid_t const *preferred_uid);
+extern int find_new_uids (bool sys_user, uid_t *uids, size_t n,
+                          bool contiguous);
+extern /*@null@*//*@only@*/struct id_pool *uid_pool_open (bool sys_user);
+extern int uid_pool_get (struct id_pool *pool,
+                         uid_t *uid,
+                         /*@null@*/uid_t const *preferred_uid);
+extern int uid_pool_get_range (struct id_pool *pool, uid_t *uid,
+                               size_t count);
+extern int uid_pool_add (struct id_pool *pool, uid_t uid);
+extern void uid_hint_save (bool written);
 
 #ifdef ENABLE_SUBIDS
 /* find_new_sub_gids.c */
@@ -148,7 +206,7 @@ extern time_t gettime (void);
 
 /* groupio.c */
 extern void __gr_del_entry (const struct commonio_entry *ent);
-extern /*@observer@*/const struct commonio_db *__gr_get_db (void);
+extern struct commonio_db *__gr_get_db (void);
 extern /*@dependent@*/ /*@null@*/struct commonio_entry *__gr_get_head (void);
 extern void __gr_set_changed (void);
 
@@ -305,6 +363,7 @@ extern bool isttytime (const char *, const char *, time_t);
 
 /* prefix_flag.c */
 extern const char* process_prefix_flag (const char* short_opt, int argc, char **argv);
+extern bool prefix_is_set(void);
 extern struct group *prefix_getgrnam(const char *name);
 extern struct group *prefix_getgrgid(gid_t gid);
 extern struct passwd *prefix_getpwuid(uid_t uid);
@@ -387,6 +446,7 @@ extern void setup_env (struct passwd *);
 
 /* sgroupio.c */
 extern void __sgr_del_entry (const struct commonio_entry *ent);
+extern struct commonio_db *__sgr_get_db (void);
 extern /*@null@*/ /*@only@*/struct sgrp *__sgr_dup (const struct sgrp *sgent);
 extern void sgr_free(/*@only@*/struct sgrp *sgent);
 extern /*@dependent@*/ /*@null@*/struct commonio_entry *__sgr_get_head (void);
@@ -395,6 +455,7 @@ extern void __sgr_set_changed (void);
 /* shadowio.c */
 extern /*@dependent@*/ /*@null@*/struct commonio_entry *__spw_get_head (void);
 extern void __spw_del_entry (const struct commonio_entry *ent);
+extern struct commonio_db *__spw_get_db (void);
 
 /* shadowmem.c */
 extern /*@null@*/ /*@only@*/struct spwd *__spw_dup (const struct spwd *spent);
@@ -43,6 +43,13 @@ static const char *passwd_getname (const void *ent)
 	return pw->pw_name;
 }
 
+static id_t passwd_getid (const void *ent)
+{
+	const struct passwd *pw = ent;
+
+	return pw->pw_uid;
+}
+
 static void *passwd_parse (const char *line)
 {
 	return sgetpwent (line);
@@ -76,7 +83,8 @@ static struct commonio_ops passwd_ops = {
 	passwd_parse,
 	passwd_put,
 	NULL,			/* open_hook */
-	NULL			/* close_hook */
+	NULL,			/* close_hook */
+	passwd_getid
 };
 
 static struct commonio_db passwd_db = {
@@ -96,7 +104,22 @@ static struct commonio_db passwd_db = {
 	false,			/* isopen */
 	false,			/* locked */
 	false,			/* readonly */
-	false			/* setname */
+	false,			/* setname */
+	false,			/* committed */
+	NULL,			/* name_index */
+	0,			/* name_index_size */
+	0,			/* name_index_count */
+	NULL,			/* id_index */
+	0,			/* id_index_size */
+	0,			/* id_index_count */
+	NULL,			/* slab_text */
+	0,			/* slab_text_size */
+	false,			/* slab_text_mapped */
+	NULL,			/* slab_entries */
+	0,			/* slab_entries_count */
+	0,			/* lock_time */
+	0,			/* lock_wait */
+	0			/* lock_holder */
 };
 
 int pw_setdbname (const char *filename)
@@ -126,14 +149,7 @@ int pw_open (int mode)
 
 /*@observer@*/ /*@null@*/const struct passwd *pw_locate_uid (uid_t uid)
 {
-	const struct passwd *pwd;
-
-	pw_rewind ();
-	while (   ((pwd = pw_next ()) != NULL)
-	       && (pwd->pw_uid != uid)) {
-	}
-
-	return pwd;
+	return commonio_locate_id (&passwd_db, uid);
 }
 
 int pw_update (const struct passwd *pw)
@@ -163,12 +179,16 @@ int pw_close (bool process_selinux)
 
 int pw_unlock (bool process_selinux)
 {
+	uid_hint_save (passwd_db.committed);
 	return commonio_unlock (&passwd_db, process_selinux);
 }
 
 /*@null@*/struct commonio_entry *__pw_get_head (void)
 {
-	return passwd_db.head;
+	if (commonio_split_lines (&passwd_db) != 0) {
+		return NULL;
+	}
+	return commonio_get_head (&passwd_db);
 }
 
 void __pw_del_entry (const struct commonio_entry *ent)
@@ -0,0 +1,402 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc/realloc.h"
+#include "rangeset.h"
+#include "search/sort/qsort.h"
+
+
+static int
+slot_cmp(const void *p1, const void *p2)
+{
+	const struct rangeset_slot  *s1 = p1;
+	const struct rangeset_slot  *s2 = p2;
+
+	if (s1->first != s2->first)
+		return (s1->first < s2->first) ? -1 : 1;
+	if (s1->last != s2->last)
+		return (s1->last < s2->last) ? -1 : 1;
+	return 0;
+}
+
+
+/*
+ * grow - Make room for one more range.
+ *
+ *	There are never more spans than ranges, so both vectors are grown
+ *	together, and the spans can be rebuilt without allocating memory.
+ *	It returns 0 on success, -1 on failure to allocate memory.  The
+ *	set is not changed on failure.
+ */
+static int
+grow(struct rangeset *set)
+{
+	size_t                size;
+	struct rangeset_slot  *slots;
+	struct rangeset_span  *spans;
+
+	if (set->n < set->size)
+		return 0;
+
+	size = (0 == set->size) ? 64 : set->size * 2;
+	slots = realloc_T(set->slots, size, struct rangeset_slot);
+	if (NULL == slots)
+		return -1;
+	set->slots = slots;
+
+	spans = realloc_T(set->spans, size, struct rangeset_span);
+	if (NULL == spans)
+		return -1;
+	set->spans = spans;
+
+	set->size = size;
+	return 0;
+}
+
+
+/*
+ * adjacent - Whether an interval ending at last and one starting at
+ * first have no hole between them.
+ */
+static bool
+adjacent(unsigned long last, unsigned long first)
+{
+	return (0 == first) || (first - 1 <= last);
+}
+
+
+/*
+ * update_reach - Compute the reach of the ranges from the i-th one.
+ *
+ *	The ranges before the i-th one must be up to date.  After the
+ *	i-th one, it stops at the first range whose reach did not change.
+ */
+static void
+update_reach(struct rangeset *set, size_t i)
+{
+	size_t         start;
+	unsigned long  reach;
+
+	for (start = i; i < set->n; i++) {
+		reach = set->slots[i].last;
+		if (i > 0 && set->slots[i - 1].reach > reach)
+			reach = set->slots[i - 1].reach;
+		if (i > start && set->slots[i].reach == reach)
+			break;
+		set->slots[i].reach = reach;
+	}
+}
+
+
+static void
+build_spans(struct rangeset *set)
+{
+	size_t                      i;
+	struct rangeset_span        *span;
+	const struct rangeset_slot  *slot;
+
+	set->nspans = 0;
+	for (i = 0; i < set->n; i++) {
+		slot = &set->slots[i];
+		if (set->nspans > 0) {
+			span = &set->spans[set->nspans - 1];
+			if (adjacent(span->last, slot->first)) {
+				if (span->last < slot->last)
+					span->last = slot->last;
+				continue;
+			}
+		}
+		span = &set->spans[set->nspans++];
+		span->first = slot->first;
+		span->last = slot->last;
+	}
+}
+
+
+/*
+ * insert_span - Add [first, last] to the union of the ranges.
+ */
+static void
+insert_span(struct rangeset *set, unsigned long first, unsigned long last)
+{
+	size_t                a, b, lo, hi, mid;
+	struct rangeset_span  *spans = set->spans;
+
+	/* a: the first span which is not entirely before first */
+	lo = 0;
+	hi = set->nspans;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (!adjacent(spans[mid].last, first))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	a = lo;
+
+	/* b: the first span which is entirely after last */
+	hi = set->nspans;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (adjacent(last, spans[mid].first))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	b = lo;
+
+	if (a == b) {
+		memmove(&spans[a + 1], &spans[a],
+		        (set->nspans - a) * sizeof(spans[0]));
+		set->nspans++;
+	} else {
+		if (spans[a].first < first)
+			first = spans[a].first;
+		if (spans[b - 1].last > last)
+			last = spans[b - 1].last;
+		memmove(&spans[a + 1], &spans[b],
+		        (set->nspans - b) * sizeof(spans[0]));
+		set->nspans -= b - a - 1;
+	}
+	spans[a].first = first;
+	spans[a].last = last;
+}
+
+
+/*
+ * rangeset_add - Append the range of count IDs from first to the set.
+ *
+ *	The set has to be sorted again before it is searched.
+ *	It returns 0 on success, -1 on failure to allocate memory.
+ */
+int
+rangeset_add(struct rangeset *set, unsigned long first, unsigned long count,
+             void *data)
+{
+	struct rangeset_slot  *slot;
+
+	if (grow(set) == -1)
+		return -1;
+
+	slot = &set->slots[set->n++];
+	slot->first = first;
+	slot->last = first + count - 1;
+	slot->reach = slot->last;
+	slot->data = data;
+	return 0;
+}
+
+
+/*
+ * rangeset_sort - Sort the set, so that it can be searched.
+ */
+void
+rangeset_sort(struct rangeset *set)
+{
+	size_t  i;
+
+	if (0 == set->n) {
+		set->nspans = 0;
+		return;
+	}
+
+	qsort_T(struct rangeset_slot, set->slots, set->n, slot_cmp);
+
+	set->slots[0].reach = set->slots[0].last;
+	for (i = 1; i < set->n; i++) {
+		set->slots[i].reach = set->slots[i].last;
+		if (set->slots[i - 1].reach > set->slots[i].reach)
+			set->slots[i].reach = set->slots[i - 1].reach;
+	}
+	build_spans(set);
+}
+
+
+/*
+ * rangeset_insert - Insert the range of count IDs from first into the
+ * sorted set, keeping it sorted.
+ *
+ *	It returns 0 on success, -1 on failure to allocate memory.  The
+ *	set is not changed on failure.
+ */
+int
+rangeset_insert(struct rangeset *set, unsigned long first,
+                unsigned long count, void *data)
+{
+	size_t                i;
+	struct rangeset_slot  slot;
+
+	if (grow(set) == -1)
+		return -1;
+
+	slot.first = first;
+	slot.last = first + count - 1;
+	slot.reach = slot.last;
+	slot.data = data;
+
+	i = rangeset_upto(set, first);
+	while (i > 0 && slot_cmp(&set->slots[i - 1], &slot) > 0)
+		i--;
+	memmove(&set->slots[i + 1], &set->slots[i],
+	        (set->n - i) * sizeof(set->slots[0]));
+	set->slots[i] = slot;
+	set->n++;
+
+	update_reach(set, i);
+	insert_span(set, slot.first, slot.last);
+	return 0;
+}
+
+
+/*
+ * rangeset_remove - Remove the range starting at first which was added
+ * with data from the sorted set.
+ *
+ *	It returns 0 on success, -1 if there is no such range.
+ */
+int
+rangeset_remove(struct rangeset *set, unsigned long first, const void *data)
+{
+	size_t  i;
+
+	for (i = rangeset_upto(set, first); i > 0; i--) {
+		if (set->slots[i - 1].first != first)
+			return -1;
+		if (set->slots[i - 1].data == data)
+			break;
+	}
+	if (0 == i)
+		return -1;
+	i--;
+
+	memmove(&set->slots[i], &set->slots[i + 1],
+	        (set->n - i - 1) * sizeof(set->slots[0]));
+	set->n--;
+
+	update_reach(set, i);
+	build_spans(set);
+	return 0;
+}
+
+
+/*
+ * rangeset_upto - Number of ranges of the sorted set which start at or
+ * before id.
+ */
+size_t
+rangeset_upto(const struct rangeset *set, unsigned long id)
+{
+	size_t  lo, hi, mid;
+
+	lo = 0;
+	hi = set->n;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (set->slots[mid].first <= id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+/*
+ * rangeset_prev_overlap - Walk back the ranges which end at or after
+ * first.
+ *
+ *	*pos has to be initialized with rangeset_upto() of the last ID of
+ *	interest, so that only the ranges which overlap [first, last] are
+ *	returned, from the one which starts last.  It returns the data of
+ *	the next range, or NULL when there are no more.
+ */
+/*@null@*/void *
+rangeset_prev_overlap(const struct rangeset *set, unsigned long first,
+                      size_t *pos)
+{
+	const struct rangeset_slot  *slot;
+
+	while (*pos > 0) {
+		slot = &set->slots[--*pos];
+		if (slot->reach < first) {
+			*pos = 0;
+			break;
+		}
+		if (slot->last >= first)
+			return slot->data;
+	}
+	return NULL;
+}
+
+
+/*
+ * rangeset_find_free - Find the lowest count consecutive IDs between
+ * min and max which are not in any range of the sorted set.
+ *
+ *	It returns false if there are none.  Otherwise, the first ID is
+ *	stored in *start.  Only the holes after min are looked at.
+ */
+bool
+rangeset_find_free(const struct rangeset *set, unsigned long min,
+                   unsigned long max, unsigned long count,
+                   unsigned long *start)
+{
+	size_t              i, lo, hi, mid;
+	unsigned long long  low, high;
+
+	if (0 == count || max < min || count - 1 > max - min)
+		return false;
+
+	/* Skip the spans which end before min */
+	lo = 0;
+	hi = set->nspans;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (set->spans[mid].last < min)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	low = min;
+	for (i = lo; i < set->nspans; i++) {
+		/* The hole before this span */
+		high = set->spans[i].first;
+		if (high > max + 1ULL)
+			high = max + 1ULL;
+		if (high > low && high - low >= count) {
+			*start = low;
+			return true;
+		}
+
+		if (low < set->spans[i].last + 1ULL)
+			low = set->spans[i].last + 1ULL;
+		if (low > max)
+			return false;
+	}
+
+	if (max - low < count - 1)
+		return false;
+	*start = low;
+	return true;
+}
+
+
+void
+rangeset_free(struct rangeset *set)
+{
+	free(set->slots);
+	free(set->spans);
+	set->slots = NULL;
+	set->spans = NULL;
+	set->n = 0;
+	set->size = 0;
+	set->nspans = 0;
+}
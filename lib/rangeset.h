@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+
+#ifndef SHADOW_INCLUDE_LIB_RANGESET_H_
+#define SHADOW_INCLUDE_LIB_RANGESET_H_
+
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/*
+ * A range of IDs [first, last], and the data it was added with.
+ * reach is the highest last of this range and of all the ranges
+ * before it, so that a search for the ranges including an ID can stop
+ * as soon as no earlier range reaches it.
+ */
+struct rangeset_slot {
+	unsigned long   first, last;
+	unsigned long   reach;
+	/*@dependent@*/void  *data;
+};
+
+/*
+ * The union of the ranges, as disjoint intervals which are not adjacent.
+ */
+struct rangeset_span {
+	unsigned long  first, last;
+};
+
+/*
+ * A set of ranges, which may overlap, sorted by their first ID.  Ranges
+ * are appended with rangeset_add(), and then rangeset_sort() sorts them,
+ * after which the set can be searched.  rangeset_insert() and
+ * rangeset_remove() keep a sorted set sorted.
+ */
+struct rangeset {
+	/*@only@*/ /*@null@*/struct rangeset_slot  *slots;
+	size_t                                   n;
+	size_t                                   size;	/* allocated slots and spans */
+	/*@only@*/ /*@null@*/struct rangeset_span  *spans;
+	size_t                                   nspans;
+};
+
+#define RANGESET_INIT  {NULL, 0, 0, NULL, 0}
+
+
+int rangeset_add(struct rangeset *set, unsigned long first,
+                 unsigned long count, void *data);
+void rangeset_sort(struct rangeset *set);
+int rangeset_insert(struct rangeset *set, unsigned long first,
+                    unsigned long count, void *data);
+int rangeset_remove(struct rangeset *set, unsigned long first,
+                    const void *data);
+size_t rangeset_upto(const struct rangeset *set, unsigned long id);
+/*@null@*/void *rangeset_prev_overlap(const struct rangeset *set,
+                                      unsigned long first, size_t *pos);
+bool rangeset_find_free(const struct rangeset *set, unsigned long min,
+                        unsigned long max, unsigned long count,
+                        unsigned long *start);
+void rangeset_free(struct rangeset *set);
+
+
+#endif  // include guard
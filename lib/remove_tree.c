@@ -20,9 +20,11 @@
 #include <dirent.h>
 #include <unistd.h>
 
+#include "alloc/malloc.h"
 #include "defines.h"
 #include "prototypes.h"
 #include "string/strcmp/streq.h"
+#include "workpool.h"
 
 
 static int remove_tree_at (int at_fd, const char *path, bool remove_root)
@@ -91,14 +93,121 @@ static int remove_tree_at (int at_fd, const char *path, bool remove_root)
 	return rc;
 }
 
+/*
+ * With several processors, the files are first deleted by a pool of
+ * threads, each subdirectory being handed to the pool.  A subdirectory
+ * which cannot be queued is done by the thread which found it.  Only
+ * the empty directories are then left to remove_tree_at().
+ */
+static int remove_files (struct workpool *wp, int dir_fd);
+
+static void remove_files_job (struct workpool *wp, void *arg)
+{
+	int *dir_fd = arg;
+
+	if (remove_files (wp, *dir_fd) != 0) {
+		workpool_fail (wp);
+	}
+	free (dir_fd);
+}
+
+/*
+ * remove_files - delete the files of a tree, and keep its directories
+ *
+ *	dir_fd is closed.
+ */
+static int remove_files (struct workpool *wp, int dir_fd)
+{
+	DIR *dir;
+	const struct dirent *ent;
+	int *job, fd, rc = 0;
+
+	dir = fdopendir (dir_fd);
+	if (!dir) {
+		(void) close (dir_fd);
+		return -1;
+	}
+
+	while ((ent = readdir (dir))) {
+		struct stat ent_sb;
+
+		if (streq(ent->d_name, ".") ||
+		    streq(ent->d_name, "..")) {
+			continue;
+		}
+
+		/*
+		 * Give up if another directory failed
+		 */
+		if (workpool_failed (wp)) {
+			rc = -1;
+			break;
+		}
+
+		rc = fstatat (dirfd(dir), ent->d_name, &ent_sb, AT_SYMLINK_NOFOLLOW);
+		if (rc < 0) {
+			break;
+		}
+
+		if (!S_ISDIR (ent_sb.st_mode)) {
+			rc = unlinkat (dirfd(dir), ent->d_name, 0);
+			if (rc != 0) {
+				break;
+			}
+			continue;
+		}
+
+		fd = openat (dirfd(dir), ent->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd < 0) {
+			rc = -1;
+			break;
+		}
+		job = malloc_T (1, int);
+		if (NULL != job) {
+			*job = fd;
+			if (workpool_trysubmit (wp, remove_files_job, job)) {
+				continue;
+			}
+			free (job);
+		}
+		rc = remove_files (wp, fd);
+		if (rc != 0) {
+			break;
+		}
+	}
+
+	(void) closedir (dir);
+
+	return rc;
+}
+
 /*
  * remove_tree - delete a directory tree
  *
  *	remove_tree() walks a directory tree and deletes all the files
  *	and directories.
  *	At the end, it deletes the root directory itself.
+ *
+ *	The files are deleted in parallel when several processors are
+ *	online.
  */
 int remove_tree (const char *root, bool remove_root)
 {
+	struct workpool wp;
+	int dir_fd, rc = 0;
+
+	workpool_start (&wp, 0);
+	if (wp.nthreads > 0) {
+		dir_fd = openat (AT_FDCWD, root, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (dir_fd < 0) {
+			rc = -1;
+		} else {
+			rc = remove_files (&wp, dir_fd);
+		}
+	}
+	if (workpool_stop (&wp) != 0 || rc != 0) {
+		return -1;
+	}
+
 	return remove_tree_at (AT_FDCWD, root, remove_root);
 }
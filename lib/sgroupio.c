@@ -203,7 +203,8 @@ static struct commonio_ops gshadow_ops = {
 	gshadow_parse,
 	gshadow_put,
 	NULL,			/* open_hook */
-	NULL			/* close_hook */
+	NULL,			/* close_hook */
+	NULL			/* getid */
 };
 
 static struct commonio_db gshadow_db = {
@@ -223,7 +224,22 @@ static struct commonio_db gshadow_db = {
 	false,			/* isopen */
 	false,			/* locked */
 	false,			/* readonly */
-	false			/* setname */
+	false,			/* setname */
+	false,			/* committed */
+	NULL,			/* name_index */
+	0,			/* name_index_size */
+	0,			/* name_index_count */
+	NULL,			/* id_index */
+	0,			/* id_index_size */
+	0,			/* id_index_count */
+	NULL,			/* slab_text */
+	0,			/* slab_text_size */
+	false,			/* slab_text_mapped */
+	NULL,			/* slab_entries */
+	0,			/* slab_entries_count */
+	0,			/* lock_time */
+	0,			/* lock_wait */
+	0			/* lock_holder */
 };
 
 int sgr_setdbname (const char *filename)
@@ -295,7 +311,10 @@ void __sgr_set_changed (void)
 
 /*@dependent@*/ /*@null@*/struct commonio_entry *__sgr_get_head (void)
 {
-	return gshadow_db.head;
+	if (commonio_split_lines (&gshadow_db) != 0) {
+		return NULL;
+	}
+	return commonio_get_head (&gshadow_db);
 }
 
 void __sgr_del_entry (const struct commonio_entry *ent)
@@ -303,6 +322,11 @@ void __sgr_del_entry (const struct commonio_entry *ent)
 	commonio_del_entry (&gshadow_db, ent);
 }
 
+struct commonio_db *__sgr_get_db (void)
+{
+	return &gshadow_db;
+}
+
 /* Sort with respect to group ordering. */
 int sgr_sort ()
 {
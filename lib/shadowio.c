@@ -77,7 +77,8 @@ static struct commonio_ops shadow_ops = {
 	shadow_parse,
 	shadow_put,
 	NULL,			/* open_hook */
-	NULL			/* close_hook */
+	NULL,			/* close_hook */
+	NULL			/* getid */
 };
 
 static struct commonio_db shadow_db = {
@@ -97,7 +98,22 @@ static struct commonio_db shadow_db = {
 	false,			/* isopen */
 	false,			/* locked */
 	false,			/* readonly */
-	false			/* setname */
+	false,			/* setname */
+	false,			/* committed */
+	NULL,			/* name_index */
+	0,			/* name_index_size */
+	0,			/* name_index_count */
+	NULL,			/* id_index */
+	0,			/* id_index_size */
+	0,			/* id_index_count */
+	NULL,			/* slab_text */
+	0,			/* slab_text_size */
+	false,			/* slab_text_mapped */
+	NULL,			/* slab_entries */
+	0,			/* slab_entries_count */
+	0,			/* lock_time */
+	0,			/* lock_wait */
+	0			/* lock_holder */
 };
 
 int spw_setdbname (const char *filename)
@@ -230,7 +246,10 @@ int spw_unlock (bool process_selinux)
 
 struct commonio_entry *__spw_get_head (void)
 {
-	return shadow_db.head;
+	if (commonio_split_lines (&shadow_db) != 0) {
+		return NULL;
+	}
+	return commonio_get_head (&shadow_db);
 }
 
 void __spw_del_entry (const struct commonio_entry *ent)
@@ -238,6 +257,11 @@ void __spw_del_entry (const struct commonio_entry *ent)
 	commonio_del_entry (&shadow_db, ent);
 }
 
+struct commonio_db *__spw_get_db (void)
+{
+	return &shadow_db;
+}
+
 /* Sort with respect to passwd ordering. */
 int spw_sort ()
 {
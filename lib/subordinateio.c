@@ -20,11 +20,16 @@
 #include <fcntl.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 
+#include "alloc/calloc.h"
 #include "alloc/malloc.h"
 #include "alloc/reallocf.h"
 #include "atoi/a2i.h"
 #include "atoi/getnum.h"
+#include "rangeset.h"
+#include "search/sort/qsort.h"
 #include "shadow/passwd/getpw.h"
 #include "string/ctype/isascii.h"
 #include "string/sprintf/stprintf.h"
@@ -151,27 +156,141 @@ static struct commonio_ops subordinate_ops = {
 	subordinate_put,	/* put */
 	NULL,			/* open_hook */
 	NULL,			/* close_hook */
+	NULL,			/* getid */
 };
 
-// is_same_user: test whether two strings identify the same user.
+/*
+ * The ranges of an open database, sorted by their first ID, so that the
+ * ranges which include an ID, and the holes between them, are found
+ * without walking all the entries.  It is built the first time the
+ * database is searched after it is opened, and then kept up to date by
+ * add_range() and remove_range().  The data of each range is its
+ * commonio_entry.
+ */
+struct subid_index {
+	struct rangeset  ranges;
+	bool             built;
+	bool             sorted;	/* see sort_ranges() */
+};
+
+static struct subid_index subordinate_uid_index;
+static struct subid_index subordinate_gid_index;
+
+static struct subid_index *db_index(const struct commonio_db *db);
+
+/*
+ * index_reset: forget the index of @db
+ *
+ * It is called when @db is opened or closed, and when the index could not
+ * be kept up to date.  It is built again when it is needed.
+ */
+static void index_reset(const struct commonio_db *db)
+{
+	struct subid_index *idx = db_index(db);
+
+	rangeset_free(&idx->ranges);
+	idx->built = false;
+	idx->sorted = false;
+}
+
+/*
+ * ranges_index: get the index of the ranges of @db, building it if needed
+ *
+ * @db: an open database
+ *
+ * Returns NULL on failure to allocate memory.
+ */
+static /*@null@*/struct rangeset *ranges_index(struct commonio_db *db)
+{
+	struct subid_index *idx = db_index(db);
+	struct commonio_entry *head, *ent;
+	const struct subordinate_range *range;
+
+	if (idx->built)
+		return &idx->ranges;
+
+	head = commonio_get_head(db);
+	if (NULL == head && NULL != db->head)
+		return NULL;
+
+	for (ent = head; NULL != ent; ent = ent->next) {
+		range = ent->eptr;
+		if (NULL == range || range->count == 0)
+			continue;
+		if (rangeset_add(&idx->ranges, range->start, range->count,
+		                 ent) == -1)
+		{
+			rangeset_free(&idx->ranges);
+			return NULL;
+		}
+	}
+	rangeset_sort(&idx->ranges);
+	idx->built = true;
+	return &idx->ranges;
+}
+
+/*
+ * index_add: add the range of @ent, which was added or changed, to the
+ * index of @db
+ */
+static void index_add(struct commonio_db *db, struct commonio_entry *ent)
+{
+	struct subid_index *idx = db_index(db);
+	const struct subordinate_range *range = ent->eptr;
+
+	if (!idx->built || range->count == 0)
+		return;
+	if (rangeset_insert(&idx->ranges, range->start, range->count, ent) == -1)
+		index_reset(db);
+}
+
+/*
+ * index_del: remove the range of @ent, which is about to be deleted or
+ * changed, from the index of @db
+ */
+static void index_del(struct commonio_db *db, const struct commonio_entry *ent)
+{
+	struct subid_index *idx = db_index(db);
+	const struct subordinate_range *range = ent->eptr;
+
+	if (!idx->built || range->count == 0)
+		return;
+	if (rangeset_remove(&idx->ranges, range->start, ent) == -1)
+		index_reset(db);
+}
+
+// owner_uid: get the UID of the user identified by @owner, if it exists.
 static bool
-is_same_user(const char *a, const char *b)
+owner_uid(const char *owner, uid_t *uid)
 {
-	uid_t                uid_a;
-	uid_t                uid_b;
 	const struct passwd  *pw;
 
-	pw = getpw_uid_or_nam(a);
+	pw = getpw_uid_or_nam(owner);
 	if (NULL == pw)
 		return false;
-	uid_a = pw->pw_uid;
+	*uid = pw->pw_uid;
+	return true;
+}
 
-	pw = getpw_uid_or_nam(b);
-	if (NULL == pw)
-		return false;
-	uid_b = pw->pw_uid;
+// is_owned_by: test whether @a identifies the user @owner, whose UID is @uid.
+static bool
+is_owned_by(const char *a, const char *owner, uid_t uid)
+{
+	uid_t  uid_a;
+
+	if (streq(a, owner))
+		return true;
 
-	return uid_a == uid_b;
+	return owner_uid(a, &uid_a) && (uid_a == uid);
+}
+
+// is_same_user: test whether two strings identify the same user.
+static bool
+is_same_user(const char *a, const char *b)
+{
+	uid_t  uid_b;
+
+	return owner_uid(b, &uid_b) && is_owned_by(a, b, uid_b);
 }
 
 /*
@@ -185,9 +304,15 @@ is_same_user(const char *a, const char *b)
 static bool range_exists(struct commonio_db *db, const char *owner)
 {
 	const struct subordinate_range *range;
+	uid_t uid;
+
+	/* A user which does not exist does not own any range */
+	if (!owner_uid(owner, &uid))
+		return false;
+
 	commonio_rewind(db);
 	while (NULL != (range = commonio_next(db))) {
-		if (is_same_user(range->owner, owner))
+		if (is_owned_by(range->owner, owner, uid))
 			return true;
 	}
 	return false;
@@ -208,27 +333,24 @@ static const struct subordinate_range *find_range(struct commonio_db *db,
 						  const char *owner, unsigned long val)
 {
 	const struct subordinate_range *range;
+	const struct commonio_entry *ent;
+	const struct rangeset *ranges;
+	size_t pos;
+
+	ranges = ranges_index(db);
+	if (NULL == ranges)
+		return NULL;
 
 	/*
 	 * Search for exact username/group specification
 	 *
-	 * This is the original method - go fast through the db, doing only
-	 * exact username/group string comparison. Therefore we leave it as-is
-	 * for the time being, in order to keep it equally fast as it was
-	 * before.
+	 * This is the original method - go fast through the ranges which
+	 * include @val, doing only exact username/group string comparison.
 	 */
-	commonio_rewind(db);
-	while (NULL != (range = commonio_next(db))) {
-		unsigned long first = range->start;
-		unsigned long last = first + range->count - 1;
-
-		if (range->count == 0)
-			continue;
-
-		if (!streq(range->owner, owner))
-			continue;
-
-		if ((val >= first) && (val <= last))
+	pos = rangeset_upto(ranges, val);
+	while (NULL != (ent = rangeset_prev_overlap(ranges, val, &pos))) {
+		range = ent->eptr;
+		if (streq(range->owner, owner))
 			return range;
 	}
 
@@ -246,20 +368,9 @@ static const struct subordinate_range *find_range(struct commonio_db *db,
 	 * (It may be specified as literal UID or as another username which
 	 * has the same UID as the username we are looking for.)
 	 */
-
-	commonio_rewind(db);
-	while (NULL != (range = commonio_next(db))) {
-		unsigned long first = range->start;
-		unsigned long last = first + range->count - 1;
-
-		if (range->count == 0)
-			continue;
-
-		/* For performance reasons check range before using getpwnam() */
-		if ((val < first) || (val > last)) {
-			continue;
-		}
-
+	pos = rangeset_upto(ranges, val);
+	while (NULL != (ent = rangeset_prev_overlap(ranges, val, &pos))) {
+		range = ent->eptr;
 		if (is_same_user(range->owner, owner)) {
 			return range;
 		}
@@ -334,6 +445,23 @@ static int subordinate_range_cmp (const void *p1, const void *p2)
 		return strcmp(range1->owner, range2->owner);
 }
 
+/*
+ * sort_ranges: sort the entries of @db by range, then by owner
+ *
+ * The tools have always written the ranges in order.  The searches do
+ * not need it, since they use the index, so it is only done once after
+ * @db is opened; the ranges added later are appended.
+ */
+static void sort_ranges(struct commonio_db *db)
+{
+	struct subid_index *idx = db_index(db);
+
+	if (idx->sorted)
+		return;
+	if (commonio_sort (db, subordinate_range_cmp) == 0)
+		idx->sorted = true;
+}
+
 /*
  * find_free_range: find an unused consecutive sequence of ids to allocate
  *                  to a user.
@@ -349,8 +477,9 @@ find_free_range(struct commonio_db *db, id_t min, id_t max, unsigned long count)
 {
 	static_assert(sizeof(long long) > sizeof(id_t), "");
 
-	intmax_t                       n, low, high;
-	const struct subordinate_range *range;
+	intmax_t         n;
+	unsigned long    start;
+	struct rangeset  *ranges;
 
 	n = count;
 	if (n == 0 || max < min || n > max - min + 1LL) {
@@ -358,45 +487,17 @@ find_free_range(struct commonio_db *db, id_t min, id_t max, unsigned long count)
 		return -1;
 	}
 
-	/* Sort by range then by owner */
-	commonio_sort (db, subordinate_range_cmp);
-	commonio_rewind(db);
-
-	low = min;
-	while (NULL != (range = commonio_next(db))) {
-		intmax_t  first, last;
-
-		if (range->count == 0)
-			continue;
-
-		first = range->start;
-		last = first - 1LL + range->count;
-
-		/* Find the top end of the hole before this range */
-		high = first;
-
-		/* Don't allocate IDs after max (included) */
-		if (high > max + 1LL) {
-			high = max + 1LL;
-		}
-
-		/* Is the hole before this range large enough? */
-		if ((high > low) && ((high - low) >= n))
-			return low;
-
-		/* Compute the low end of the next hole */
-		if (low < (last + 1))
-			low = last + 1;
-		if (low > max)
-			goto fail;
+	ranges = ranges_index(db);
+	if (NULL == ranges) {
+		errno = ENOMEM;
+		return -1;
 	}
 
-	/* Is the remaining unclaimed area large enough? */
-	if (max - low >= n - 1)
-		return low;
-fail:
-	errno = EUSERS;
-	return -1;
+	if (!rangeset_find_free(ranges, min, max, count, &start)) {
+		errno = EUSERS;
+		return -1;
+	}
+	return start;
 }
 
 /*
@@ -423,7 +524,11 @@ static int add_range(struct commonio_db *db,
 		return 1;
 
 	/* Otherwise append the range */
-	return commonio_append(db, &range);
+	if (commonio_append(db, &range) == 0)
+		return 0;
+
+	index_add(db, db->tail);
+	return 1;
 }
 
 /*
@@ -442,23 +547,42 @@ static int remove_range (struct commonio_db *db,
                          unsigned long start, unsigned long count)
 {
 	struct commonio_entry *ent;
+	struct commonio_entry **ents = NULL;
+	struct rangeset *ranges;
 	unsigned long end;
+	size_t i, n = 0, pos;
 
 	if (count == 0) {
 		return 1;
 	}
 
 	end = start + count - 1;
-	for (ent = db->head; NULL != ent; ent = ent->next) {
-		struct subordinate_range *range = ent->eptr;
-		unsigned long first;
-		unsigned long last;
 
-		/* Skip unparsed entries */
-		if (NULL == range) {
-			continue;
+	ranges = ranges_index (db);
+	if (NULL == ranges) {
+		return 0;
+	}
+
+	/*
+	 * Collect the entries which overlap the range to remove first, since
+	 * changing them changes the index.
+	 */
+	pos = rangeset_upto (ranges, end);
+	while (NULL != (ent = rangeset_prev_overlap (ranges, start, &pos))) {
+		ents = reallocf_T (ents, n + 1, struct commonio_entry *);
+		if (NULL == ents) {
+			return 0;
 		}
+		ents[n++] = ent;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct subordinate_range *range;
+		unsigned long first;
+		unsigned long last;
 
+		ent = ents[i];
+		range = ent->eptr;
 		first = range->start;
 		last = first + range->count - 1;
 
@@ -467,24 +591,22 @@ static int remove_range (struct commonio_db *db,
 			continue;
 		}
 
-		/* Skip entries outside of the range to remove */
-		if ((end < first) || (start > last)) {
-			continue;
-		}
-
 		if (start <= first) {
 			if (end >= last) {
 				/* to be removed: [start,      end]
 				 * range:           [first, last] */
 				/* entry completely contained in the
 				 * range to remove */
+				index_del (db, ent);
 				commonio_del_entry (db, ent);
 			} else {
 				/* to be removed: [start,  end]
 				 * range:           [first, last] */
 				/* Remove only the start of the entry */
+				index_del (db, ent);
 				range->start = end + 1;
 				range->count = (last - range->start) + 1;
+				index_add (db, ent);
 
 				ent->changed = true;
 				db->changed = true;
@@ -494,7 +616,9 @@ static int remove_range (struct commonio_db *db,
 				/* to be removed:   [start,  end]
 				 * range:         [first, last] */
 				/* Remove only the end of the entry */
+				index_del (db, ent);
 				range->count = start - range->start;
+				index_add (db, ent);
 
 				ent->changed = true;
 				db->changed = true;
@@ -509,10 +633,14 @@ static int remove_range (struct commonio_db *db,
 				tail.count = (last - tail.start) + 1;
 
 				if (commonio_append (db, &tail) == 0) {
+					free (ents);
 					return 0;
 				}
+				index_add (db, db->tail);
 
+				index_del (db, ent);
 				range->count = start - range->start;
+				index_add (db, ent);
 
 				ent->changed = true;
 				db->changed = true;
@@ -520,6 +648,7 @@ static int remove_range (struct commonio_db *db,
 		}
 	}
 
+	free (ents);
 	return 1;
 }
 
@@ -540,7 +669,22 @@ static struct commonio_db subordinate_uid_db = {
 	false,			/* isopen */
 	false,			/* locked */
 	false,			/* readonly */
-	false			/* setname */
+	false,			/* setname */
+	false,			/* committed */
+	NULL,			/* name_index */
+	0,			/* name_index_size */
+	0,			/* name_index_count */
+	NULL,			/* id_index */
+	0,			/* id_index_size */
+	0,			/* id_index_count */
+	NULL,			/* slab_text */
+	0,			/* slab_text_size */
+	false,			/* slab_text_mapped */
+	NULL,			/* slab_entries */
+	0,			/* slab_entries_count */
+	0,			/* lock_time */
+	0,			/* lock_wait */
+	0			/* lock_holder */
 };
 
 /*
@@ -623,6 +767,7 @@ int sub_uid_lock (void)
 
 int sub_uid_open (int mode)
 {
+	index_reset (&subordinate_uid_db);
 	return commonio_open (&subordinate_uid_db, mode);
 }
 
@@ -687,6 +832,7 @@ int sub_uid_remove (const char *owner, uid_t start, unsigned long count)
 
 int sub_uid_close (bool process_selinux)
 {
+	index_reset (&subordinate_uid_db);
 	return commonio_close (&subordinate_uid_db, process_selinux);
 }
 
@@ -695,8 +841,14 @@ int sub_uid_unlock (bool process_selinux)
 	return commonio_unlock (&subordinate_uid_db, process_selinux);
 }
 
+struct commonio_db *__sub_uid_get_db (void)
+{
+	return &subordinate_uid_db;
+}
+
 uid_t sub_uid_find_free_range(uid_t min, uid_t max, unsigned long count)
 {
+	sort_ranges(&subordinate_uid_db);
 	return find_free_range(&subordinate_uid_db, min, max, count);
 }
 
@@ -748,9 +900,31 @@ static struct commonio_db subordinate_gid_db = {
 	false,			/* isopen */
 	false,			/* locked */
 	false,			/* readonly */
-	false			/* setname */
+	false,			/* setname */
+	false,			/* committed */
+	NULL,			/* name_index */
+	0,			/* name_index_size */
+	0,			/* name_index_count */
+	NULL,			/* id_index */
+	0,			/* id_index_size */
+	0,			/* id_index_count */
+	NULL,			/* slab_text */
+	0,			/* slab_text_size */
+	false,			/* slab_text_mapped */
+	NULL,			/* slab_entries */
+	0,			/* slab_entries_count */
+	0,			/* lock_time */
+	0,			/* lock_wait */
+	0			/* lock_holder */
 };
 
+static struct subid_index *db_index(const struct commonio_db *db)
+{
+	if (db == &subordinate_uid_db)
+		return &subordinate_uid_index;
+	return &subordinate_gid_index;
+}
+
 int sub_gid_setdbname (const char *filename)
 {
 	return commonio_setname (&subordinate_gid_db, filename);
@@ -773,6 +947,7 @@ int sub_gid_lock (void)
 
 int sub_gid_open (int mode)
 {
+	index_reset (&subordinate_gid_db);
 	return commonio_open (&subordinate_gid_db, mode);
 }
 
@@ -837,6 +1012,7 @@ int sub_gid_remove (const char *owner, gid_t start, unsigned long count)
 
 int sub_gid_close (bool process_selinux)
 {
+	index_reset (&subordinate_gid_db);
 	return commonio_close (&subordinate_gid_db, process_selinux);
 }
 
@@ -845,11 +1021,270 @@ int sub_gid_unlock (bool process_selinux)
 	return commonio_unlock (&subordinate_gid_db, process_selinux);
 }
 
+struct commonio_db *__sub_gid_get_db (void)
+{
+	return &subordinate_gid_db;
+}
+
 gid_t sub_gid_find_free_range(gid_t min, gid_t max, unsigned long count)
 {
+	sort_ranges(&subordinate_gid_db);
 	return find_free_range(&subordinate_gid_db, min, max, count);
 }
 
+/*
+ * A copy of the ranges of a database, kept between the queries of a
+ * long-running process using libsubid, for as long as the file does not
+ * change.  The ranges are indexed by the UID of their owner, and by ID.
+ * The owners are resolved to UIDs when the file is read, once per name,
+ * and they are resolved again when the passwd file changes, or after
+ * SUBID_CACHE_TTL seconds, for the users which are not in this file.
+ */
+#define SUBID_CACHE_TTL  5
+
+struct subid_cache_name {
+	const char  *owner;
+	size_t      i;	/* index of the range */
+};
+
+struct subid_cache_owner {
+	uid_t   uid;
+	size_t  i;	/* index of the range */
+};
+
+struct subid_cache {
+	bool                      valid;
+	struct stat               st;	/* of the file which was read */
+	struct stat               pw_st;	/* of the passwd file then */
+	time_t                    filled;	/* CLOCK_MONOTONIC seconds */
+	struct subordinate_range  *ranges;	/* in the order of the file */
+	size_t                    n;
+	struct subid_cache_owner  *owners;	/* sorted by UID, then by i */
+	size_t                    n_owners;	/* ranges of existing users */
+	struct rangeset           index;	/* the data is a range */
+};
+
+static struct subid_cache subuid_cache;
+static struct subid_cache subgid_cache;
+
+static void subid_cache_free(struct subid_cache *cache)
+{
+	size_t i;
+
+	for (i = 0; i < cache->n; i++)
+		free((void *)cache->ranges[i].owner);
+	free(cache->ranges);
+	free(cache->owners);
+	rangeset_free(&cache->index);
+	cache->ranges = NULL;
+	cache->owners = NULL;
+	cache->n = 0;
+	cache->n_owners = 0;
+	cache->valid = false;
+}
+
+static int subid_cache_name_cmp(const void *p1, const void *p2)
+{
+	const struct subid_cache_name *n1 = p1;
+	const struct subid_cache_name *n2 = p2;
+
+	return strcmp(n1->owner, n2->owner);
+}
+
+static int subid_cache_owner_cmp(const void *p1, const void *p2)
+{
+	const struct subid_cache_owner *o1 = p1;
+	const struct subid_cache_owner *o2 = p2;
+
+	if (o1->uid != o2->uid)
+		return (o1->uid > o2->uid) - (o1->uid < o2->uid);
+	return (o1->i > o2->i) - (o1->i < o2->i);
+}
+
+// is_same_file: test whether @a and @b tell the same version of a file.
+static bool
+is_same_file(const struct stat *a, const struct stat *b)
+{
+	return a->st_dev == b->st_dev
+	    && a->st_ino == b->st_ino
+	    && a->st_size == b->st_size
+	    && a->st_mtim.tv_sec == b->st_mtim.tv_sec
+	    && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+static int size_cmp(const void *p1, const void *p2)
+{
+	const size_t *i1 = p1;
+	const size_t *i2 = p2;
+
+	return (*i1 > *i2) - (*i1 < *i2);
+}
+
+/*
+ * subid_cache_owners: index the ranges of @cache by the UID of their owner
+ *
+ * The ranges of the owners which are not users are not indexed.
+ *
+ * Returns false on failure to allocate memory.
+ */
+static bool subid_cache_owners(struct subid_cache *cache)
+{
+	struct subid_cache_name *names;
+	size_t i, j;
+	uid_t uid;
+
+	names = malloc_T(cache->n, struct subid_cache_name);
+	if (NULL == names)
+		return false;
+	for (i = 0; i < cache->n; i++) {
+		names[i].owner = cache->ranges[i].owner;
+		names[i].i = i;
+	}
+	qsort_T(struct subid_cache_name, names, cache->n,
+	        subid_cache_name_cmp);
+
+	for (i = 0; i < cache->n; i = j) {
+		bool found = owner_uid(names[i].owner, &uid);
+
+		for (j = i; j < cache->n && streq(names[j].owner, names[i].owner); j++) {
+			if (!found)
+				continue;
+			cache->owners[cache->n_owners].uid = uid;
+			cache->owners[cache->n_owners].i = names[j].i;
+			cache->n_owners++;
+		}
+	}
+	free(names);
+
+	qsort_T(struct subid_cache_owner, cache->owners, cache->n_owners,
+	        subid_cache_owner_cmp);
+	return true;
+}
+
+/*
+ * subid_cache_fill: copy the ranges of the open database @db in @cache
+ *
+ * Returns false on failure to allocate memory.
+ */
+static bool subid_cache_fill(struct subid_cache *cache, struct commonio_db *db)
+{
+	const struct subordinate_range *range;
+	size_t i, n = 0;
+
+	commonio_rewind(db);
+	errno = 0;
+	while (NULL != commonio_next(db))
+		n++;
+	if (ENOMEM == errno)
+		return false;
+	if (0 == n)
+		return true;
+
+	cache->ranges = calloc_T(n, struct subordinate_range);
+	cache->owners = malloc_T(n, struct subid_cache_owner);
+	if (NULL == cache->ranges || NULL == cache->owners)
+		return false;
+
+	commonio_rewind(db);
+	for (i = 0; i < n && NULL != (range = commonio_next(db)); i++) {
+		cache->ranges[i].owner = strdup(range->owner);
+		if (NULL == cache->ranges[i].owner)
+			return false;
+		cache->ranges[i].start = range->start;
+		cache->ranges[i].count = range->count;
+		cache->n++;
+
+		if (range->count == 0)
+			continue;
+		if (rangeset_add(&cache->index, range->start, range->count,
+		                 &cache->ranges[i]) == -1)
+		{
+			return false;
+		}
+	}
+
+	rangeset_sort(&cache->index);
+	return subid_cache_owners(cache);
+}
+
+/*
+ * subid_cache_get: get the ranges of the database of @id_type
+ *
+ * The database is read again only if the file or the passwd file changed
+ * since it was last read, as told by their device, inode, size and
+ * modification time, or if it was read more than SUBID_CACHE_TTL seconds
+ * ago.
+ *
+ * Returns NULL on failure.
+ */
+static /*@null@*/const struct subid_cache *subid_cache_get(enum subid_type id_type)
+{
+	struct subid_cache *cache;
+	struct commonio_db *db;
+	struct timespec now;
+	struct stat st, pw_st;
+	bool ok;
+
+	switch (id_type) {
+	case ID_TYPE_UID:
+		cache = &subuid_cache;
+		db = &subordinate_uid_db;
+		break;
+	case ID_TYPE_GID:
+		cache = &subgid_cache;
+		db = &subordinate_gid_db;
+		break;
+	default:
+		return NULL;
+	}
+
+	/*
+	 * The files are replaced on every update, so a change of their
+	 * inode, size or modification time tells that the copy is stale.
+	 * They are checked before the file is read: if they change in
+	 * between, it is read again on the next query.  The users from
+	 * other sources than the passwd file are only trusted for
+	 * SUBID_CACHE_TTL seconds.
+	 */
+	if (stat(db->filename, &st) == -1)
+		return NULL;
+	if (stat(PASSWD_FILE, &pw_st) == -1)
+		memset(&pw_st, 0, sizeof(pw_st));
+	if (clock_gettime(CLOCK_MONOTONIC, &now) == -1)
+		return NULL;
+	if (cache->valid
+	    && is_same_file(&st, &cache->st)
+	    && is_same_file(&pw_st, &cache->pw_st)
+	    && now.tv_sec - cache->filled < SUBID_CACHE_TTL)
+	{
+		return cache;
+	}
+
+	subid_cache_free(cache);
+
+	if (id_type == ID_TYPE_UID) {
+		if (!sub_uid_open(O_RDONLY))
+			return NULL;
+		ok = subid_cache_fill(cache, db);
+		sub_uid_close(true);
+	} else {
+		if (!sub_gid_open(O_RDONLY))
+			return NULL;
+		ok = subid_cache_fill(cache, db);
+		sub_gid_close(true);
+	}
+	if (!ok) {
+		subid_cache_free(cache);
+		return NULL;
+	}
+
+	cache->st = st;
+	cache->pw_st = pw_st;
+	cache->filled = now.tv_sec;
+	cache->valid = true;
+	return cache;
+}
+
 /*
  * int list_owner_ranges(const char *owner, enum subid_type id_type, struct subordinate_range ***ranges)
  *
@@ -861,6 +1296,10 @@ gid_t sub_gid_find_free_range(gid_t min, gid_t max, unsigned long count)
  * user.  Username may be a username or a string representation of a
  * UID number.  If id_type is UID, then subuids are returned, else
  * subgids are given.
+ *
+ * The ranges are looked up in a copy of the file, which is read again
+ * when the file or the users change (see subid_cache_get()).  The ranges
+ * recorded with a name or a UID of the same user as @owner are returned.
 
  * Returns the number of ranges found, or < 0 on error.
  *
@@ -869,11 +1308,12 @@ gid_t sub_gid_find_free_range(gid_t min, gid_t max, unsigned long count)
 int list_owner_ranges(const char *owner, enum subid_type id_type, struct subid_range **in_ranges)
 {
 	struct subid_range *ranges = NULL;
-	const struct subordinate_range *range;
-	struct commonio_db *db;
+	const struct subid_cache *cache;
 	enum subid_status status;
 	int count = 0;
 	struct subid_nss_ops *h;
+	size_t lo, hi, mid;
+	uid_t uid;
 
 	*in_ranges = NULL;
 
@@ -885,40 +1325,34 @@ int list_owner_ranges(const char *owner, enum subid_type id_type, struct subid_r
 		return -1;
 	}
 
-	switch (id_type) {
-	case ID_TYPE_UID:
-		if (!sub_uid_open(O_RDONLY)) {
-			return -1;
-		}
-		db = &subordinate_uid_db;
-		break;
-	case ID_TYPE_GID:
-		if (!sub_gid_open(O_RDONLY)) {
-			return -1;
-		}
-		db = &subordinate_gid_db;
-		break;
-	default:
+	cache = subid_cache_get(id_type);
+	if (NULL == cache)
 		return -1;
+
+	/* A user which does not exist does not own any range */
+	if (!owner_uid(owner, &uid))
+		return 0;
+
+	lo = 0;
+	hi = cache->n_owners;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (cache->owners[mid].uid < uid)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
 
-	commonio_rewind(db);
-	while (NULL != (range = commonio_next(db))) {
-		if (is_same_user(range->owner, owner)) {
-			ranges = append_range(ranges, range, count++);
-			if (ranges == NULL) {
-				count = -1;
-				goto out;
-			}
+	/* In the order of the file */
+	for (; lo < cache->n_owners && cache->owners[lo].uid == uid; lo++) {
+		ranges = append_range(ranges, &cache->ranges[cache->owners[lo].i],
+		                      count++);
+		if (ranges == NULL) {
+			count = -1;
+			break;
 		}
 	}
 
-out:
-	if (id_type == ID_TYPE_UID)
-		sub_uid_close(true);
-	else
-		sub_gid_close(true);
-
 	*in_ranges = ranges;
 	return count;
 }
@@ -960,12 +1394,23 @@ static int append_uids(uid_t **uids, const char *owner, int n)
 	return n+1;
 }
 
+/*
+ * find_subid_owners: get the UIDs of the owners of the ranges which include
+ *                    @id
+ *
+ * The ranges are looked up in a copy of the file, which is read again
+ * when the file changes (see subid_cache_get()).
+ *
+ * Returns the number of owners, or < 0 on error.
+ */
 int find_subid_owners(unsigned long id, enum subid_type id_type, uid_t **uids)
 {
 	const struct subordinate_range *range;
+	const struct subid_cache *cache;
 	struct subid_nss_ops *h;
 	enum subid_status status;
-	struct commonio_db *db;
+	size_t *idx = NULL;
+	size_t i, m = 0, pos;
 	int n = 0;
 
 	h = get_subid_nss_handle();
@@ -977,85 +1422,105 @@ int find_subid_owners(unsigned long id, enum subid_type id_type, uid_t **uids)
 		return n;
 	}
 
-	switch (id_type) {
-	case ID_TYPE_UID:
-		if (!sub_uid_open(O_RDONLY)) {
-			return -1;
-		}
-		db = &subordinate_uid_db;
-		break;
-	case ID_TYPE_GID:
-		if (!sub_gid_open(O_RDONLY)) {
-			return -1;
-		}
-		db = &subordinate_gid_db;
-		break;
-	default:
+	cache = subid_cache_get(id_type);
+	if (NULL == cache)
 		return -1;
-	}
 
 	*uids = NULL;
 
-	commonio_rewind(db);
-	while (NULL != (range = commonio_next(db))) {
-		if (id >= range->start && id < range->start + range-> count) {
-			n = append_uids(uids, range->owner, n);
-			if (n < 0)
-				break;
-		}
+	pos = rangeset_upto(&cache->index, id);
+	while (NULL != (range = rangeset_prev_overlap(&cache->index, id, &pos))) {
+		idx = reallocf_T(idx, m + 1, size_t);
+		if (NULL == idx)
+			return -1;
+		idx[m++] = range - cache->ranges;
 	}
 
-	if (id_type == ID_TYPE_UID)
-		sub_uid_close(true);
-	else
-		sub_gid_close(true);
+	/* In the order of the file */
+	qsort_T(size_t, idx, m, size_cmp);
+	for (i = 0; i < m; i++) {
+		n = append_uids(uids, cache->ranges[idx[i]].owner, n);
+		if (n < 0)
+			break;
+	}
+	free(idx);
 
 	return n;
 }
 
-bool new_subid_range(struct subordinate_range *range, enum subid_type id_type, bool reuse)
+/*
+ * lock_subid_db: lock and open the database of @id_type for writing
+ *
+ * Returns the database, or NULL on failure.
+ */
+static /*@null@*/struct commonio_db *lock_subid_db(enum subid_type id_type)
 {
-	id_t               start;
-	struct commonio_db *db;
-	const struct subordinate_range *r;
-	bool ret;
-
-	if (get_subid_nss_handle())
-		return false;
-
 	switch (id_type) {
 	case ID_TYPE_UID:
 		if (!sub_uid_lock()) {
 			printf("Failed locking subuids (errno %d)\n", errno);
-			return false;
+			return NULL;
 		}
 		if (!sub_uid_open(O_CREAT | O_RDWR)) {
 			printf("Failed opening subuids (errno %d)\n", errno);
 			sub_uid_unlock(true);
-			return false;
+			return NULL;
 		}
-		db = &subordinate_uid_db;
-		break;
+		return &subordinate_uid_db;
 	case ID_TYPE_GID:
 		if (!sub_gid_lock()) {
 			printf("Failed locking subgids (errno %d)\n", errno);
-			return false;
+			return NULL;
 		}
 		if (!sub_gid_open(O_CREAT | O_RDWR)) {
 			printf("Failed opening subgids (errno %d)\n", errno);
 			sub_gid_unlock(true);
-			return false;
+			return NULL;
 		}
-		db = &subordinate_gid_db;
-		break;
+		return &subordinate_gid_db;
 	default:
-		return false;
+		return NULL;
 	}
+}
 
-	commonio_rewind(db);
-	if (reuse) {
+/*
+ * unlock_subid_db: write the database of @id_type if @commit is true, and
+ *                  unlock it
+ *
+ * If @commit is false, the changes are discarded.
+ *
+ * Returns false if the database could not be written.
+ */
+static bool unlock_subid_db(enum subid_type id_type, bool commit)
+{
+	bool ret = true;
+
+	if (id_type == ID_TYPE_UID) {
+		if (commit && sub_uid_close(true) == 0)
+			ret = false;
+		sub_uid_unlock(true);
+	} else {
+		if (commit && sub_gid_close(true) == 0)
+			ret = false;
+		sub_gid_unlock(true);
+	}
+	return ret;
+}
+
+/*
+ * grant_range: allocate @range in @db, see new_subid_ranges()
+ */
+static bool grant_range(struct commonio_db *db, struct subordinate_range *range,
+                        bool reuse)
+{
+	const struct subordinate_range *r;
+	id_t start;
+	uid_t uid;
+
+	if (reuse && owner_uid(range->owner, &uid)) {
+		commonio_rewind(db);
 		while (NULL != (r = commonio_next(db))) {
-			if (!is_same_user(r->owner, range->owner))
+			if (!is_owned_by(r->owner, range->owner, uid))
 				continue;
 			if (r->count >= range->count) {
 				range->count = r->count;
@@ -1066,76 +1531,110 @@ bool new_subid_range(struct subordinate_range *range, enum subid_type id_type, b
 	}
 
 	start = find_free_range(db, range->start, maxof(id_t), range->count);
-	if (start == -1) {
-		ret = false;
-		goto out;
-	}
+	if (start == -1)
+		return false;
 	range->start = start;
 
-	ret = add_range(db, range->owner, range->start, range->count) == 1;
+	return add_range(db, range->owner, range->start, range->count) == 1;
+}
 
-out:
-	if (id_type == ID_TYPE_UID) {
-		sub_uid_close(true);
-		sub_uid_unlock(true);
-	} else {
-		sub_gid_close(true);
-		sub_gid_unlock(true);
+/*
+ * new_subid_ranges: allocate @n subordinate ranges
+ *
+ * @ranges: the ranges to allocate.  ->owner and ->count must be filled in,
+ *          and ->start is the lowest ID to allocate.  On success, ->start
+ *          (and ->count, if an existing range was reused) are set.
+ * @n: the number of ranges
+ * @id_type: UID or GID
+ * @reuse: whether an existing range of the owner, large enough, can be
+ *         returned instead of allocating a new one
+ *
+ * The database is locked and written once for all the ranges.  Either all
+ * the ranges are allocated, or none is, and @ranges is left unchanged.
+ */
+bool new_subid_ranges(struct subordinate_range *ranges, size_t n,
+                      enum subid_type id_type, bool reuse)
+{
+	struct commonio_db *db;
+	struct subid_range *saved;
+	size_t i;
+	bool ret = true;
+
+	if (get_subid_nss_handle())
+		return false;
+	if (0 == n)
+		return true;
+
+	saved = malloc_T(n, struct subid_range);
+	if (NULL == saved)
+		return false;
+	for (i = 0; i < n; i++) {
+		saved[i].start = ranges[i].start;
+		saved[i].count = ranges[i].count;
+	}
+
+	db = lock_subid_db(id_type);
+	if (NULL == db) {
+		free(saved);
+		return false;
 	}
 
+	for (i = 0; i < n && ret; i++)
+		ret = grant_range(db, &ranges[i], reuse);
+
+	if (!unlock_subid_db(id_type, ret))
+		ret = false;
+
+	if (!ret) {
+		for (i = 0; i < n; i++) {
+			ranges[i].start = saved[i].start;
+			ranges[i].count = saved[i].count;
+		}
+	}
+	free(saved);
 	return ret;
 }
 
-bool release_subid_range(struct subordinate_range *range, enum subid_type id_type)
+bool new_subid_range(struct subordinate_range *range, enum subid_type id_type, bool reuse)
+{
+	return new_subid_ranges(range, 1, id_type, reuse);
+}
+
+/*
+ * release_subid_ranges: remove @n subordinate ranges
+ *
+ * The database is locked and written once for all the ranges.  Either all
+ * the ranges are removed, or none is.
+ */
+bool release_subid_ranges(struct subordinate_range *ranges, size_t n,
+                          enum subid_type id_type)
 {
 	struct commonio_db *db;
-	bool ret;
+	size_t i;
+	bool ret = true;
 
 	if (get_subid_nss_handle())
 		return false;
 
-	switch (id_type) {
-	case ID_TYPE_UID:
-		if (!sub_uid_lock()) {
-			printf("Failed locking subuids (errno %d)\n", errno);
-			return false;
-		}
-		if (!sub_uid_open(O_CREAT | O_RDWR)) {
-			printf("Failed opening subuids (errno %d)\n", errno);
-			sub_uid_unlock(true);
-			return false;
-		}
-		db = &subordinate_uid_db;
-		break;
-	case ID_TYPE_GID:
-		if (!sub_gid_lock()) {
-			printf("Failed locking subgids (errno %d)\n", errno);
-			return false;
-		}
-		if (!sub_gid_open(O_CREAT | O_RDWR)) {
-			printf("Failed opening subgids (errno %d)\n", errno);
-			sub_gid_unlock(true);
-			return false;
-		}
-		db = &subordinate_gid_db;
-		break;
-	default:
+	db = lock_subid_db(id_type);
+	if (NULL == db)
 		return false;
-	}
 
-	ret = remove_range(db, range->owner, range->start, range->count) == 1;
-
-	if (id_type == ID_TYPE_UID) {
-		sub_uid_close(true);
-		sub_uid_unlock(true);
-	} else {
-		sub_gid_close(true);
-		sub_gid_unlock(true);
+	for (i = 0; i < n && ret; i++) {
+		ret = remove_range(db, ranges[i].owner, ranges[i].start,
+		                   ranges[i].count) == 1;
 	}
 
+	if (!unlock_subid_db(id_type, ret))
+		ret = false;
 	return ret;
 }
 
+bool release_subid_range(struct subordinate_range *range, enum subid_type id_type)
+{
+	return release_subid_ranges(range, 1, id_type);
+}
+
 void free_subid_pointer(void *ptr)
 {
 	struct subid_nss_ops *h = get_subid_nss_handle();
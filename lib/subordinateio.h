@@ -9,6 +9,7 @@
 
 #ifdef ENABLE_SUBIDS
 
+#include <stddef.h>
 #include <sys/types.h>
 
 #include "../libsubid/subid.h"
@@ -22,6 +23,7 @@ extern int sub_uid_setdbname (const char *filename);
 extern /*@observer@*/const char *sub_uid_dbname (void);
 extern int sub_uid_open (int mode);
 extern int sub_uid_unlock (bool process_selinux);
+extern struct commonio_db *__sub_uid_get_db (void);
 extern int sub_uid_add (const char *owner, uid_t start, unsigned long count);
 extern int sub_uid_remove (const char *owner, uid_t start, unsigned long count);
 extern uid_t sub_uid_find_free_range(uid_t min, uid_t max, unsigned long count);
@@ -29,6 +31,8 @@ extern bool want_subuid_file(void);
 extern int list_owner_ranges(const char *owner, enum subid_type id_type, struct subid_range **ranges);
 extern bool new_subid_range(struct subordinate_range *range, enum subid_type id_type, bool reuse);
 extern bool release_subid_range(struct subordinate_range *range, enum subid_type id_type);
+extern bool new_subid_ranges(struct subordinate_range *ranges, size_t n, enum subid_type id_type, bool reuse);
+extern bool release_subid_ranges(struct subordinate_range *ranges, size_t n, enum subid_type id_type);
 extern int find_subid_owners(unsigned long id, enum subid_type id_type, uid_t **uids);
 extern void free_subordinate_ranges(struct subordinate_range **ranges, int count);
 
@@ -41,6 +45,7 @@ extern int sub_gid_setdbname (const char *filename);
 extern /*@observer@*/const char *sub_gid_dbname (void);
 extern int sub_gid_open (int mode);
 extern int sub_gid_unlock (bool process_selinux);
+extern struct commonio_db *__sub_gid_get_db (void);
 extern int sub_gid_add (const char *owner, gid_t start, unsigned long count);
 extern int sub_gid_remove (const char *owner, gid_t start, unsigned long count);
 extern uid_t sub_gid_find_free_range(gid_t min, gid_t max, unsigned long count);
@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include "workpool.h"
+
+
+static void *
+worker(void *arg)
+{
+	struct workpool      *wp = arg;
+	struct workpool_job  job;
+
+	pthread_mutex_lock(&wp->lock);
+	while (true) {
+		while (0 == wp->len && !wp->stop)
+			pthread_cond_wait(&wp->work, &wp->lock);
+		if (0 == wp->len)
+			break;
+
+		job = wp->queue[wp->head];
+		wp->head = (wp->head + 1) % wp->size;
+		wp->len--;
+		wp->busy++;
+		pthread_cond_broadcast(&wp->done);
+		pthread_mutex_unlock(&wp->lock);
+
+		job.fn(wp, job.arg);
+
+		pthread_mutex_lock(&wp->lock);
+		wp->busy--;
+		pthread_cond_broadcast(&wp->done);
+	}
+	pthread_mutex_unlock(&wp->lock);
+
+	return NULL;
+}
+
+
+/*
+ * workpool_start - Start nthreads threads.
+ *
+ *	With 0, there is one thread per online processor, up to
+ *	WORKPOOL_THREADS_DEF.  There are at most WORKPOOL_THREADS_MAX.
+ */
+void
+workpool_start(struct workpool *wp, long nthreads)
+{
+
+	pthread_mutex_init(&wp->lock, NULL);
+	pthread_cond_init(&wp->work, NULL);
+	pthread_cond_init(&wp->done, NULL);
+	wp->nthreads = 0;
+	wp->size = 0;
+	wp->head = 0;
+	wp->len = 0;
+	wp->busy = 0;
+	wp->failed = false;
+	wp->stop = false;
+
+	if (0 == nthreads) {
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (nthreads > WORKPOOL_THREADS_DEF)
+			nthreads = WORKPOOL_THREADS_DEF;
+	}
+	if (nthreads < 2)
+		return;
+	if (nthreads > WORKPOOL_THREADS_MAX)
+		nthreads = WORKPOOL_THREADS_MAX;
+
+	while (wp->nthreads < (size_t) nthreads) {
+		if (pthread_create(&wp->threads[wp->nthreads], NULL,
+		                   worker, wp) != 0)
+		{
+			break;
+		}
+		wp->nthreads++;
+	}
+	wp->size = 2 * wp->nthreads;
+}
+
+
+static void
+enqueue(struct workpool *wp, void (*fn)(struct workpool *wp, void *arg),
+        void *arg)
+{
+	struct workpool_job  *job;
+
+	job = &wp->queue[(wp->head + wp->len) % wp->size];
+	job->fn = fn;
+	job->arg = arg;
+	wp->len++;
+	pthread_cond_signal(&wp->work);
+}
+
+
+/*
+ * workpool_submit - Queue a job, waiting for room in the queue.
+ *
+ *	A job must not call it, as it could wait for itself; it can use
+ *	workpool_trysubmit().  Without threads, the job is run at once.
+ */
+void
+workpool_submit(struct workpool *wp,
+                void (*fn)(struct workpool *wp, void *arg), void *arg)
+{
+	if (0 == wp->nthreads) {
+		fn(wp, arg);
+		return;
+	}
+
+	pthread_mutex_lock(&wp->lock);
+	while (wp->size == wp->len)
+		pthread_cond_wait(&wp->done, &wp->lock);
+	enqueue(wp, fn, arg);
+	pthread_mutex_unlock(&wp->lock);
+}
+
+
+/*
+ * workpool_trysubmit - Queue a job if there is room in the queue.
+ *
+ *	It returns false if the job was not queued, and the caller should
+ *	run it itself.
+ */
+bool
+workpool_trysubmit(struct workpool *wp,
+                   void (*fn)(struct workpool *wp, void *arg), void *arg)
+{
+	bool  queued = false;
+
+	if (0 == wp->nthreads)
+		return false;
+
+	pthread_mutex_lock(&wp->lock);
+	if (wp->len < wp->size) {
+		enqueue(wp, fn, arg);
+		queued = true;
+	}
+	pthread_mutex_unlock(&wp->lock);
+
+	return queued;
+}
+
+
+void
+workpool_fail(struct workpool *wp)
+{
+	pthread_mutex_lock(&wp->lock);
+	wp->failed = true;
+	pthread_mutex_unlock(&wp->lock);
+}
+
+
+bool
+workpool_failed(struct workpool *wp)
+{
+	bool  failed;
+
+	pthread_mutex_lock(&wp->lock);
+	failed = wp->failed;
+	pthread_mutex_unlock(&wp->lock);
+
+	return failed;
+}
+
+
+/*
+ * workpool_wait - Wait for all the queued jobs to finish, including the
+ * jobs they queued.
+ *
+ *	It returns 0, or -1 if a job failed.
+ */
+int
+workpool_wait(struct workpool *wp)
+{
+	pthread_mutex_lock(&wp->lock);
+	while (wp->len > 0 || wp->busy > 0)
+		pthread_cond_wait(&wp->done, &wp->lock);
+	pthread_mutex_unlock(&wp->lock);
+
+	return workpool_failed(wp) ? -1 : 0;
+}
+
+
+/*
+ * workpool_stop - Wait for the jobs, and stop the threads.
+ *
+ *	It returns 0, or -1 if a job failed.
+ */
+int
+workpool_stop(struct workpool *wp)
+{
+	size_t  i;
+	int     ret;
+
+	ret = workpool_wait(wp);
+
+	pthread_mutex_lock(&wp->lock);
+	wp->stop = true;
+	pthread_cond_broadcast(&wp->work);
+	pthread_mutex_unlock(&wp->lock);
+
+	for (i = 0; i < wp->nthreads; i++)
+		pthread_join(wp->threads[i], NULL);
+	wp->nthreads = 0;
+
+	pthread_cond_destroy(&wp->done);
+	pthread_cond_destroy(&wp->work);
+	pthread_mutex_destroy(&wp->lock);
+
+	return ret;
+}
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+
+#ifndef SHADOW_INCLUDE_LIB_WORKPOOL_H_
+#define SHADOW_INCLUDE_LIB_WORKPOOL_H_
+
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+#define WORKPOOL_THREADS_DEF  8
+#define WORKPOOL_THREADS_MAX  64
+#define WORKPOOL_QUEUE_SIZE   (2 * WORKPOOL_THREADS_MAX)
+
+
+struct workpool;
+
+struct workpool_job {
+	void  (*fn)(struct workpool *wp, void *arg);
+	void  *arg;
+};
+
+/*
+ * A pool of threads running the jobs of a bounded queue, which holds
+ * twice as many jobs as there are threads.  With a single thread, or
+ * if no thread could be started, there are no threads, and the jobs are
+ * run by the caller of workpool_submit().
+ *
+ * A job which fails calls workpool_fail(), so that the next jobs can
+ * give up early with workpool_failed().
+ */
+struct workpool {
+	pthread_mutex_t      lock;
+	pthread_cond_t       work;	/* a job was queued, or the pool stops */
+	pthread_cond_t       done;	/* a job was taken, or it finished */
+	pthread_t            threads[WORKPOOL_THREADS_MAX];
+	size_t               nthreads;
+	struct workpool_job  queue[WORKPOOL_QUEUE_SIZE];
+	size_t               size;	/* of the queue */
+	size_t               head;
+	size_t               len;
+	size_t               busy;	/* jobs being run */
+	bool                 failed;
+	bool                 stop;
+};
+
+
+void workpool_start(struct workpool *wp, long nthreads);
+void workpool_submit(struct workpool *wp,
+                     void (*fn)(struct workpool *wp, void *arg), void *arg);
+bool workpool_trysubmit(struct workpool *wp,
+                        void (*fn)(struct workpool *wp, void *arg), void *arg);
+void workpool_fail(struct workpool *wp);
+bool workpool_failed(struct workpool *wp);
+int workpool_wait(struct workpool *wp);
+int workpool_stop(struct workpool *wp);
+
+
+#endif  // include guard
@@ -98,6 +98,18 @@ bool subid_grant_gid_range(struct subordinate_range *range, bool reuse)
 	return grant_subid_range(range, reuse, ID_TYPE_GID);
 }
 
+bool subid_grant_uid_ranges(struct subordinate_range *ranges, size_t n,
+			    bool reuse)
+{
+	return new_subid_ranges(ranges, n, ID_TYPE_UID, reuse);
+}
+
+bool subid_grant_gid_ranges(struct subordinate_range *ranges, size_t n,
+			    bool reuse)
+{
+	return new_subid_ranges(ranges, n, ID_TYPE_GID, reuse);
+}
+
 static
 bool ungrant_subid_range(struct subordinate_range *range, enum subid_type id_type)
 {
@@ -113,3 +125,13 @@ bool subid_ungrant_gid_range(struct subordinate_range *range)
 {
 	return ungrant_subid_range(range, ID_TYPE_GID);
 }
+
+bool subid_ungrant_uid_ranges(struct subordinate_range *ranges, size_t n)
+{
+	return release_subid_ranges(ranges, n, ID_TYPE_UID);
+}
+
+bool subid_ungrant_gid_ranges(struct subordinate_range *ranges, size_t n)
+{
+	return release_subid_ranges(ranges, n, ID_TYPE_GID);
+}
@@ -30,7 +30,6 @@
 #endif
 /*@-exitarg@*/
 #include "exitcodes.h"
-#include "io/fgets/fgets.h"
 #include "shadow/gshadow/sgrp.h"
 #include "shadowlog.h"
 #include "string/strcmp/streq.h"
@@ -321,7 +320,9 @@ static void close_files(const struct option_flags *flags)
 
 int main (int argc, char **argv)
 {
-	char buf[BUFSIZ];
+	static struct pw_input in;
+	struct pw_line *input;
+	void *arg = NULL;
 	char *name;
 	char *newpwd;
 	char *cp;
@@ -355,6 +356,27 @@ int main (int argc, char **argv)
 
 	process_flags (argc, argv, &flags);
 	process_selinux = !flags.chroot;
+	in.encrypt = (   (!eflg)
+	              && (   (NULL == crypt_method)
+	                  || !streq(crypt_method, "NONE")));
+	if (sflg) {
+		if (   streq(crypt_method, "SHA256")
+			|| streq(crypt_method, "SHA512")) {
+			arg = &sha_rounds;
+		}
+#if defined(USE_BCRYPT)
+		if (streq(crypt_method, "BCRYPT")) {
+			arg = &bcrypt_rounds;
+		}
+#endif				/* USE_BCRYPT */
+#if defined(USE_YESCRYPT)
+		if (streq(crypt_method, "YESCRYPT")) {
+			arg = &yescrypt_cost;
+		}
+#endif				/* USE_YESCRYPT */
+	}
+	in.crypt_method = crypt_method;
+	in.crypt_arg = arg;
 
 	OPENLOG (Prog);
 
@@ -369,9 +391,9 @@ int main (int argc, char **argv)
 	 * group entry for each group will be looked up in the appropriate
 	 * file (gshadow or group) and the password changed.
 	 */
-	while (fgets_a(buf, stdin) != NULL) {
-		line++;
-		if (stpsep(buf, "\n") == NULL) {
+	while ((input = pw_input_next (&in)) != NULL) {
+		line = input->line;
+		if (NULL == input->buf) {
 			eprintf(_("%s: line %jd: line too long\n"), Prog, line);
 			errors = true;
 			continue;
@@ -386,7 +408,7 @@ int main (int argc, char **argv)
 		 * assumed to already be encrypted.
 		 */
 
-		name = buf;
+		name = input->buf;
 		cp = stpsep(name, ":");
 		if (cp == NULL) {
 			eprintf(_("%s: line %jd: missing new password\n"),
@@ -395,27 +417,11 @@ int main (int argc, char **argv)
 			continue;
 		}
 		newpwd = cp;
-		if (   (!eflg)
-		    && (   (NULL == crypt_method)
-		        || !streq(crypt_method, "NONE"))) {
-			void *arg = NULL;
+		if (NULL != input->hash) {
+			cp = input->hash;
+		} else if (in.encrypt) {
 			const char *salt;
-			if (sflg) {
-				if (   streq(crypt_method, "SHA256")
-					|| streq(crypt_method, "SHA512")) {
-					arg = &sha_rounds;
-				}
-#if defined(USE_BCRYPT)
-				if (streq(crypt_method, "BCRYPT")) {
-					arg = &bcrypt_rounds;
-				}
-#endif				/* USE_BCRYPT */
-#if defined(USE_YESCRYPT)
-				if (streq(crypt_method, "YESCRYPT")) {
-					arg = &yescrypt_cost;
-				}
-#endif				/* USE_YESCRYPT */
-			}
+
 			salt = crypt_make_salt (crypt_method, arg);
 			cp = pw_encrypt (newpwd, salt);
 			if (NULL == cp) {
@@ -34,7 +34,6 @@
 #include "shadowio.h"
 /*@-exitarg@*/
 #include "exitcodes.h"
-#include "io/fgets/fgets.h"
 #include "shadowlog.h"
 #include "string/strcmp/streq.h"
 #include "string/strtok/stpsep.h"
@@ -350,7 +349,8 @@ static const char *get_salt(void)
 
 int main (int argc, char **argv)
 {
-	char buf[BUFSIZ];
+	static struct pw_input in;
+	struct pw_line *input;
 	char *name;
 	char *newpwd;
 	const char *salt;
@@ -401,6 +401,15 @@ int main (int argc, char **argv)
 		open_files (&flags);
 	}
 
+	/* With PAM, the passwords are not encrypted here. */
+	in.encrypt = (NULL != salt);
+#ifdef USE_PAM
+	if (use_pam) {
+		in.encrypt = false;
+	}
+#endif				/* USE_PAM */
+	in.salt = salt;
+
 	/*
 	 * Read each line, separating the user name from the password. The
 	 * password entry for each user will be looked up in the appropriate
@@ -409,23 +418,15 @@ int main (int argc, char **argv)
 	 * last change date is set in the age only if aging information is
 	 * present.
 	 */
-	while (fgets_a(buf, stdin) != NULL) {
+	while ((input = pw_input_next (&in)) != NULL) {
 		char  *cp;
 
-		line++;
-		if (stpsep(buf, "\n") == NULL) {
-			if (feof (stdin) == 0) {
-				// Drop all remaining characters on this line.
-				while (fgets_a(buf, stdin) != NULL) {
-					if (strchr(buf, '\n'))
-						break;
-				}
-
-				eprintf(_("%s: line %jd: line too long\n"),
-				         Prog, line);
-				errors = true;
-				continue;
-			}
+		line = input->line;
+		if (NULL == input->buf) {
+			eprintf(_("%s: line %jd: line too long\n"),
+			         Prog, line);
+			errors = true;
+			continue;
 		}
 
 		/*
@@ -437,7 +438,7 @@ int main (int argc, char **argv)
 		 * assumed to already be encrypted.
 		 */
 
-		name = buf;
+		name = input->buf;
 		cp = stpsep(name, ":");
 		if (cp == NULL) {
 			eprintf(_("%s: line %jd: missing new password\n"),
@@ -477,7 +478,9 @@ int main (int argc, char **argv)
 		const struct passwd *pw;
 		struct passwd newpw;
 
-		if (salt) {
+		if (NULL != input->hash) {
+			cp = input->hash;
+		} else if (salt) {
 			cp = pw_encrypt (newpwd, salt);
 			if (NULL == cp) {
 				eprinte(_("%s: failed to crypt password with salt '%s'"),
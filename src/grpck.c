@@ -15,8 +15,12 @@
 #include <paths.h>
 #include <pwd.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <getopt.h>
 
+#include "alloc/malloc.h"
+#include "alloc/realloc.h"
 #include "chkname.h"
 #include "commonio.h"
 #include "defines.h"
@@ -24,12 +28,14 @@
 #include "io/fprintf.h"
 #include "nscd.h"
 #include "prototypes.h"
+#include "search/sort/qsort.h"
 #include "shadow/gshadow/gshadow.h"
 #include "shadow/gshadow/sgrp.h"
 #include "shadowlog.h"
 #include "sssd.h"
 #include "string/strcmp/streq.h"
 #include "string/strcmp/strprefix.h"
+#include "string/strdup/strdup.h"
 
 #ifdef SHADOWGRP
 #include "sgroupio.h"
@@ -75,6 +81,14 @@ static bool read_only = false;
 static bool sort_mode = false;
 static bool silence_warnings = false;
 
+/*
+ * The names of all the users, sorted, so that check_members() does not
+ * look every member up in the passwd database.
+ */
+static char **user_names = NULL;
+static size_t n_user_names = 0;
+static bool user_names_read = false;
+
 /* local function prototypes */
 static void fail_exit (int status, bool process_selinux);
 NORETURN static void usage (int status);
@@ -82,6 +96,9 @@ static void delete_member (char **, const char *);
 static void process_flags (int argc, char **argv, struct option_flags *flags);
 static void open_files (bool process_selinux);
 static void close_files(bool changed, const struct option_flags *flags);
+static int cmp_name (const void *p1, const void *p2);
+static void read_user_names (void);
+static bool user_exists (const char *name);
 static int check_members (const char *groupname,
                           char **members,
                           const char *fmt_info,
@@ -372,6 +389,62 @@ static void close_files(bool changed, const struct option_flags *flags)
 	}
 }
 
+static int cmp_name (const void *p1, const void *p2)
+{
+	char *const  *n1 = p1;
+	char *const  *n2 = p2;
+
+	return strcmp (*n1, *n2);
+}
+
+/*
+ * read_user_names - read the names of all the users in one pass
+ */
+static void read_user_names (void)
+{
+	size_t         size = 0;
+	struct passwd  *pwd;
+
+	user_names_read = true;
+
+	setpwent ();
+	while (NULL != (pwd = getpwent ())) {
+		if (n_user_names == size) {
+			size = (0 == size) ? 1024 : size * 2;
+			user_names = xrealloc_T(user_names, size, char *);
+		}
+		user_names[n_user_names] = xstrdup (pwd->pw_name);
+		n_user_names++;
+	}
+	endpwent ();
+
+	if (0 != n_user_names) {
+		qsort_T(char *, user_names, n_user_names, cmp_name);
+	}
+}
+
+/*
+ * user_exists - check if a user exists
+ *
+ *	The users which could not be enumerated are still looked up with
+ *	getpwnam().
+ */
+static bool user_exists (const char *name)
+{
+	if (!user_names_read) {
+		read_user_names ();
+	}
+
+	if (   (0 != n_user_names)
+	    && (NULL != bsearch (&name, user_names, n_user_names,
+	                         sizeof (user_names[0]), cmp_name))) {
+		return true;
+	}
+
+	/* local, no need for xgetpwnam */
+	return getpwnam (name) != NULL;
+}
+
 /*
  * check_members - check that every members of a group exist
  *
@@ -405,8 +478,7 @@ static int check_members (const char *groupname,
 	 * Make sure each member exists
 	 */
 	for (i = 0; NULL != members[i]; i++) {
-		/* local, no need for xgetpwnam */
-		if (getpwnam (members[i]) != NULL) {
+		if (user_exists (members[i])) {
 			continue;
 		}
 		/*
@@ -449,20 +521,38 @@ static void compare_members_lists (const char *groupname,
                                    const char *file,
                                    const char *other_file)
 {
-	char **pmem, **other_pmem;
+	size_t  n;
+	char    **pmem, **sorted;
+
+	if (silence_warnings) {
+		return;
+	}
+
+	/*
+	 * Sort a copy of other_members, so that the lists are compared
+	 * in n log n.
+	 */
+	for (n = 0; NULL != other_members[n]; n++) {
+		continue;
+	}
+	sorted = NULL;
+	if (0 != n) {
+		sorted = xmalloc_T(n, char *);
+		memcpy (sorted, other_members, n * sizeof (sorted[0]));
+		qsort_T(char *, sorted, n, cmp_name);
+	}
 
 	for (pmem = members; NULL != *pmem; pmem++) {
-		for (other_pmem = other_members; NULL != *other_pmem; other_pmem++) {
-			if (streq(*pmem, *other_pmem)) {
-				break;
-			}
-		}
-		if (!silence_warnings && *other_pmem == NULL) {
+		if (   (0 == n)
+		    || (NULL == bsearch (pmem, sorted, n, sizeof (sorted[0]),
+		                         cmp_name))) {
 			printf
 			    ("'%s' is a member of the '%s' group in %s but not in %s\n",
 			     *pmem, groupname, file, other_file);
 		}
 	}
+
+	free (sorted);
 }
 #endif				/* SHADOWGRP */
 
@@ -471,7 +561,8 @@ static void compare_members_lists (const char *groupname,
  */
 static void check_grp_file(bool *errors, bool *changed, const struct option_flags *flags)
 {
-	struct commonio_entry *gre, *tgre;
+	struct commonio_entry *gre;
+	size_t dups;
 	struct group *grp;
 #ifdef SHADOWGRP
 	const struct sgrp *sgr;
@@ -536,28 +627,10 @@ static void check_grp_file(bool *errors, bool *changed, const struct option_flag
 		/*
 		 * Make sure this entry has a unique name.
 		 */
-		for (tgre = __gr_get_head (); NULL != tgre; tgre = tgre->next) {
-
-			const struct group *ent = tgre->eptr;
-
-			/*
-			 * Don't check this entry
-			 */
-			if (tgre == gre) {
-				continue;
-			}
-
-			/*
-			 * Don't check invalid entries.
-			 */
-			if (NULL == ent) {
-				continue;
-			}
-
-			if (!streq(grp->gr_name, ent->gr_name)) {
-				continue;
-			}
-
+		for (dups = commonio_count_named (__gr_get_db (), gre);
+		     dups > 0;
+		     dups--)
+		{
 			/*
 			 * Tell the user this entry is a duplicate of
 			 * another and ask them to delete it.
@@ -683,7 +756,8 @@ static void check_grp_file(bool *errors, bool *changed, const struct option_flag
 static void check_sgr_file (bool *errors, bool *changed)
 {
 	const struct group *grp;
-	struct commonio_entry *sge, *tsge;
+	struct commonio_entry *sge;
+	size_t dups;
 	struct sgrp *sgr;
 
 	/*
@@ -735,28 +809,10 @@ static void check_sgr_file (bool *errors, bool *changed)
 		/*
 		 * Make sure this entry has a unique name.
 		 */
-		for (tsge = __sgr_get_head (); NULL != tsge; tsge = tsge->next) {
-
-			const struct sgrp *ent = tsge->eptr;
-
-			/*
-			 * Don't check this entry
-			 */
-			if (tsge == sge) {
-				continue;
-			}
-
-			/*
-			 * Don't check invalid entries.
-			 */
-			if (NULL == ent) {
-				continue;
-			}
-
-			if (!streq(sgr->sg_namp, ent->sg_namp)) {
-				continue;
-			}
-
+		for (dups = commonio_count_named (__sgr_get_db (), sge);
+		     dups > 0;
+		     dups--)
+		{
 			/*
 			 * Tell the user this entry is a duplicate of
 			 * another and ask them to delete it.
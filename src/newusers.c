@@ -37,6 +37,7 @@
 #include "atoi/getnum.h"
 #include "attr.h"
 #include "chkname.h"
+#include "dbtxn.h"
 #include "defines.h"
 #include "getdef.h"
 #include "groupio.h"
@@ -55,6 +56,8 @@
 #include "shadowlog.h"
 #include "sssd.h"
 #include "string/ctype/isascii.h"
+#include "string/memset/memzero.h"
+#include "string/sprintf/aprintf.h"
 #include "string/sprintf/stprintf.h"
 #include "string/strcmp/streq.h"
 #include "string/strdup/strdup.h"
@@ -73,6 +76,8 @@ static const char Prog[] = "newusers";
 
 static bool bflg = false;
 static bool rflg = false;	/* create a system account */
+static long commit_every = 0;	/* commit after this many lines */
+static /*@null@*//*@observer@*/const char *checkpoint = NULL;
 #ifndef USE_PAM
 static /*@null@*//*@observer@*/char *crypt_method = NULL;
 #define cflg (NULL != crypt_method)
@@ -84,23 +89,38 @@ static long bcrypt_rounds = 13;
 #ifdef USE_YESCRYPT
 static long yescrypt_cost = 5;
 #endif				/* USE_YESCRYPT */
+
+/* the hash of the password of the line being processed, if known */
+static /*@null@*//*@dependent@*/char *line_hash = NULL;
 #endif				/* !USE_PAM */
 
 static bool is_shadow;
 #ifdef SHADOWGRP
 static bool is_shadow_grp;
-static bool sgr_locked = false;
 #endif
-static bool pw_locked = false;
-static bool gr_locked = false;
-static bool spw_locked = false;
 #ifdef ENABLE_SUBIDS
 static bool is_sub_uid = false;
 static bool is_sub_gid = false;
-static bool sub_uid_locked = false;
-static bool sub_gid_locked = false;
 #endif				/* ENABLE_SUBIDS */
 
+/* the databases changed by newusers */
+static struct dbtxn txn;
+
+#ifdef USE_PAM
+/* the passwords to update with PAM, once the users are committed */
+static intmax_t *pam_lines = NULL;
+static char **usernames = NULL;
+static char **passwords = NULL;
+static size_t nusers = 0;
+#endif				/* USE_PAM */
+
+/*
+ * The IDs selected automatically.  The databases are scanned once, when
+ * the first ID is needed.
+ */
+static /*@null@*//*@only@*/struct id_pool *uid_pool = NULL;
+static /*@null@*//*@only@*/struct id_pool *gid_pool = NULL;
+
 /* local function prototypes */
 NORETURN static void usage (int status);
 NORETURN static void fail_exit (int, bool);
@@ -108,6 +128,8 @@ static int add_group (const char *, const char *, gid_t *, gid_t);
 static int get_user_id (const char *, uid_t *);
 static int add_user (const char *, uid_t, gid_t);
 #ifndef USE_PAM
+static /*@null@*/void *get_crypt_arg (void);
+static /*@null@*/char *encrypt_password (const char *);
 static int update_passwd (struct passwd *, const char *);
 #endif				/* !USE_PAM */
 static int add_passwd (struct passwd *, const char *);
@@ -115,6 +137,12 @@ static void process_flags (int argc, char **argv, struct option_flags *flags);
 static void check_flags (void);
 static void open_files (bool process_selinux);
 static void close_files(const struct option_flags *flags);
+static void commit_files (intmax_t line, bool process_selinux);
+static intmax_t read_checkpoint (bool process_selinux);
+static void write_checkpoint (intmax_t line, bool process_selinux);
+#ifdef USE_PAM
+static void update_passwords (void);
+#endif				/* USE_PAM */
 
 
 /*
@@ -129,6 +157,7 @@ static void usage (int status)
 	                  "Options:\n"),
 	                Prog);
 	(void) fputs (_("  -b, --badname                 allow bad names\n"), usageout);
+	(void) fputs (_("  -C, --commit-every N          commit the changes every N lines\n"), usageout);
 #ifndef USE_PAM
 	(void) fprintf (usageout,
 	                _("  -c, --crypt-method METHOD     the crypt method (one of %s)\n"),
@@ -142,6 +171,8 @@ static void usage (int status)
 	               );
 #endif				/* !USE_PAM */
 	(void) fputs (_("  -h, --help                    display this help message and exit\n"), usageout);
+	(void) fputs (_("  -k, --checkpoint FILE         record the last line committed in FILE,\n"
+	                "                                and resume after it\n"), usageout);
 	(void) fputs (_("  -r, --system                  create system accounts\n"), usageout);
 	(void) fputs (_("  -R, --root CHROOT_DIR         directory to chroot into\n"), usageout);
 #ifndef USE_PAM
@@ -157,54 +188,13 @@ static void usage (int status)
 /*
  * fail_exit - undo as much as possible
  */
-static void fail_exit (int code, bool process_selinux)
+static void fail_exit (int code, MAYBE_UNUSED bool process_selinux)
 {
-	if (spw_locked) {
-		if (spw_unlock (process_selinux) == 0) {
-			eprintf(_("%s: failed to unlock %s\n"), Prog, spw_dbname());
-			SYSLOG(LOG_ERR, "failed to unlock %s", spw_dbname());
-			/* continue */
-		}
-	}
-	if (pw_locked) {
-		if (pw_unlock (process_selinux) == 0) {
-			eprintf(_("%s: failed to unlock %s\n"), Prog, pw_dbname());
-			SYSLOG(LOG_ERR, "failed to unlock %s", pw_dbname());
-			/* continue */
-		}
-	}
-	if (gr_locked) {
-		if (gr_unlock (process_selinux) == 0) {
-			eprintf(_("%s: failed to unlock %s\n"), Prog, gr_dbname());
-			SYSLOG(LOG_ERR, "failed to unlock %s", gr_dbname());
-			/* continue */
-		}
-	}
-#ifdef	SHADOWGRP
-	if (sgr_locked) {
-		if (sgr_unlock (process_selinux) == 0) {
-			eprintf(_("%s: failed to unlock %s\n"), Prog, sgr_dbname());
-			SYSLOG(LOG_ERR, "failed to unlock %s", sgr_dbname());
-			/* continue */
-		}
-	}
-#endif
-#ifdef ENABLE_SUBIDS
-	if (sub_uid_locked) {
-		if (sub_uid_unlock (process_selinux) == 0) {
-			eprintf(_("%s: failed to unlock %s\n"), Prog, sub_uid_dbname());
-			SYSLOG(LOG_ERR, "failed to unlock %s", sub_uid_dbname());
-			/* continue */
-		}
-	}
-	if (sub_gid_locked) {
-		if (sub_gid_unlock (process_selinux) == 0) {
-			eprintf(_("%s: failed to unlock %s\n"), Prog, sub_gid_dbname());
-			SYSLOG(LOG_ERR, "failed to unlock %s", sub_gid_dbname());
-			/* continue */
-		}
+	if (dbtxn_unlock (&txn) == 0) {
+		eprintf(_("%s: failed to unlock %s\n"), Prog, txn.failed);
+		SYSLOG(LOG_ERR, "failed to unlock %s", txn.failed);
+		/* continue */
 	}
-#endif				/* ENABLE_SUBIDS */
 
 	exit (code);
 }
@@ -263,12 +253,23 @@ static int add_group (const char *name, const char *gid, gid_t *ngid, uid_t uid)
 			eprintf(_("%s: invalid group ID '%s'\n"), Prog, gid);
 			return -1;
 		}
+
+		if (   (NULL != gid_pool)
+		    && (gid_pool_add (gid_pool, grent.gr_gid) != 0)) {
+			return -1;
+		}
 	} else {
 		/* The gid parameter can be "" or a name which is not
 		 * already the name of an existing group.
 		 * In both cases, figure out what group ID can be used.
 		 */
-		if (find_new_gid(rflg, &grent.gr_gid, &uid) < 0) {
+		if (NULL == gid_pool) {
+			gid_pool = gid_pool_open (rflg);
+			if (NULL == gid_pool) {
+				return -1;
+			}
+		}
+		if (gid_pool_get (gid_pool, &grent.gr_gid, &uid) < 0) {
 			return -1;
 		}
 	}
@@ -343,6 +344,11 @@ static int get_user_id (const char *uid, uid_t *nuid) {
 			eprintf(_("%s: invalid user ID '%s'\n"), Prog, uid);
 			return -1;
 		}
+
+		if (   (NULL != uid_pool)
+		    && (uid_pool_add (uid_pool, *nuid) != 0)) {
+			return -1;
+		}
 	} else {
 		if (!streq(uid, "")) {
 			const struct passwd *pwd;
@@ -359,7 +365,12 @@ static int get_user_id (const char *uid, uid_t *nuid) {
 
 			*nuid = pwd->pw_uid;
 		} else {
-			if (find_new_uid (rflg, nuid, NULL) < 0)
+			if (NULL == uid_pool) {
+				uid_pool = uid_pool_open (rflg);
+				if (NULL == uid_pool)
+					return -1;
+			}
+			if (uid_pool_get (uid_pool, nuid, NULL) < 0)
 				return -1;
 		}
 	}
@@ -403,14 +414,12 @@ static int add_user (const char *name, uid_t uid, gid_t gid)
 
 #ifndef USE_PAM
 /*
- * update_passwd - update the password in the passwd entry
- *
- * Return 0 if successful.
+ * get_crypt_arg - the argument of crypt_make_salt() for the -s option
  */
-static int update_passwd (struct passwd *pwd, const char *password)
+static /*@null@*/void *get_crypt_arg (void)
 {
 	void *crypt_arg = NULL;
-	char *cp;
+
 	if (NULL != crypt_method) {
 		if (sflg) {
 			if (   streq(crypt_method, "SHA256")
@@ -434,14 +443,47 @@ static int update_passwd (struct passwd *pwd, const char *password)
 #endif				/* USE_YESCRYPT */
 	}
 
+	return crypt_arg;
+}
+
+/*
+ * encrypt_password - encrypt the password of the line being processed
+ *
+ *	The hash computed in advance for the line is used if there is one.
+ *	Return NULL if the password could not be encrypted.
+ */
+static /*@null@*/char *encrypt_password (const char *password)
+{
+	const char *salt;
+	char *cp;
+
+	if (NULL != line_hash) {
+		return line_hash;
+	}
+
+	salt = crypt_make_salt (crypt_method, get_crypt_arg ());
+	cp = pw_encrypt (password, salt);
+	if (NULL == cp) {
+		eprinte(_("%s: failed to crypt password with salt '%s'"),
+		        Prog, salt);
+	}
+	return cp;
+}
+
+/*
+ * update_passwd - update the password in the passwd entry
+ *
+ * Return 0 if successful.
+ */
+static int update_passwd (struct passwd *pwd, const char *password)
+{
+	char *cp;
+
 	if ((NULL != crypt_method) && streq(crypt_method, "NONE")) {
 		pwd->pw_passwd = (char *)password;
 	} else {
-		const char *salt = crypt_make_salt (crypt_method, crypt_arg);
-		cp = pw_encrypt (password, salt);
+		cp = encrypt_password (password);
 		if (NULL == cp) {
-			eprinte(_("%s: failed to crypt password with salt '%s'"),
-			        Prog, salt);
 			return 1;
 		}
 		pwd->pw_passwd = cp;
@@ -464,31 +506,6 @@ add_passwd(struct passwd *pwd, MAYBE_UNUSED const char *password)
 #endif				/* !USE_PAM */
 
 #ifndef USE_PAM
-	void *crypt_arg = NULL;
-	if (NULL != crypt_method) {
-		if (sflg) {
-			if (streq(crypt_method, "SHA256")
-			    || streq(crypt_method, "SHA512"))
-			{
-				crypt_arg = &sha_rounds;
-			}
-		}
-#if defined(USE_BCRYPT)
-		if (sflg) {
-			if (streq(crypt_method, "BCRYPT")) {
-				crypt_arg = &bcrypt_rounds;
-			}
-		}
-#endif				/* USE_BCRYPT */
-#if defined(USE_YESCRYPT)
-		if (sflg) {
-			if (streq(crypt_method, "YESCRYPT")) {
-				crypt_arg = &yescrypt_cost;
-			}
-		}
-#endif				/* USE_PAM */
-	}
-
 	/*
 	 * In the case of regular password files, this is real easy - pwd
 	 * points to the entry in the password file. Shadow files are
@@ -512,12 +529,8 @@ add_passwd(struct passwd *pwd, MAYBE_UNUSED const char *password)
 		{
 			spent.sp_pwdp = (char *)password;
 		} else {
-			const char *salt = crypt_make_salt (crypt_method,
-			                                    crypt_arg);
-			cp = pw_encrypt (password, salt);
+			cp = encrypt_password (password);
 			if (NULL == cp) {
-				eprinte(_("%s: failed to crypt password with salt '%s'"),
-				        Prog, salt);
 				return 1;
 			}
 			spent.sp_pwdp = cp;
@@ -562,11 +575,8 @@ add_passwd(struct passwd *pwd, MAYBE_UNUSED const char *password)
 	if ((crypt_method != NULL) && streq(crypt_method, "NONE")) {
 		spent.sp_pwdp = (char *)password;
 	} else {
-		const char *salt = crypt_make_salt (crypt_method, crypt_arg);
-		cp = pw_encrypt (password, salt);
+		cp = encrypt_password (password);
 		if (NULL == cp) {
-			eprinte(_("%s: failed to crypt password with salt '%s'"),
-			        Prog, salt);
 			return 1;
 		}
 		spent.sp_pwdp = cp;
@@ -606,6 +616,8 @@ static void process_flags (int argc, char **argv, struct option_flags *flags)
 #endif 				/* !USE_PAM */
 	static struct option long_options[] = {
 		{"badname",      no_argument,       NULL, 'b'},
+		{"checkpoint",   required_argument, NULL, 'k'},
+		{"commit-every", required_argument, NULL, 'C'},
 #ifndef USE_PAM
 		{"crypt-method", required_argument, NULL, 'c'},
 #endif				/* !USE_PAM */
@@ -620,15 +632,23 @@ static void process_flags (int argc, char **argv, struct option_flags *flags)
 
 	while ((c = getopt_long (argc, argv,
 #ifndef USE_PAM
-	                         "c:bhrs:",
+	                         "c:bC:hk:rs:",
 #else				/* USE_PAM */
-	                         "bhr",
+	                         "bC:hk:r",
 #endif
 	                         long_options, NULL)) != -1) {
 		switch (c) {
 		case 'b':
 			bflg = true;
 			break;
+		case 'C':
+			if (   (-1 == str2sl(&commit_every, optarg))
+			    || (commit_every <= 0)) {
+				eprintf(_("%s: invalid numeric argument '%s'\n"),
+				         Prog, optarg);
+				usage (EXIT_FAILURE);
+			}
+			break;
 #ifndef USE_PAM
 		case 'c':
 			crypt_method = optarg;
@@ -637,6 +657,9 @@ static void process_flags (int argc, char **argv, struct option_flags *flags)
 		case 'h':
 			usage (EXIT_SUCCESS);
 			break;
+		case 'k':
+			checkpoint = optarg;
+			break;
 		case 'r':
 			rflg = true;
 			break;
@@ -708,6 +731,12 @@ static void process_flags (int argc, char **argv, struct option_flags *flags)
  */
 static void check_flags (void)
 {
+	if ((NULL != checkpoint) && (0 == commit_every)) {
+		eprintf(_("%s: %s flag is only allowed with the %s flag\n"),
+		         Prog, "-k", "-C");
+		usage (EXIT_FAILURE);
+	}
+
 #ifndef USE_PAM
 	if (sflg && !cflg) {
 		eprintf(_("%s: %s flag is only allowed with the %s flag\n"),
@@ -739,97 +768,48 @@ static void check_flags (void)
  */
 static void open_files (bool process_selinux)
 {
-	/*
-	 * Lock the password files and open them for update. This will bring
-	 * all of the entries into memory where they may be searched for an
-	 * modified, or new entries added. The password file is the key - if
-	 * it gets locked, assume the others can be locked right away.
-	 */
-	if (pw_lock () == 0) {
-		eprintf(_("%s: cannot lock %s; try again later.\n"),
-		         Prog, pw_dbname ());
-		fail_exit (EXIT_FAILURE, process_selinux);
-	}
-	pw_locked = true;
+	unsigned int  dbs = DBTXN_PASSWD | DBTXN_GROUP;
+
 	if (is_shadow) {
-		if (spw_lock () == 0) {
-			eprintf(_("%s: cannot lock %s; try again later.\n"),
-			         Prog, spw_dbname ());
-			fail_exit (EXIT_FAILURE, process_selinux);
-		}
-		spw_locked = true;
+		dbs |= DBTXN_SHADOW;
 	}
-	if (gr_lock () == 0) {
-		eprintf(_("%s: cannot lock %s; try again later.\n"),
-		         Prog, gr_dbname ());
-		fail_exit (EXIT_FAILURE, process_selinux);
-	}
-	gr_locked = true;
 #ifdef SHADOWGRP
 	if (is_shadow_grp) {
-		if (sgr_lock () == 0) {
-			eprintf(_("%s: cannot lock %s; try again later.\n"),
-			         Prog, sgr_dbname ());
-			fail_exit (EXIT_FAILURE, process_selinux);
-		}
-		sgr_locked = true;
+		dbs |= DBTXN_GSHADOW;
 	}
 #endif
 #ifdef ENABLE_SUBIDS
 	if (is_sub_uid) {
-		if (sub_uid_lock () == 0) {
-			eprintf(_("%s: cannot lock %s; try again later.\n"),
-			         Prog, sub_uid_dbname ());
-			fail_exit (EXIT_FAILURE, process_selinux);
-		}
-		sub_uid_locked = true;
+		dbs |= DBTXN_SUBUID;
 	}
 	if (is_sub_gid) {
-		if (sub_gid_lock () == 0) {
-			eprintf(_("%s: cannot lock %s; try again later.\n"),
-			         Prog, sub_gid_dbname ());
-			fail_exit (EXIT_FAILURE, process_selinux);
-		}
-		sub_gid_locked = true;
+		dbs |= DBTXN_SUBGID;
 	}
 #endif				/* ENABLE_SUBIDS */
+	dbtxn_init (&txn, dbs, process_selinux);
 
-	if (pw_open (O_CREAT | O_RDWR) == 0) {
-		eprintf(_("%s: cannot open %s\n"), Prog, pw_dbname());
-		fail_exit (EXIT_FAILURE, process_selinux);
-	}
-	if (is_shadow && (spw_open (O_CREAT | O_RDWR) == 0)) {
-		eprintf(_("%s: cannot open %s\n"), Prog, spw_dbname());
-		fail_exit (EXIT_FAILURE, process_selinux);
-	}
-	if (gr_open (O_CREAT | O_RDWR) == 0) {
-		eprintf(_("%s: cannot open %s\n"), Prog, gr_dbname());
+	/*
+	 * Lock the password files and open them for update. This will bring
+	 * all of the entries into memory where they may be searched for an
+	 * modified, or new entries added. The password file is the key - if
+	 * it gets locked, assume the others can be locked right away.
+	 */
+	if (dbtxn_lock (&txn) == 0) {
+		eprintf(_("%s: cannot lock %s; try again later.\n"),
+		         Prog, txn.failed);
 		fail_exit (EXIT_FAILURE, process_selinux);
 	}
-#ifdef SHADOWGRP
-	if (is_shadow_grp && (sgr_open (O_CREAT | O_RDWR) == 0)) {
-		eprintf(_("%s: cannot open %s\n"), Prog, sgr_dbname());
+	if (dbtxn_open (&txn, O_CREAT | O_RDWR) == 0) {
+		eprintf(_("%s: cannot open %s\n"), Prog, txn.failed);
 		fail_exit (EXIT_FAILURE, process_selinux);
 	}
-#endif
-#ifdef ENABLE_SUBIDS
-	if (is_sub_uid) {
-		if (sub_uid_open (O_CREAT | O_RDWR) == 0) {
-			eprintf(_("%s: cannot open %s\n"), Prog, sub_uid_dbname());
-			fail_exit (EXIT_FAILURE, process_selinux);
-		}
-	}
-	if (is_sub_gid) {
-		if (sub_gid_open (O_CREAT | O_RDWR) == 0) {
-			eprintf(_("%s: cannot open %s\n"), Prog, sub_gid_dbname());
-			fail_exit (EXIT_FAILURE, process_selinux);
-		}
-	}
-#endif				/* ENABLE_SUBIDS */
 }
 
 /*
  * close_files - close and unlock the password, group and shadow databases
+ *
+ *	All the databases are written in a single transaction: either all
+ *	of them are updated, or none.
  */
 static void close_files(const struct option_flags *flags)
 {
@@ -837,110 +817,173 @@ static void close_files(const struct option_flags *flags)
 
 	process_selinux = !flags->chroot;
 
-	if (pw_close (process_selinux) == 0) {
-		eprintf(_("%s: failure while writing changes to %s\n"), Prog, pw_dbname());
-		SYSLOG(LOG_ERR, "failure while writing changes to %s", pw_dbname());
+	id_pool_free (uid_pool);
+	uid_pool = NULL;
+	id_pool_free (gid_pool);
+	gid_pool = NULL;
+
+	if (dbtxn_commit (&txn) == 0) {
+		eprintf(_("%s: failure while writing changes to %s\n"),
+		         Prog, txn.failed);
+		SYSLOG(LOG_ERR, "failure while writing changes to %s", txn.failed);
 		fail_exit (EXIT_FAILURE, process_selinux);
 	}
-	if (pw_unlock (process_selinux) == 0) {
-		eprintf(_("%s: failed to unlock %s\n"), Prog, pw_dbname());
-		SYSLOG(LOG_ERR, "failed to unlock %s", pw_dbname());
+	if (dbtxn_unlock (&txn) == 0) {
+		eprintf(_("%s: failed to unlock %s\n"), Prog, txn.failed);
+		SYSLOG(LOG_ERR, "failed to unlock %s", txn.failed);
 		/* continue */
 	}
-	pw_locked = false;
+}
 
-	if (is_shadow) {
-		if (spw_close (process_selinux) == 0) {
-			eprintf(_("%s: failure while writing changes to %s\n"),
-			         Prog, spw_dbname ());
-			SYSLOG(LOG_ERR, "failure while writing changes to %s", spw_dbname());
-			fail_exit (EXIT_FAILURE, process_selinux);
-		}
-		if (spw_unlock (process_selinux) == 0) {
-			eprintf(_("%s: failed to unlock %s\n"), Prog, spw_dbname());
-			SYSLOG(LOG_ERR, "failed to unlock %s", spw_dbname());
-			/* continue */
-		}
-		spw_locked = false;
+/*
+ * commit_files - write the changes of the lines up to line
+ *
+ *	The databases remain locked, and are read again for the next
+ *	lines.  With PAM, they are unlocked while the passwords of the
+ *	committed users are updated, and the IDs are then searched again.
+ *	The checkpoint file, if any, records line as the last line
+ *	committed.
+ */
+static void commit_files (intmax_t line, bool process_selinux)
+{
+	if (dbtxn_commit (&txn) == 0) {
+		eprintf(_("%s: failure while writing changes to %s\n"),
+		         Prog, txn.failed);
+		SYSLOG(LOG_ERR, "failure while writing changes to %s", txn.failed);
+		fail_exit (EXIT_FAILURE, process_selinux);
 	}
 
-	if (gr_close (process_selinux) == 0) {
-		eprintf(_("%s: failure while writing changes to %s\n"),
-		         Prog, gr_dbname ());
-		SYSLOG(LOG_ERR, "failure while writing changes to %s", gr_dbname());
+#ifdef USE_PAM
+	id_pool_free (uid_pool);
+	uid_pool = NULL;
+	id_pool_free (gid_pool);
+	gid_pool = NULL;
+
+	if (dbtxn_unlock (&txn) == 0) {
+		eprintf(_("%s: failed to unlock %s\n"), Prog, txn.failed);
+		SYSLOG(LOG_ERR, "failed to unlock %s", txn.failed);
+		/* continue */
+	}
+	update_passwords ();
+#endif				/* USE_PAM */
+
+	if (NULL != checkpoint) {
+		write_checkpoint (line, process_selinux);
+	}
+
+#ifdef USE_PAM
+	if (dbtxn_lock (&txn) == 0) {
+		eprintf(_("%s: cannot lock %s; try again later.\n"),
+		         Prog, txn.failed);
 		fail_exit (EXIT_FAILURE, process_selinux);
 	}
-#ifdef ENABLE_SUBIDS
-	if (is_sub_uid  && (sub_uid_close (process_selinux) == 0)) {
-		eprintf(_("%s: failure while writing changes to %s\n"), Prog, sub_uid_dbname());
-		SYSLOG(LOG_ERR, "failure while writing changes to %s", sub_uid_dbname());
+#endif				/* USE_PAM */
+	if (dbtxn_open (&txn, O_CREAT | O_RDWR) == 0) {
+		eprintf(_("%s: cannot open %s\n"), Prog, txn.failed);
 		fail_exit (EXIT_FAILURE, process_selinux);
 	}
-	if (is_sub_gid  && (sub_gid_close (process_selinux) == 0)) {
-		eprintf(_("%s: failure while writing changes to %s\n"), Prog, sub_gid_dbname());
-		SYSLOG(LOG_ERR, "failure while writing changes to %s", sub_gid_dbname());
+}
+
+/*
+ * read_checkpoint - get the last line committed by a previous run
+ *
+ *	It returns 0 if the checkpoint file does not exist.
+ */
+static intmax_t read_checkpoint (bool process_selinux)
+{
+	FILE *fp;
+	char buf[64];
+	intmax_t line;
+
+	fp = fopen (checkpoint, "r");
+	if (NULL == fp) {
+		if (ENOENT == errno) {
+			return 0;
+		}
+		eprinte(_("%s: cannot open %s"), Prog, checkpoint);
 		fail_exit (EXIT_FAILURE, process_selinux);
 	}
-#endif				/* ENABLE_SUBIDS */
 
-	if (gr_unlock (process_selinux) == 0) {
-		eprintf(_("%s: failed to unlock %s\n"), Prog, gr_dbname());
-		SYSLOG(LOG_ERR, "failed to unlock %s", gr_dbname());
-		/* continue */
+	if (   (fgets_a(buf, fp) == NULL)
+	    || (stpsep(buf, "\n") == NULL)
+	    || (a2i(intmax_t, &line, buf, NULL, 10, 0, INTMAX_MAX) == -1)) {
+		eprintf(_("%s: invalid checkpoint file %s\n"), Prog, checkpoint);
+		(void) fclose (fp);
+		fail_exit (EXIT_FAILURE, process_selinux);
 	}
-	gr_locked = false;
 
-#ifdef SHADOWGRP
-	if (is_shadow_grp) {
-		if (sgr_close (process_selinux) == 0) {
-			eprintf(_("%s: failure while writing changes to %s\n"),
-			         Prog, sgr_dbname ());
-			SYSLOG(LOG_ERR, "failure while writing changes to %s", sgr_dbname());
-			fail_exit (EXIT_FAILURE, process_selinux);
-		}
-		if (sgr_unlock (process_selinux) == 0) {
-			eprintf(_("%s: failed to unlock %s\n"), Prog, sgr_dbname());
-			SYSLOG(LOG_ERR, "failed to unlock %s", sgr_dbname());
-			/* continue */
-		}
-		sgr_locked = false;
+	(void) fclose (fp);
+	return line;
+}
+
+/*
+ * write_checkpoint - record line as the last line committed
+ *
+ *	The checkpoint file is replaced by a new one, so that it is never
+ *	found incomplete.
+ */
+static void write_checkpoint (intmax_t line, bool process_selinux)
+{
+	char *tmp;
+	FILE *fp;
+	bool ok;
+
+	tmp = xaprintf("%s+", checkpoint);
+	fp = fopen (tmp, "w");
+	if (NULL == fp) {
+		eprinte(_("%s: cannot create %s"), Prog, tmp);
+		fail_exit (EXIT_FAILURE, process_selinux);
 	}
-#endif
-#ifdef ENABLE_SUBIDS
-	if (is_sub_uid) {
-		if (sub_uid_unlock (process_selinux) == 0) {
-			eprintf(_("%s: failed to unlock %s\n"), Prog, sub_uid_dbname());
-			SYSLOG(LOG_ERR, "failed to unlock %s", sub_uid_dbname());
-			/* continue */
-		}
-		sub_uid_locked = false;
+
+	ok = (fprintf (fp, "%jd\n", line) >= 0);
+	ok = (fflush (fp) == 0) && ok;
+	ok = (fsync (fileno (fp)) == 0) && ok;
+	ok = (fclose (fp) == 0) && ok;
+	if (!ok || (rename (tmp, checkpoint) != 0)) {
+		eprinte(_("%s: cannot write %s"), Prog, checkpoint);
+		(void) unlink (tmp);
+		fail_exit (EXIT_FAILURE, process_selinux);
 	}
-	if (is_sub_gid) {
-		if (sub_gid_unlock (process_selinux) == 0) {
-			eprintf(_("%s: failed to unlock %s\n"), Prog, sub_gid_dbname());
-			SYSLOG(LOG_ERR, "failed to unlock %s", sub_gid_dbname());
-			/* continue */
+
+	free (tmp);
+}
+
+#ifdef USE_PAM
+/*
+ * update_passwords - update the passwords of the committed users with PAM
+ */
+static void update_passwords (void)
+{
+	for (size_t i = 0; i < nusers; i++) {
+		if (streq(passwords[i], ""))
+			continue;
+		if (do_pam_passwd_non_interactive ("newusers", usernames[i], passwords[i]) != 0) {
+			eprintf(_("%s: (line %jd, user %s) password not changed\n"),
+			         Prog, pam_lines[i], usernames[i]);
+			exit (EXIT_FAILURE);
 		}
-		sub_gid_locked = false;
 	}
-#endif				/* ENABLE_SUBIDS */
+
+	for (size_t i = 0; i < nusers; i++) {
+		free (usernames[i]);
+		strzero (passwords[i]);
+		free (passwords[i]);
+	}
+	nusers = 0;
 }
+#endif				/* USE_PAM */
 
 int main (int argc, char **argv)
 {
-	char buf[BUFSIZ];
+	static struct pw_input in;
+	struct pw_line *input;
 	char *fields[7];
 	const struct passwd *pw;
 	struct passwd newpw;
 	intmax_t line = 0;
+	intmax_t committed;
 	uid_t uid;
 	gid_t gid;
-#ifdef USE_PAM
-	intmax_t *lines = NULL;
-	char **usernames = NULL;
-	char **passwords = NULL;
-	size_t nusers = 0;
-#endif				/* USE_PAM */
 	struct option_flags  flags = {.chroot = false};
 	bool process_selinux;
 
@@ -969,6 +1012,17 @@ int main (int argc, char **argv)
 	is_sub_gid = want_subgid_file() && sub_gid_file_present() && !rflg;
 #endif				/* ENABLE_SUBIDS */
 
+	if (NULL != checkpoint) {
+		in.skip = read_checkpoint (process_selinux);
+	}
+	committed = in.skip;
+#ifndef USE_PAM
+	in.encrypt = (NULL == crypt_method) || !streq(crypt_method, "NONE");
+	in.field = true;
+	in.crypt_method = crypt_method;
+	in.crypt_arg = get_crypt_arg ();
+#endif				/* !USE_PAM */
+
 	open_files (process_selinux);
 
 	/*
@@ -980,14 +1034,17 @@ int main (int argc, char **argv)
 	 * over 100 is allocated. The pw_gid field will be updated with that
 	 * value.
 	 */
-	while (fgets_a(buf, stdin) != NULL) {
-		line++;
-		if (stpsep(buf, "\n") == NULL && feof(stdin) == 0) {
+	while ((input = pw_input_next (&in)) != NULL) {
+		line = input->line;
+		if (NULL == input->buf) {
 			eprintf(_("%s: line %jd: line too long\n"), Prog, line);
 			fail_exit (EXIT_FAILURE, process_selinux);
 		}
+#ifndef USE_PAM
+		line_hash = input->hash;
+#endif				/* !USE_PAM */
 
-		if (strsep2arr_a(buf, ":", fields) == -1) {
+		if (strsep2arr_a(input->buf, ":", fields) == -1) {
 			eprintf(_("%s: line %jd: invalid line\n"), Prog, line);
 			fail_exit (EXIT_FAILURE, process_selinux);
 		}
@@ -1057,14 +1114,14 @@ int main (int argc, char **argv)
 #ifdef USE_PAM
 		/* keep the list of user/password for later update by PAM */
 		nusers++;
-		lines     = reallocf_T(lines, nusers, intmax_t);
+		pam_lines = reallocf_T(pam_lines, nusers, intmax_t);
 		usernames = reallocf_T(usernames, nusers, char *);
 		passwords = reallocf_T(passwords, nusers, char *);
-		if (lines == NULL || usernames == NULL || passwords == NULL) {
+		if (pam_lines == NULL || usernames == NULL || passwords == NULL) {
 			eprinte(_("%s: line %jd"), Prog, line);
 			fail_exit (EXIT_FAILURE, process_selinux);
 		}
-		lines[nusers-1]     = line;
+		pam_lines[nusers-1] = line;
 		usernames[nusers-1] = xstrdup(fields[0]);
 		passwords[nusers-1] = xstrdup(fields[1]);
 #endif				/* USE_PAM */
@@ -1158,14 +1215,25 @@ int main (int argc, char **argv)
 			}
 		}
 #endif				/* ENABLE_SUBIDS */
+
+		/*
+		 * With --commit-every, the changes are written every
+		 * commit_every lines, so that they are not all kept in
+		 * memory, and a failure does not lose the lines committed
+		 * before.
+		 */
+		if ((commit_every > 0) && (line - committed >= commit_every)) {
+			commit_files (line, process_selinux);
+			committed = line;
+		}
 	}
 
 	/*
-	 * Any detected errors will cause the entire set of changes to be
-	 * aborted. Unlocking the password file will cause all of the
-	 * changes to be ignored. Otherwise the file is closed, causing the
-	 * changes to be written out all at once, and then unlocked
-	 * afterwards.
+	 * Any detected errors will cause the entire set of changes (since
+	 * the last commit, with --commit-every) to be aborted. Unlocking
+	 * the password file will cause all of the changes to be ignored.
+	 * Otherwise the file is closed, causing the changes to be written
+	 * out all at once, and then unlocked afterwards.
 	 */
 	close_files (&flags);
 
@@ -1175,17 +1243,14 @@ int main (int argc, char **argv)
 
 #ifdef USE_PAM
 	/* Now update the passwords using PAM */
-	for (size_t i = 0; i < nusers; i++) {
-		if (streq(passwords[i], ""))
-			continue;
-		if (do_pam_passwd_non_interactive ("newusers", usernames[i], passwords[i]) != 0) {
-			eprintf(_("%s: (line %jd, user %s) password not changed\n"),
-			         Prog, lines[i], usernames[i]);
-			exit (EXIT_FAILURE);
-		}
-	}
+	update_passwords ();
 #endif				/* USE_PAM */
 
+	/* The whole input is committed */
+	if ((NULL != checkpoint) && (unlink (checkpoint) != 0) && (ENOENT != errno)) {
+		eprinte(_("%s: cannot remove %s"), Prog, checkpoint);
+	}
+
 	exit (EXIT_SUCCESS);
 }
 
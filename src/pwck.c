@@ -17,7 +17,11 @@
 #include <grp.h>
 #include <pwd.h>
 #include <stdio.h>
+#include <unistd.h>
 
+#include "alloc/malloc.h"
+#include "atoi/a2i.h"
+#include "attr.h"
 #include "chkname.h"
 #include "commonio.h"
 #include "defines.h"
@@ -31,6 +35,7 @@
 #include "sssd.h"
 #include "string/strcmp/streq.h"
 #include "string/strcmp/strprefix.h"
+#include "workpool.h"
 #ifdef WITH_TCB
 #include "tcbfuncs.h"
 #endif				/* WITH_TCB */
@@ -53,6 +58,19 @@ struct option_flags {
 	bool chroot;
 };
 
+/*
+ * The checks of the home directory and of the login shell of an entry
+ * of passwd, made before the entries are looked at.  A NULL dir or shell
+ * is not checked.
+ */
+struct fs_check {
+	/*@dependent@*/const struct commonio_entry *entry;
+	/*@dependent@*/ /*@null@*/const char *dir;
+	/*@dependent@*/ /*@null@*/const char *shell;
+	bool dir_missing;
+	bool shell_missing;
+};
+
 /*
  * Global variables
  */
@@ -73,6 +91,7 @@ static bool bflg = false;
 static bool read_only = false;
 static bool sort_mode = false;
 static bool quiet = false;		/* don't report warnings, only errors */
+static long jobs = 1;			/* parallel filesystem checks */
 
 /* local function prototypes */
 static void fail_exit (int code, bool process_selinux);
@@ -80,6 +99,10 @@ NORETURN static void usage (int status);
 static void process_flags (int argc, char **argv, struct option_flags *flags);
 static void open_files(const struct option_flags *flags);
 static void close_files(bool changed, const struct option_flags *flags);
+static void fs_check_job (struct workpool *wp, void *arg);
+static /*@null@*/struct fs_check *check_fs (size_t *n,
+                                             uid_t min_sys_id,
+                                             uid_t max_sys_id);
 static void check_pw_file (bool *errors, bool *changed,
                            const struct option_flags *flags);
 static void check_spw_file (bool *errors, bool *changed);
@@ -140,6 +163,8 @@ usage (int status)
 	}
 	(void) fputs (_("  -b, --badname                 allow bad names\n"), usageout);
 	(void) fputs (_("  -h, --help                    display this help message and exit\n"), usageout);
+	(void) fputs (_("  -j, --jobs N                  check N home directories and shells\n"
+	                "                                at a time\n"), usageout);
 	(void) fputs (_("  -q, --quiet                   report errors only\n"), usageout);
 	(void) fputs (_("  -r, --read-only               display errors and warnings\n"
 	                "                                but do not change files\n"), usageout);
@@ -165,6 +190,7 @@ static void process_flags (int argc, char **argv, struct option_flags *flags)
 	static struct option long_options[] = {
 		{"badname",   no_argument,       NULL, 'b'},
 		{"help",      no_argument,       NULL, 'h'},
+		{"jobs",      required_argument, NULL, 'j'},
 		{"quiet",     no_argument,       NULL, 'q'},
 		{"read-only", no_argument,       NULL, 'r'},
 		{"root",      required_argument, NULL, 'R'},
@@ -175,7 +201,7 @@ static void process_flags (int argc, char **argv, struct option_flags *flags)
 	/*
 	 * Parse the command line arguments
 	 */
-	while ((c = getopt_long (argc, argv, "behqrR:s",
+	while ((c = getopt_long (argc, argv, "behj:qrR:s",
 	                         long_options, NULL)) != -1) {
 		switch (c) {
 		case 'b':
@@ -184,6 +210,14 @@ static void process_flags (int argc, char **argv, struct option_flags *flags)
 		case 'h':
 			usage (E_SUCCESS);
 			/*@notreached@*/break;
+		case 'j':
+			if (   (-1 == str2sl(&jobs, optarg))
+			    || (jobs <= 0)) {
+				eprintf(_("%s: invalid numeric argument '%s'\n"),
+				         Prog, optarg);
+				usage (E_USAGE);
+			}
+			break;
 		case 'e':	/* added for Debian shadow-961025-2 compatibility */
 		case 'q':
 			quiet = true;
@@ -365,24 +399,121 @@ static void close_files(bool changed, const struct option_flags *flags)
 	pw_locked = false;
 }
 
+static void fs_check_job (MAYBE_UNUSED struct workpool *wp, void *arg)
+{
+	struct fs_check *fc = arg;
+
+	if (NULL != fc->dir) {
+		fc->dir_missing = (access (fc->dir, F_OK) != 0);
+	}
+	if (NULL != fc->shell) {
+		fc->shell_missing = (access (fc->shell, F_OK) != 0);
+	}
+}
+
+/*
+ * check_fs - check the home directories and the login shells of passwd
+ *
+ *	On network file systems, each check can take a while.  With -j,
+ *	they are all made by a pool of threads before check_pw_file()
+ *	looks at the entries, and prompts for them.  The results are
+ *	returned in the order of the file, and their number in *n.
+ *
+ *	NULL is returned if check_pw_file() should make the checks as
+ *	it goes.
+ */
+static /*@null@*/struct fs_check *check_fs (size_t *n,
+                                             uid_t min_sys_id,
+                                             uid_t max_sys_id)
+{
+	size_t                 i, size;
+	struct fs_check        *fc;
+	struct workpool        wp;
+	const struct passwd    *pwd;
+	struct commonio_entry  *pfe;
+
+	if (quiet || (jobs < 2)) {
+		return NULL;
+	}
+
+	size = 0;
+	for (pfe = __pw_get_head (); NULL != pfe; pfe = pfe->next) {
+		size++;
+	}
+	fc = malloc_T(size, struct fs_check);
+	if (NULL == fc) {
+		return NULL;
+	}
+
+	i = 0;
+	for (pfe = __pw_get_head (); NULL != pfe; pfe = pfe->next) {
+		pwd = pfe->eptr;
+		if (   (NULL == pwd)
+		    || strprefix(pfe->line, "+")
+		    || strprefix(pfe->line, "-")) {
+			continue;
+		}
+
+		/* The same conditions as in check_pw_file() */
+		fc[i].entry = pfe;
+		fc[i].dir = NULL;
+		if (   !(pwd->pw_uid >= min_sys_id && pwd->pw_uid <= max_sys_id)
+		    && (NULL != pwd->pw_dir)
+		    && ('\0' != pwd->pw_dir[0])) {
+			fc[i].dir = pwd->pw_dir;
+		}
+		fc[i].shell = NULL;
+		if (!streq(pwd->pw_shell, "")) {
+			fc[i].shell = pwd->pw_shell;
+		}
+		fc[i].dir_missing = false;
+		fc[i].shell_missing = false;
+		i++;
+	}
+	*n = i;
+
+	workpool_start (&wp, jobs);
+	for (i = 0; i < *n; i++) {
+		workpool_submit (&wp, fs_check_job, &fc[i]);
+	}
+	(void) workpool_stop (&wp);
+
+	return fc;
+}
+
 /*
  * check_pw_file - check the content of the passwd file
  */
 static void check_pw_file(bool *errors, bool *changed, const struct option_flags *flags)
 {
-	struct commonio_entry *pfe, *tpfe;
+	struct commonio_entry *pfe;
+	size_t dups;
 	struct passwd *pwd;
 	const struct spwd *spw;
 	uid_t min_sys_id = getdef_ulong ("SYS_UID_MIN", 101UL);
 	uid_t max_sys_id = getdef_ulong ("SYS_UID_MAX", 999UL);
 	bool process_selinux;
+	size_t nfc = 0, ifc = 0;
+	struct fs_check *fc;
+	const struct fs_check *fs;
 
 	process_selinux = !flags->chroot;
 
+	fc = check_fs (&nfc, min_sys_id, max_sys_id);
+
 	/*
 	 * Loop through the entire password file.
 	 */
 	for (pfe = __pw_get_head (); NULL != pfe; pfe = pfe->next) {
+		/*
+		 * Pick the results of check_fs(), if this entry was checked
+		 */
+		fs = NULL;
+		if ((ifc < nfc) && (fc[ifc].entry == pfe)) {
+			fs = &fc[ifc];
+			ifc++;
+		}
+
 		/*
 		 * If this is a NIS line, skip it. You can't "know" what NIS
 		 * is going to do without directly asking NIS ...
@@ -437,27 +568,10 @@ static void check_pw_file(bool *errors, bool *changed, const struct option_flags
 		/*
 		 * Make sure this entry has a unique name.
 		 */
-		for (tpfe = __pw_get_head (); NULL != tpfe; tpfe = tpfe->next) {
-			const struct passwd *ent = tpfe->eptr;
-
-			/*
-			 * Don't check this entry
-			 */
-			if (tpfe == pfe) {
-				continue;
-			}
-
-			/*
-			 * Don't check invalid entries.
-			 */
-			if (NULL == ent) {
-				continue;
-			}
-
-			if (!streq(pwd->pw_name, ent->pw_name)) {
-				continue;
-			}
-
+		for (dups = commonio_count_named (__pw_get_db (), pfe);
+		     dups > 0;
+		     dups--)
+		{
 			/*
 			 * Tell the user this entry is a duplicate of
 			 * another and ask them to delete it.
@@ -519,7 +633,9 @@ static void check_pw_file(bool *errors, bool *changed, const struct option_flags
 			/*
 			 * Make sure the home directory exists
 			 */
-			if (!quiet && (access (pwd->pw_dir, F_OK) != 0)) {
+			if (   !quiet
+			    && ((NULL != fs) ? fs->dir_missing
+			                     : (access (pwd->pw_dir, F_OK) != 0))) {
 				const char *nonexistent = getdef_str("NONEXISTENT");
 
 				/*
@@ -538,7 +654,8 @@ static void check_pw_file(bool *errors, bool *changed, const struct option_flags
 		 */
 		if (   !quiet
 		    && !streq(pwd->pw_shell, "")
-		    && (access (pwd->pw_shell, F_OK) != 0)) {
+		    && ((NULL != fs) ? fs->shell_missing
+		                     : (access (pwd->pw_shell, F_OK) != 0))) {
 
 			/*
 			 * Login shell doesn't exist, give a warning
@@ -678,6 +795,8 @@ static void check_pw_file(bool *errors, bool *changed, const struct option_flags
 		}
 #endif				/* WITH_TCB */
 	}
+
+	free (fc);
 }
 
 /*
@@ -685,7 +804,8 @@ static void check_pw_file(bool *errors, bool *changed, const struct option_flags
  */
 static void check_spw_file (bool *errors, bool *changed)
 {
-	struct commonio_entry *spe, *tspe;
+	struct commonio_entry *spe;
+	size_t dups;
 	struct spwd *spw;
 
 	/*
@@ -754,27 +874,10 @@ static void check_spw_file (bool *errors, bool *changed)
 		/*
 		 * Make sure this entry has a unique name.
 		 */
-		for (tspe = __spw_get_head (); NULL != tspe; tspe = tspe->next) {
-			const struct spwd *ent = tspe->eptr;
-
-			/*
-			 * Don't check this entry
-			 */
-			if (tspe == spe) {
-				continue;
-			}
-
-			/*
-			 * Don't check invalid entries.
-			 */
-			if (NULL == ent) {
-				continue;
-			}
-
-			if (!streq(spw->sp_namp, ent->sp_namp)) {
-				continue;
-			}
-
+		for (dups = commonio_count_named (__spw_get_db (), spe);
+		     dups > 0;
+		     dups--)
+		{
 			/*
 			 * Tell the user this entry is a duplicate of
 			 * another and ask them to delete it.
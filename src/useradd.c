@@ -135,6 +135,10 @@ static const char *create_mail_spool = "";
 static const char *prefix = "";
 static const char *prefix_user_home = NULL;
 
+/* --count: the accounts are named after this LOGIN, and numbered */
+static const char *base_name = "";
+static unsigned long user_count = 0;
+
 #ifdef WITH_SELINUX
 static /*@notnull@*/const char *user_selinux = "";
 static const char *user_selinux_range = NULL;
@@ -166,6 +170,7 @@ static bool
     badnameflg = false,
     bflg = false,		/* new default root of home directory */
     cflg = false,		/* comment (GECOS) field for new account */
+    countflg = false,		/* create user_count accounts */
     dflg = false,		/* home directory for new account */
     Dflg = false,		/* set/show new user default values */
     eflg = false,		/* days since 1970-01-01 when account is locked */
@@ -257,6 +262,7 @@ static void usr_update (unsigned long subuid_count, unsigned long subgid_count,
 static void create_home(const struct option_flags *flags);
 static void create_mail(const struct option_flags *flags);
 static void check_uid_range(bool sys_user, uid_t uid);
+static void select_user (unsigned long i);
 
 
 /*
@@ -903,6 +909,8 @@ static void usage (int status)
 	(void) fputs (_("      --btrfs-subvolume-home    use BTRFS subvolume for home directory\n"), usageout);
 #endif
 	(void) fputs (_("  -c, --comment COMMENT         GECOS field of the new account\n"), usageout);
+	(void) fputs (_("      --count COUNT             create COUNT accounts, named LOGIN1 to\n"
+	                "                                LOGINCOUNT\n"), usageout);
 	(void) fputs (_("  -d, --home-dir HOME_DIR       home directory of the new account\n"), usageout);
 	(void) fputs (_("  -D, --defaults                print or change default useradd configuration\n"), usageout);
 	(void) fputs (_("  -e, --expiredate EXPIRE_DATE  expiration date of the new account\n"), usageout);
@@ -1156,6 +1164,7 @@ static void process_flags (int argc, char **argv, struct option_flags *flags)
 #endif
 			{"badname",        no_argument,       NULL, 201},
 			{"comment",        required_argument, NULL, 'c'},
+			{"count",          required_argument, NULL, 203},
 			{"home-dir",       required_argument, NULL, 'd'},
 			{"defaults",       no_argument,       NULL, 'D'},
 			{"expiredate",     required_argument, NULL, 'e'},
@@ -1213,6 +1222,16 @@ static void process_flags (int argc, char **argv, struct option_flags *flags)
 			case 201:
 				badnameflg = true;
 				break;
+			case 203:
+				if (a2ul(&user_count, optarg, NULL, 0, 1, ULONG_MAX)
+				    == -1)
+				{
+					eprintf(_("%s: invalid numeric argument '%s'\n"),
+					         Prog, optarg);
+					exit (E_BAD_ARG);
+				}
+				countflg = true;
+				break;
 			case 'c':
 				if (!VALID (optarg)) {
 					eprintf(_("%s: invalid comment '%s'\n"),
@@ -1466,6 +1485,16 @@ static void process_flags (int argc, char **argv, struct option_flags *flags)
 		         Prog, "-m", "-M");
 		usage (E_USAGE);
 	}
+	if (countflg && uflg) {
+		eprintf(_("%s: options %s and %s conflict\n"),
+		         Prog, "--count", "-u");
+		usage (E_USAGE);
+	}
+	if (countflg && dflg) {
+		eprintf(_("%s: options %s and %s conflict\n"),
+		         Prog, "--count", "-d");
+		usage (E_USAGE);
+	}
 #ifdef WITH_SELINUX
 	if (user_selinux_range && !Zflg) {
 		eprintf(_("%s: %s flag is only allowed with the %s flag\n"),
@@ -1483,7 +1512,7 @@ static void process_flags (int argc, char **argv, struct option_flags *flags)
 			usage (E_USAGE);
 		}
 
-		if (uflg || Gflg || dflg || cflg || mflg) {
+		if (uflg || Gflg || dflg || cflg || mflg || countflg) {
 			usage (E_USAGE);
 		}
 	} else {
@@ -1492,6 +1521,14 @@ static void process_flags (int argc, char **argv, struct option_flags *flags)
 		}
 
 		user_name = argv[optind];
+		if (countflg) {
+			/*
+			 * The names only differ by their number; check the
+			 * longest one.
+			 */
+			base_name = user_name;
+			user_name = xaprintf("%s%lu", base_name, user_count);
+		}
 		if (!is_valid_user_name(user_name, badnameflg)) {
 			if (errno == EILSEQ) {
 				eprintf(_("%s: invalid user name '%s': use --badname to ignore\n"),
@@ -2462,6 +2499,28 @@ should_assign_subgid(void)
 }
 #endif
 
+/*
+ * select_user - select the i-th account created with --count
+ *
+ *	The accounts are named LOGIN1 to LOGINCOUNT, and their home
+ *	directories are in the base directory.  Nothing is done without
+ *	--count.
+ */
+static void select_user (unsigned long i)
+{
+	if (!countflg) {
+		return;
+	}
+
+	user_name = xaprintf("%s%lu", base_name, i + 1);
+	user_home = xaprintf("%s/%s", def_home, user_name);
+	if (prefix[0]) {
+		prefix_user_home = xaprintf("%s/%s", prefix, user_home);
+	} else {
+		prefix_user_home = user_home;
+	}
+}
+
 /*
  * main - useradd command
  */
@@ -2469,6 +2528,10 @@ int main (int argc, char **argv)
 {
 	unsigned long subuid_count = 0;
 	unsigned long subgid_count = 0;
+	unsigned long i, n;
+	uid_t *uids = NULL;
+	gid_t *gids = NULL;
+	struct id_pool *gid_pool = NULL;
 	struct option_flags  flags = {.chroot = false, .prefix = false};
 	bool process_selinux;
 
@@ -2505,10 +2568,22 @@ int main (int argc, char **argv)
 
 	process_flags (argc, argv, &flags);
 	process_selinux = !flags.chroot && !flags.prefix;
+	n = countflg ? user_count : 1;
 
-	if (run_parts ("/etc/shadow-maint/useradd-pre.d", user_name,
-			"useradd")) {
-		exit(1);
+#ifdef WITH_TCB
+	if (countflg && getdef_bool ("USE_TCB")) {
+		eprintf(_("%s: %s is not supported with USE_TCB\n"),
+		         Prog, "--count");
+		exit (E_USAGE);
+	}
+#endif
+
+	for (i = 0; i < n; i++) {
+		select_user (i);
+		if (run_parts ("/etc/shadow-maint/useradd-pre.d", user_name,
+				"useradd")) {
+			exit(1);
+		}
 	}
 
 	/*
@@ -2527,24 +2602,27 @@ int main (int argc, char **argv)
 	/*
 	 * Start with a quick check to see if the user exists.
 	 */
-	if (prefix_getpwnam (user_name) != NULL) { /* local, no need for xgetpwnam */
-		eprintf(_("%s: user '%s' already exists\n"), Prog, user_name);
-		fail_exit (E_NAME_IN_USE, process_selinux);
-	}
-
-	/*
-	 * Don't blindly overwrite a group when a user is added...
-	 * If you already have a group username, and want to add the user
-	 * to that group, use useradd -g username username.
-	 * --bero
-	 */
-	if (Uflg) {
-		/* local, no need for xgetgrnam */
-		if (prefix_getgrnam (user_name) != NULL) {
-			eprintf(_("%s: group %s exists - if you want to add this user to that group, use -g.\n"),
-			         Prog, user_name);
+	for (i = 0; i < n; i++) {
+		select_user (i);
+		if (prefix_getpwnam (user_name) != NULL) { /* local, no need for xgetpwnam */
+			eprintf(_("%s: user '%s' already exists\n"), Prog, user_name);
 			fail_exit (E_NAME_IN_USE, process_selinux);
 		}
+
+		/*
+		 * Don't blindly overwrite a group when a user is added...
+		 * If you already have a group username, and want to add the user
+		 * to that group, use useradd -g username username.
+		 * --bero
+		 */
+		if (Uflg) {
+			/* local, no need for xgetgrnam */
+			if (prefix_getgrnam (user_name) != NULL) {
+				eprintf(_("%s: group %s exists - if you want to add this user to that group, use -g.\n"),
+				         Prog, user_name);
+				fail_exit (E_NAME_IN_USE, process_selinux);
+			}
+		}
 	}
 
 	/*
@@ -2558,7 +2636,23 @@ int main (int argc, char **argv)
 	 */
 	open_files (process_selinux);
 
-	if (!oflg) {
+	if (countflg) {
+		/* All the UIDs are selected with a single scan */
+		uids = xmalloc_T(n, uid_t);
+		gids = xmalloc_T(n, gid_t);
+		if (find_new_uids (rflg, uids, n, false) < 0) {
+			eprintf(_("%s: can't create user\n"), Prog);
+			fail_exit (E_UID_IN_USE, process_selinux);
+		}
+		user_id = uids[0];
+		if (Uflg) {
+			gid_pool = gid_pool_open (rflg);
+			if (NULL == gid_pool) {
+				eprintf(_("%s: can't create group\n"), Prog);
+				fail_exit (4, process_selinux);
+			}
+		}
+	} else if (!oflg) {
 		/* first, seek for a valid uid to use for this user.
 		 * We do this because later we can use the uid we found as
 		 * gid too ... --gafton */
@@ -2598,34 +2692,49 @@ int main (int argc, char **argv)
 #endif
 	open_shadow (process_selinux);
 
-	/* do we have to add a group for that user? This is why we need to
-	 * open the group files in the open_files() function  --gafton */
-	if (Uflg) {
-		if (find_new_gid (rflg, &user_gid, &user_id) < 0) {
-			eprintf(_("%s: can't create group\n"), Prog);
-			fail_exit (4, process_selinux);
+	for (i = 0; i < n; i++) {
+		if (countflg) {
+			select_user (i);
+			user_id = uids[i];
+		}
+
+		/* do we have to add a group for that user? This is why we need to
+		 * open the group files in the open_files() function  --gafton */
+		if (Uflg) {
+			if (  (countflg
+			       ? gid_pool_get (gid_pool, &user_gid, &user_id)
+			       : find_new_gid (rflg, &user_gid, &user_id))
+			    < 0) {
+				eprintf(_("%s: can't create group\n"), Prog);
+				fail_exit (4, process_selinux);
+			}
+			grp_add (process_selinux);
 		}
-		grp_add (process_selinux);
-	}
 
 #ifdef ENABLE_SUBIDS
-	if (is_sub_uid && subuid_count != 0) {
-		if (find_new_sub_uids(user_id, &sub_uid_start, &subuid_count) < 0) {
-			eprinte(_("%s: can't create subordinate user IDs"), Prog);
-			SYSLOGE(LOG_WARN, "can't create subordinate user IDs");
-			fail_exit(E_SUB_UID_UPDATE, process_selinux);
+		if (is_sub_uid && subuid_count != 0) {
+			if (find_new_sub_uids(user_id, &sub_uid_start, &subuid_count) < 0) {
+				eprinte(_("%s: can't create subordinate user IDs"), Prog);
+				SYSLOGE(LOG_WARN, "can't create subordinate user IDs");
+				fail_exit(E_SUB_UID_UPDATE, process_selinux);
+			}
 		}
-	}
-	if (is_sub_gid && subgid_count != 0) {
-		if (find_new_sub_gids(user_id, &sub_gid_start, &subgid_count) < 0) {
-			eprinte(_("%s: can't create subordinate group IDs"), Prog);
-			SYSLOGE(LOG_WARN, "can't create subordinate group IDs");
-			fail_exit(E_SUB_GID_UPDATE, process_selinux);
+		if (is_sub_gid && subgid_count != 0) {
+			if (find_new_sub_gids(user_id, &sub_gid_start, &subgid_count) < 0) {
+				eprinte(_("%s: can't create subordinate group IDs"), Prog);
+				SYSLOGE(LOG_WARN, "can't create subordinate group IDs");
+				fail_exit(E_SUB_GID_UPDATE, process_selinux);
+			}
 		}
-	}
 #endif				/* ENABLE_SUBIDS */
 
-	usr_update (subuid_count, subgid_count, &flags);
+		usr_update (subuid_count, subgid_count, &flags);
+
+		if (countflg) {
+			gids[i] = user_gid;
+		}
+	}
+	id_pool_free (gid_pool);
 
 	close_files (&flags);
 
@@ -2633,54 +2742,66 @@ int main (int argc, char **argv)
 	nscd_flush_cache ("group");
 	sssd_flush_cache (SSSD_DB_PASSWD | SSSD_DB_GROUP);
 
-	/*
-	 * tallylog_reset needs to be able to lookup
-	 * a valid existing user name,
-	 * so we cannot call it before close_files()
-	 */
-	if (!lflg && getpwuid (user_id) != NULL) {
-		tallylog_reset (user_name);
-	}
+	for (i = 0; i < n; i++) {
+		if (countflg) {
+			select_user (i);
+			user_id = uids[i];
+			user_gid = gids[i];
+			home_added = false;
+		}
+
+		/*
+		 * tallylog_reset needs to be able to lookup
+		 * a valid existing user name,
+		 * so we cannot call it before close_files()
+		 */
+		if (!lflg && getpwuid (user_id) != NULL) {
+			tallylog_reset (user_name);
+		}
 
 #ifdef WITH_SELINUX
-	if (Zflg) {
-		if (set_seuser (user_name, user_selinux, user_selinux_range) != 0) {
-			eprintf(_("%s: warning: the user name %s to %s SELinux user mapping failed.\n"),
-			         Prog, user_name, user_selinux);
+		if (Zflg) {
+			if (set_seuser (user_name, user_selinux, user_selinux_range) != 0) {
+				eprintf(_("%s: warning: the user name %s to %s SELinux user mapping failed.\n"),
+				         Prog, user_name, user_selinux);
 #ifdef WITH_AUDIT
-			audit_logger (AUDIT_ROLE_ASSIGN,
-			              "add-selinux-user-mapping",
-			              user_name, user_id, SHADOW_AUDIT_FAILURE);
+				audit_logger (AUDIT_ROLE_ASSIGN,
+				              "add-selinux-user-mapping",
+				              user_name, user_id, SHADOW_AUDIT_FAILURE);
 #endif				/* WITH_AUDIT */
-			fail_exit (E_SE_UPDATE, process_selinux);
+				fail_exit (E_SE_UPDATE, process_selinux);
+			}
 		}
-	}
 #endif				/* WITH_SELINUX */
 
-	if (mflg) {
-		create_home (&flags);
-		if (home_added) {
-			copy_tree (def_template, prefix_user_home, false,
-			           (uid_t)-1, user_id, (gid_t)-1, user_gid);
-			copy_tree (def_usrtemplate, prefix_user_home, false,
-			           (uid_t)-1, user_id, (gid_t)-1, user_gid);
-		} else {
-			eprintf(_("%s: warning: the home directory %s already exists.\n"
-			          "%s: Not copying any file from skel directory into it.\n"),
-			         Prog, user_home, Prog);
+		if (mflg) {
+			create_home (&flags);
+			if (home_added) {
+				copy_tree (def_template, prefix_user_home, false,
+				           (uid_t)-1, user_id, (gid_t)-1, user_gid);
+				copy_tree (def_usrtemplate, prefix_user_home, false,
+				           (uid_t)-1, user_id, (gid_t)-1, user_gid);
+			} else {
+				eprintf(_("%s: warning: the home directory %s already exists.\n"
+				          "%s: Not copying any file from skel directory into it.\n"),
+				         Prog, user_home, Prog);
+			}
+
 		}
 
-	}
+		/* Do not create mail directory for system accounts */
+		if (!rflg) {
+			create_mail (&flags);
+		}
 
-	/* Do not create mail directory for system accounts */
-	if (!rflg) {
-		create_mail (&flags);
+		if (run_parts ("/etc/shadow-maint/useradd-post.d", user_name,
+				"useradd")) {
+			exit(1);
+		}
 	}
 
-	if (run_parts ("/etc/shadow-maint/useradd-post.d", user_name,
-			"useradd")) {
-		exit(1);
-	}
+	free (uids);
+	free (gids);
 
 	return E_SUCCESS;
 }
@@ -87,6 +87,7 @@ static char *user_name;
 static uid_t user_id;
 static gid_t user_gid;
 static char *user_home;
+static /*@null@*/char *user_trash;	/* user_home, renamed to be removed */
 
 static bool fflg = false;
 static bool rflg = false;
@@ -127,6 +128,7 @@ static bool path_prefix (const char *, const char *);
 #endif				/* EXTRA_CHECK_HOME_DIR */
 static int is_owner (uid_t, const char *);
 static bool remove_mailbox (void);
+static /*@null@*/char *trash_home (const char *home);
 #ifdef WITH_TCB
 static int remove_tcbdir (const char *user_name, uid_t user_id);
 #endif				/* WITH_TCB */
@@ -528,6 +530,14 @@ static void fail_exit (int code, bool process_selinux)
 	}
 #endif				/* ENABLE_SUBIDS */
 
+	/* The user was not deleted: give its home directory back */
+	if (NULL != user_trash) {
+		if (rename (user_trash, user_home) != 0) {
+			eprintf(_("%s: cannot rename directory %s to %s\n"),
+			        Prog, user_trash, user_home);
+		}
+	}
+
 #ifdef WITH_AUDIT
 	audit_logger (AUDIT_DEL_USER,
 	              "delete-user",
@@ -819,6 +829,37 @@ static bool remove_mailbox (void)
 	return errors;
 }
 
+/*
+ * trash_home - rename the home directory, to remove it later
+ *
+ *	With USERDEL_DEFER_REMOVE, the home directory is renamed next to
+ *	itself while the databases are locked, and the renamed directory
+ *	is removed once the user was deleted.  The rename is atomic, and
+ *	the databases are not locked while the files are removed.
+ *
+ *	The new name is returned, or NULL if the directory could not be
+ *	renamed.
+ */
+static /*@null@*/char *trash_home (const char *home)
+{
+	char *trash;
+
+	trash = xaprintf("%s.userdel-XXXXXX", home);
+	if (NULL == mkdtemp (trash)) {
+		free (trash);
+		return NULL;
+	}
+
+	/* The empty directory created by mkdtemp is replaced */
+	if (rename (home, trash) != 0) {
+		(void) rmdir (trash);
+		free (trash);
+		return NULL;
+	}
+
+	return trash;
+}
+
 #ifdef WITH_TCB
 static int remove_tcbdir (const char *user_name, uid_t user_id)
 {
@@ -1091,7 +1132,11 @@ int main (int argc, char **argv)
 		}
 		else
 #endif
-		if (remove_tree (user_home, true) != 0) {
+		if (   getdef_bool ("USERDEL_DEFER_REMOVE")
+		    && NULL != (user_trash = trash_home (user_home))) {
+			/* It is removed once the user is deleted */
+		}
+		else if (remove_tree (user_home, true) != 0) {
 			eprintf(_("%s: error removing directory %s\n"),
 			         Prog, user_home);
 			errors = true;
@@ -1138,6 +1183,31 @@ int main (int argc, char **argv)
 		user_cancel (user_name);
 	close_files (&flags);
 
+	if (NULL != user_trash) {
+		if (remove_tree (user_trash, true) != 0) {
+			eprintf(_("%s: error removing directory %s\n"),
+			         Prog, user_trash);
+			errors = true;
+			/* continue */
+#ifdef WITH_AUDIT
+			audit_logger (AUDIT_DEL_USER,
+			              "deleting-home-directory",
+			              user_name, AUDIT_NO_ID,
+			              SHADOW_AUDIT_FAILURE);
+#endif				/* WITH_AUDIT */
+		}
+#ifdef WITH_AUDIT
+		else
+		{
+			audit_logger (AUDIT_USER_MGMT,
+			              "deleting-home-directory",
+			              user_name, user_id, SHADOW_AUDIT_SUCCESS);
+		}
+#endif				/* WITH_AUDIT */
+		free (user_trash);
+		user_trash = NULL;
+	}
+
 	if (run_parts ("/etc/shadow-maint/userdel-post.d", user_name, "userdel")) {
 		exit(1);
 	}
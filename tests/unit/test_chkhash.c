@@ -210,6 +210,22 @@ test_is_invalid_rounds(MAYBE_UNUSED void ** _1)
 }
 
 
+static void
+test_is_invalid_hash_chars(MAYBE_UNUSED void ** _1)
+{
+	// Characters out of [./A-Za-z0-9] in the hash
+	assert_false(is_valid_hash("$y$j9T$salt$abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOP:"));
+	assert_false(is_valid_hash("$2a$12$abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXY$."));
+
+	// Trailing characters after the hash
+	assert_false(is_valid_hash("$5$salt$abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQ\n"));
+	assert_false(is_valid_hash("$6$salt$abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ1234567890./abcdefghijklmnopqrstuvw"));
+
+	// A rounds= which is not valid is part of the salt
+	assert_true(is_valid_hash("$5$rounds=100$abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQ"));
+}
+
+
 int
 main(void)
 {
@@ -226,6 +242,7 @@ main(void)
         cmocka_unit_test(test_is_invalid_delimeters),
         cmocka_unit_test(test_is_invalid_salt_chars),
         cmocka_unit_test(test_is_invalid_rounds),
+        cmocka_unit_test(test_is_invalid_hash_chars),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pwd.h>
+#include <shadow.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <stdarg.h>  // Required by <cmocka.h>
+#include <stddef.h>  // Required by <cmocka.h>
+#include <setjmp.h>  // Required by <cmocka.h>
+#include <stdint.h>  // Required by <cmocka.h>
+#include <cmocka.h>
+
+#include "attr.h"
+#include "dbtxn.h"
+#include "pwio.h"
+#include "shadowio.h"
+#include "string/sprintf/stprintf.h"
+#include "string/strcmp/streq.h"
+
+
+#define PASSWD_DATA  "root:x:0:0:root:/root:/bin/sh\n"
+#define SHADOW_DATA  "root:*:19000:0:99999:7:::\n"
+
+
+static char  dir[] = "/tmp/test_dbtxn.XXXXXX";
+static char  passwd_path[sizeof(dir) + 16];
+static char  shadow_path[sizeof(dir) + 16];
+
+/* rename(2) fails to replace this file, if not NULL */
+static const char  *fail_rename = NULL;
+
+
+int __real_rename(const char *old, const char *new);
+int __wrap_rename(const char *old, const char *new);
+
+static int setup(MAYBE_UNUSED void ** _1);
+static int teardown(MAYBE_UNUSED void ** _1);
+static void test_dbtxn_commit(MAYBE_UNUSED void ** _1);
+static void test_dbtxn_commit_rename_failure(MAYBE_UNUSED void ** _1);
+static void test_dbtxn_unlock_discards(MAYBE_UNUSED void ** _1);
+
+
+int
+main(void)
+{
+    const struct CMUnitTest  tests[] = {
+        cmocka_unit_test_setup_teardown(test_dbtxn_commit,
+                                        setup, teardown),
+        cmocka_unit_test_setup_teardown(test_dbtxn_commit_rename_failure,
+                                        setup, teardown),
+        cmocka_unit_test_setup_teardown(test_dbtxn_unlock_discards,
+                                        setup, teardown),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+
+int
+__wrap_rename(const char *old, const char *new)
+{
+	if (NULL != fail_rename && streq(new, fail_rename)) {
+		errno = EIO;
+		return -1;
+	}
+	return __real_rename(old, new);
+}
+
+
+static void
+write_file(const char *path, const char *s)
+{
+	FILE  *fp;
+
+	fp = fopen(path, "w");
+	assert_non_null(fp);
+	assert_int_not_equal(fputs(s, fp), EOF);
+	assert_int_equal(fclose(fp), 0);
+}
+
+
+static void
+assert_file_equal(const char *path, const char *s)
+{
+	FILE    *fp;
+	char    buf[BUFSIZ];
+	size_t  n;
+
+	fp = fopen(path, "r");
+	assert_non_null(fp);
+	n = fread(buf, 1, sizeof(buf) - 1, fp);
+	buf[n] = '\0';
+	assert_int_equal(fclose(fp), 0);
+	assert_string_equal(buf, s);
+}
+
+
+static void
+remove_file(const char *path)
+{
+	char  p[sizeof(dir) + 32];
+
+	(void) unlink(path);
+	assert_int_not_equal(stprintf_a(p, "%s-", path), -1);
+	(void) unlink(p);
+}
+
+
+static int
+setup(MAYBE_UNUSED void ** _1)
+{
+	strcpy(dir, "/tmp/test_dbtxn.XXXXXX");
+	if (mkdtemp(dir) == NULL)
+		return -1;
+	if (stprintf_a(passwd_path, "%s/passwd", dir) == -1)
+		return -1;
+	if (stprintf_a(shadow_path, "%s/shadow", dir) == -1)
+		return -1;
+
+	write_file(passwd_path, PASSWD_DATA);
+	write_file(shadow_path, SHADOW_DATA);
+	pw_setdbname(passwd_path);
+	spw_setdbname(shadow_path);
+	fail_rename = NULL;
+	return 0;
+}
+
+
+static int
+teardown(MAYBE_UNUSED void ** _1)
+{
+	remove_file(passwd_path);
+	remove_file(shadow_path);
+	return rmdir(dir);
+}
+
+
+/* Add the user "test" to the passwd and shadow databases. */
+static void
+add_user(struct dbtxn *txn)
+{
+	struct passwd  pw = {
+		.pw_name = "test",
+		.pw_passwd = "x",
+		.pw_uid = 1000,
+		.pw_gid = 1000,
+		.pw_gecos = "",
+		.pw_dir = "/home/test",
+		.pw_shell = "/bin/sh",
+	};
+	struct spwd    sp = {
+		.sp_namp = "test",
+		.sp_pwdp = "!",
+		.sp_lstchg = 19000,
+		.sp_min = -1,
+		.sp_max = -1,
+		.sp_warn = -1,
+		.sp_inact = -1,
+		.sp_expire = -1,
+		.sp_flag = SHADOW_SP_FLAG_UNSET,
+	};
+
+	dbtxn_init(txn, DBTXN_PASSWD | DBTXN_SHADOW, false);
+	assert_int_equal(dbtxn_lock(txn), 1);
+	assert_int_equal(dbtxn_open(txn, O_CREAT | O_RDWR), 1);
+	assert_int_equal(pw_update(&pw), 1);
+	assert_int_equal(spw_update(&sp), 1);
+}
+
+
+static void
+test_dbtxn_commit(MAYBE_UNUSED void ** _1)
+{
+	struct dbtxn  txn;
+
+	add_user(&txn);
+
+	assert_int_equal(dbtxn_commit(&txn), 1);
+	assert_null(txn.failed);
+	assert_int_equal(dbtxn_unlock(&txn), 1);
+
+	assert_file_equal(passwd_path,
+	                  PASSWD_DATA "test:x:1000:1000::/home/test:/bin/sh\n");
+	assert_file_equal(shadow_path, SHADOW_DATA "test:!:19000::::::\n");
+}
+
+
+static void
+test_dbtxn_commit_rename_failure(MAYBE_UNUSED void ** _1)
+{
+	struct dbtxn  txn;
+
+	add_user(&txn);
+
+	/* passwd is installed first, and must be restored */
+	fail_rename = shadow_path;
+	assert_int_equal(dbtxn_commit(&txn), 0);
+	fail_rename = NULL;
+	assert_non_null(txn.failed);
+	assert_string_equal(txn.failed, shadow_path);
+	assert_int_equal(dbtxn_unlock(&txn), 1);
+
+	assert_file_equal(passwd_path, PASSWD_DATA);
+	assert_file_equal(shadow_path, SHADOW_DATA);
+}
+
+
+static void
+test_dbtxn_unlock_discards(MAYBE_UNUSED void ** _1)
+{
+	struct dbtxn  txn;
+
+	add_user(&txn);
+
+	assert_int_equal(dbtxn_unlock(&txn), 1);
+
+	assert_file_equal(passwd_path, PASSWD_DATA);
+	assert_file_equal(shadow_path, SHADOW_DATA);
+}
@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <stdarg.h>  // Required by <cmocka.h>
+#include <stddef.h>  // Required by <cmocka.h>
+#include <setjmp.h>  // Required by <cmocka.h>
+#include <stdint.h>  // Required by <cmocka.h>
+#include <cmocka.h>
+
+#include "attr.h"
+#include "idhint.h"
+#include "string/sprintf/stprintf.h"
+
+
+static char  dir[] = "/tmp/test_idhint.XXXXXX";
+static char  dbfile[sizeof(dir) + 16];
+static char  hintfile[sizeof(dir) + 16];
+
+static const struct idhint  hint = {
+	.sys = false,
+	.min = 1000,
+	.max = 60000,
+	.next = 1042,
+};
+
+
+static int setup(MAYBE_UNUSED void ** _1);
+static int teardown(MAYBE_UNUSED void ** _1);
+static void test_idhint_read(MAYBE_UNUSED void ** _1);
+static void test_idhint_missing(MAYBE_UNUSED void ** _1);
+static void test_idhint_modified(MAYBE_UNUSED void ** _1);
+static void test_idhint_replaced(MAYBE_UNUSED void ** _1);
+static void test_idhint_invalid(MAYBE_UNUSED void ** _1);
+
+
+int
+main(void)
+{
+    const struct CMUnitTest  tests[] = {
+        cmocka_unit_test_setup_teardown(test_idhint_read,
+                                        setup, teardown),
+        cmocka_unit_test_setup_teardown(test_idhint_missing,
+                                        setup, teardown),
+        cmocka_unit_test_setup_teardown(test_idhint_modified,
+                                        setup, teardown),
+        cmocka_unit_test_setup_teardown(test_idhint_replaced,
+                                        setup, teardown),
+        cmocka_unit_test_setup_teardown(test_idhint_invalid,
+                                        setup, teardown),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+
+static void
+write_file(const char *path, const char *mode, const char *s)
+{
+	FILE  *fp;
+
+	fp = fopen(path, mode);
+	assert_non_null(fp);
+	assert_int_not_equal(fputs(s, fp), EOF);
+	assert_int_equal(fclose(fp), 0);
+}
+
+
+static int
+setup(MAYBE_UNUSED void ** _1)
+{
+	strcpy(dir, "/tmp/test_idhint.XXXXXX");
+	if (mkdtemp(dir) == NULL)
+		return -1;
+	if (stprintf_a(dbfile, "%s/passwd", dir) == -1)
+		return -1;
+	if (stprintf_a(hintfile, "%s/uid.hint", dir) == -1)
+		return -1;
+
+	write_file(dbfile, "w", "root:x:0:0:root:/root:/bin/sh\n");
+	idhint_setdir(dir);
+	return 0;
+}
+
+
+static int
+teardown(MAYBE_UNUSED void ** _1)
+{
+	char  p[sizeof(dir) + 16];
+
+	(void) unlink(hintfile);
+	if (stprintf_a(p, "%s/gid.hint", dir) != -1)
+		(void) unlink(p);
+	(void) unlink(dbfile);
+	idhint_setdir(IDHINT_DIR);
+	return rmdir(dir);
+}
+
+
+static void
+test_idhint_read(MAYBE_UNUSED void ** _1)
+{
+	struct idhint  h;
+
+	assert_int_equal(idhint_write("uid", dbfile, &hint), 0);
+	assert_int_equal(idhint_read("uid", dbfile, &h), 0);
+
+	assert_false(h.sys);
+	assert_int_equal(h.min, 1000);
+	assert_int_equal(h.max, 60000);
+	assert_int_equal(h.next, 1042);
+}
+
+
+static void
+test_idhint_missing(MAYBE_UNUSED void ** _1)
+{
+	struct idhint  h;
+
+	assert_int_equal(idhint_read("uid", dbfile, &h), -1);
+
+	/* The hint of another database */
+	assert_int_equal(idhint_write("gid", dbfile, &hint), 0);
+	assert_int_equal(idhint_read("uid", dbfile, &h), -1);
+}
+
+
+static void
+test_idhint_modified(MAYBE_UNUSED void ** _1)
+{
+	struct idhint  h;
+
+	assert_int_equal(idhint_write("uid", dbfile, &hint), 0);
+
+	write_file(dbfile, "a", "test:x:1042:1042::/home/test:/bin/sh\n");
+
+	assert_int_equal(idhint_read("uid", dbfile, &h), -1);
+}
+
+
+static void
+test_idhint_replaced(MAYBE_UNUSED void ** _1)
+{
+	char           tmp[sizeof(dir) + 16];
+	struct idhint  h;
+
+	assert_int_equal(idhint_write("uid", dbfile, &hint), 0);
+
+	/* Same contents, but another file */
+	assert_int_not_equal(stprintf_a(tmp, "%s/passwd+", dir), -1);
+	write_file(tmp, "w", "root:x:0:0:root:/root:/bin/sh\n");
+	assert_int_equal(rename(tmp, dbfile), 0);
+
+	assert_int_equal(idhint_read("uid", dbfile, &h), -1);
+}
+
+
+static void
+test_idhint_invalid(MAYBE_UNUSED void ** _1)
+{
+	struct idhint  h;
+
+	assert_int_equal(idhint_write("uid", dbfile, &hint), 0);
+	assert_int_equal(idhint_read("uid", dbfile, &h), 0);
+
+	write_file(hintfile, "w", "v1 0 1000 60000\n");
+	assert_int_equal(idhint_read("uid", dbfile, &h), -1);
+
+	write_file(hintfile, "w", "garbage\n");
+	assert_int_equal(idhint_read("uid", dbfile, &h), -1);
+}
@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include <stdarg.h>  // Required by <cmocka.h>
+#include <stddef.h>  // Required by <cmocka.h>
+#include <setjmp.h>  // Required by <cmocka.h>
+#include <stdint.h>  // Required by <cmocka.h>
+#include <cmocka.h>
+
+#include "attr.h"
+#include "idset.h"
+
+
+static void test_idset_sort(MAYBE_UNUSED void ** _1);
+static void test_idset_has(MAYBE_UNUSED void ** _1);
+static void test_idset_insert(MAYBE_UNUSED void ** _1);
+static void test_idset_next_free(MAYBE_UNUSED void ** _1);
+static void test_idset_next_free_limits(MAYBE_UNUSED void ** _1);
+static void test_idset_prev_free(MAYBE_UNUSED void ** _1);
+static void test_idset_prev_free_limits(MAYBE_UNUSED void ** _1);
+
+
+int
+main(void)
+{
+    const struct CMUnitTest  tests[] = {
+        cmocka_unit_test(test_idset_sort),
+        cmocka_unit_test(test_idset_has),
+        cmocka_unit_test(test_idset_insert),
+        cmocka_unit_test(test_idset_next_free),
+        cmocka_unit_test(test_idset_next_free_limits),
+        cmocka_unit_test(test_idset_prev_free),
+        cmocka_unit_test(test_idset_prev_free_limits),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+
+static void
+add_ids(struct idset *set, const id_t *ids, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		assert_int_equal(idset_add(set, ids[i]), 0);
+	idset_sort(set);
+}
+
+
+static void
+test_idset_sort(MAYBE_UNUSED void ** _1)
+{
+	struct idset  set = IDSET_INIT;
+	const id_t    ids[] = {1005, 1001, 1003, 1001, 1002, 1005, 1000};
+
+	add_ids(&set, ids, 7);
+
+	assert_int_equal(set.n, 5);
+	assert_int_equal(set.ids[0], 1000);
+	assert_int_equal(set.ids[1], 1001);
+	assert_int_equal(set.ids[2], 1002);
+	assert_int_equal(set.ids[3], 1003);
+	assert_int_equal(set.ids[4], 1005);
+
+	idset_free(&set);
+	assert_null(set.ids);
+	assert_int_equal(set.n, 0);
+}
+
+
+static void
+test_idset_has(MAYBE_UNUSED void ** _1)
+{
+	struct idset  set = IDSET_INIT;
+	const id_t    ids[] = {1000, 1001, 1003, 2000000000};
+
+	assert_false(idset_has(&set, 1000));
+
+	add_ids(&set, ids, 4);
+
+	assert_true(idset_has(&set, 1000));
+	assert_true(idset_has(&set, 1001));
+	assert_false(idset_has(&set, 1002));
+	assert_true(idset_has(&set, 1003));
+	assert_false(idset_has(&set, 999));
+	assert_false(idset_has(&set, 1004));
+	assert_true(idset_has(&set, 2000000000));
+
+	idset_free(&set);
+}
+
+
+static void
+test_idset_insert(MAYBE_UNUSED void ** _1)
+{
+	struct idset  set = IDSET_INIT;
+	const id_t    ids[] = {1000, 1002, 1004};
+
+	add_ids(&set, ids, 3);
+
+	assert_int_equal(idset_insert(&set, 1003), 0);
+	assert_int_equal(idset_insert(&set, 999), 0);
+	assert_int_equal(idset_insert(&set, 1005), 0);
+	assert_int_equal(idset_insert(&set, 1002), 0);
+
+	assert_int_equal(set.n, 6);
+	assert_int_equal(set.ids[0], 999);
+	assert_int_equal(set.ids[1], 1000);
+	assert_int_equal(set.ids[2], 1002);
+	assert_int_equal(set.ids[3], 1003);
+	assert_int_equal(set.ids[4], 1004);
+	assert_int_equal(set.ids[5], 1005);
+
+	idset_free(&set);
+
+	for (id_t id = 200; id > 0; id--)
+		assert_int_equal(idset_insert(&set, id), 0);
+	assert_int_equal(set.n, 200);
+	for (size_t i = 0; i < set.n; i++)
+		assert_int_equal(set.ids[i], i + 1);
+
+	idset_free(&set);
+}
+
+
+static void
+test_idset_next_free(MAYBE_UNUSED void ** _1)
+{
+	struct idset  set = IDSET_INIT;
+	id_t          id;
+	const id_t    ids[] = {1000, 1001, 1002, 1004};
+
+	add_ids(&set, ids, 4);
+
+	id = 1000;
+	assert_true(idset_next_free(&set, &id, 60000));
+	assert_int_equal(id, 1003);
+
+	id = 1004;
+	assert_true(idset_next_free(&set, &id, 60000));
+	assert_int_equal(id, 1005);
+
+	id = 999;
+	assert_true(idset_next_free(&set, &id, 60000));
+	assert_int_equal(id, 999);
+
+	idset_free(&set);
+}
+
+
+static void
+test_idset_next_free_limits(MAYBE_UNUSED void ** _1)
+{
+	struct idset  set = IDSET_INIT;
+	id_t          id;
+	const id_t    ids[] = {1000, 1001, 1002, UINT32_MAX};
+
+	add_ids(&set, ids, 4);
+
+	id = 1000;
+	assert_false(idset_next_free(&set, &id, 1002));
+
+	id = 1003;
+	assert_false(idset_next_free(&set, &id, 1002));
+
+	id = UINT32_MAX;
+	assert_false(idset_next_free(&set, &id, UINT32_MAX));
+
+	idset_free(&set);
+}
+
+
+static void
+test_idset_prev_free(MAYBE_UNUSED void ** _1)
+{
+	struct idset  set = IDSET_INIT;
+	id_t          id;
+	const id_t    ids[] = {996, 998, 999, 1000};
+
+	add_ids(&set, ids, 4);
+
+	id = 1000;
+	assert_true(idset_prev_free(&set, &id, 101));
+	assert_int_equal(id, 997);
+
+	id = 996;
+	assert_true(idset_prev_free(&set, &id, 101));
+	assert_int_equal(id, 995);
+
+	id = 1001;
+	assert_true(idset_prev_free(&set, &id, 101));
+	assert_int_equal(id, 1001);
+
+	idset_free(&set);
+}
+
+
+static void
+test_idset_prev_free_limits(MAYBE_UNUSED void ** _1)
+{
+	struct idset  set = IDSET_INIT;
+	id_t          id;
+	const id_t    ids[] = {0, 101, 102, 103};
+
+	add_ids(&set, ids, 4);
+
+	id = 103;
+	assert_false(idset_prev_free(&set, &id, 101));
+
+	id = 100;
+	assert_false(idset_prev_free(&set, &id, 101));
+
+	id = 0;
+	assert_false(idset_prev_free(&set, &id, 0));
+
+	idset_free(&set);
+}
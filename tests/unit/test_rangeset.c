@@ -0,0 +1,246 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <stdarg.h>  // Required by <cmocka.h>
+#include <stddef.h>  // Required by <cmocka.h>
+#include <setjmp.h>  // Required by <cmocka.h>
+#include <stdint.h>  // Required by <cmocka.h>
+#include <cmocka.h>
+
+#include "attr.h"
+#include "rangeset.h"
+
+
+static void test_rangeset_sort(MAYBE_UNUSED void ** _1);
+static void test_rangeset_overlap(MAYBE_UNUSED void ** _1);
+static void test_rangeset_insert(MAYBE_UNUSED void ** _1);
+static void test_rangeset_remove(MAYBE_UNUSED void ** _1);
+static void test_rangeset_find_free(MAYBE_UNUSED void ** _1);
+static void test_rangeset_find_free_limits(MAYBE_UNUSED void ** _1);
+
+
+int
+main(void)
+{
+    const struct CMUnitTest  tests[] = {
+        cmocka_unit_test(test_rangeset_sort),
+        cmocka_unit_test(test_rangeset_overlap),
+        cmocka_unit_test(test_rangeset_insert),
+        cmocka_unit_test(test_rangeset_remove),
+        cmocka_unit_test(test_rangeset_find_free),
+        cmocka_unit_test(test_rangeset_find_free_limits),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
+
+
+static char  data[8];
+
+
+static void
+add_ranges(struct rangeset *set, const unsigned long (*r)[2], size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		assert_int_equal(rangeset_add(set, r[i][0], r[i][1], &data[i]), 0);
+	rangeset_sort(set);
+}
+
+
+/* The number of ranges including id, and the data of the last one. */
+static size_t
+count_at(const struct rangeset *set, unsigned long id, void **last)
+{
+	size_t  n, pos;
+	void    *d;
+
+	n = 0;
+	pos = rangeset_upto(set, id);
+	while (NULL != (d = rangeset_prev_overlap(set, id, &pos))) {
+		if (0 == n)
+			*last = d;
+		n++;
+	}
+	return n;
+}
+
+
+static void
+test_rangeset_sort(MAYBE_UNUSED void ** _1)
+{
+	struct rangeset      set = RANGESET_INIT;
+	const unsigned long  r[][2] = {
+		{300000, 10000}, {100000, 65536}, {165536, 65536}, {250000, 100},
+	};
+
+	add_ranges(&set, r, 4);
+
+	assert_int_equal(set.n, 4);
+	assert_int_equal(set.slots[0].first, 100000);
+	assert_int_equal(set.slots[1].first, 165536);
+	assert_int_equal(set.slots[2].first, 250000);
+	assert_int_equal(set.slots[3].first, 300000);
+	assert_int_equal(set.slots[3].last, 309999);
+
+	/* Adjacent ranges are merged in the spans */
+	assert_int_equal(set.nspans, 3);
+	assert_int_equal(set.spans[0].first, 100000);
+	assert_int_equal(set.spans[0].last, 231071);
+
+	rangeset_free(&set);
+	assert_null(set.slots);
+	assert_int_equal(set.n, 0);
+}
+
+
+static void
+test_rangeset_overlap(MAYBE_UNUSED void ** _1)
+{
+	struct rangeset      set = RANGESET_INIT;
+	void                 *last;
+	const unsigned long  r[][2] = {
+		{100000, 599990001}, {200000, 10000}, {300000, 10000},
+		{700000000, 10},
+	};
+
+	add_ranges(&set, r, 4);
+
+	assert_int_equal(count_at(&set, 99999, &last), 0);
+	assert_int_equal(count_at(&set, 100000, &last), 1);
+	assert_ptr_equal(last, &data[0]);
+	assert_int_equal(count_at(&set, 205000, &last), 2);
+	assert_ptr_equal(last, &data[1]);
+	assert_int_equal(count_at(&set, 250000, &last), 1);
+	assert_ptr_equal(last, &data[0]);
+	assert_int_equal(count_at(&set, 600090001, &last), 0);
+	assert_int_equal(count_at(&set, 700000009, &last), 1);
+	assert_ptr_equal(last, &data[3]);
+
+	rangeset_free(&set);
+}
+
+
+static void
+test_rangeset_insert(MAYBE_UNUSED void ** _1)
+{
+	struct rangeset      set = RANGESET_INIT;
+	void                 *last;
+	const unsigned long  r[][2] = {{100000, 10000}, {300000, 10000}};
+
+	add_ranges(&set, r, 2);
+
+	assert_int_equal(rangeset_insert(&set, 200000, 10000, &data[2]), 0);
+	assert_int_equal(set.n, 3);
+	assert_int_equal(set.slots[1].first, 200000);
+	assert_int_equal(set.nspans, 3);
+
+	/* Filling the holes merges the spans */
+	assert_int_equal(rangeset_insert(&set, 110000, 90000, &data[3]), 0);
+	assert_int_equal(rangeset_insert(&set, 210000, 90000, &data[4]), 0);
+	assert_int_equal(set.nspans, 1);
+	assert_int_equal(set.spans[0].first, 100000);
+	assert_int_equal(set.spans[0].last, 309999);
+
+	assert_int_equal(count_at(&set, 209999, &last), 1);
+	assert_ptr_equal(last, &data[2]);
+	assert_int_equal(count_at(&set, 210000, &last), 1);
+	assert_ptr_equal(last, &data[4]);
+
+	rangeset_free(&set);
+
+	for (unsigned long i = 200; i > 0; i--)
+		assert_int_equal(rangeset_insert(&set, i * 10, 5, NULL), 0);
+	assert_int_equal(set.n, 200);
+	assert_int_equal(set.nspans, 200);
+	for (size_t i = 0; i < set.n; i++)
+		assert_int_equal(set.slots[i].first, (i + 1) * 10);
+
+	rangeset_free(&set);
+}
+
+
+static void
+test_rangeset_remove(MAYBE_UNUSED void ** _1)
+{
+	struct rangeset      set = RANGESET_INIT;
+	void                 *last;
+	const unsigned long  r[][2] = {
+		{100000, 200000}, {150000, 10000}, {150000, 10000},
+		{300000, 10000},
+	};
+
+	add_ranges(&set, r, 4);
+	assert_int_equal(set.nspans, 1);
+
+	assert_int_equal(rangeset_remove(&set, 150000, &data[3]), -1);
+	assert_int_equal(rangeset_remove(&set, 150000, &data[2]), 0);
+	assert_int_equal(count_at(&set, 155000, &last), 2);
+
+	/* The long range hid the end of the others */
+	assert_int_equal(rangeset_remove(&set, 100000, &data[0]), 0);
+	assert_int_equal(count_at(&set, 200000, &last), 0);
+	assert_int_equal(count_at(&set, 155000, &last), 1);
+	assert_ptr_equal(last, &data[1]);
+	assert_int_equal(set.nspans, 2);
+	assert_int_equal(set.spans[0].first, 150000);
+	assert_int_equal(set.spans[0].last, 159999);
+
+	rangeset_free(&set);
+}
+
+
+static void
+test_rangeset_find_free(MAYBE_UNUSED void ** _1)
+{
+	struct rangeset      set = RANGESET_INIT;
+	unsigned long        start;
+	const unsigned long  r[][2] = {
+		{90000, 5000}, {100000, 5000}, {200000, 10000},
+		{200000, 15000}, {300000, 10000},
+	};
+
+	assert_true(rangeset_find_free(&set, 100000, 600100000, 65536, &start));
+	assert_int_equal(start, 100000);
+
+	add_ranges(&set, r, 5);
+
+	assert_true(rangeset_find_free(&set, 100000, 600100000, 10000, &start));
+	assert_int_equal(start, 105000);
+	assert_true(rangeset_find_free(&set, 100000, 600100000, 95000, &start));
+	assert_int_equal(start, 105000);
+	assert_true(rangeset_find_free(&set, 100000, 600100000, 95001, &start));
+	assert_int_equal(start, 310000);
+	assert_true(rangeset_find_free(&set, 203000, 600100000, 1000, &start));
+	assert_int_equal(start, 215000);
+
+	rangeset_free(&set);
+}
+
+
+static void
+test_rangeset_find_free_limits(MAYBE_UNUSED void ** _1)
+{
+	struct rangeset      set = RANGESET_INIT;
+	unsigned long        start;
+	const unsigned long  r[][2] = {
+		{100000, 599990001}, {600100001, 10000},
+	};
+
+	add_ranges(&set, r, 2);
+
+	assert_true(rangeset_find_free(&set, 100000, 600100000, 10000, &start));
+	assert_int_equal(start, 600090001);
+	assert_false(rangeset_find_free(&set, 100000, 600100000, 10001, &start));
+	assert_false(rangeset_find_free(&set, 100000, 100000, 2, &start));
+	assert_false(rangeset_find_free(&set, 100000, 200000, 0, &start));
+
+	assert_true(rangeset_find_free(&set, 600110001, UINT32_MAX, 1, &start));
+	assert_int_equal(start, 600110001);
+	assert_true(rangeset_find_free(&set, UINT32_MAX, UINT32_MAX, 1, &start));
+	assert_int_equal(start, UINT32_MAX);
+
+	rangeset_free(&set);
+}